@@ -3,9 +3,12 @@
 #include "devicelibrary.h"
 #include "entrypoint.h"
 #include "graphics/buffers.h"
+#include "graphics/geometrypool.h"
 #include "graphics/graphicspipeline.h"
 #include "graphics/pipelinebuilder.h"
 #include "graphics/texture.h"
+#include "graphics/texturestreamer.h"
+#include "graphics/uploadqueue.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_vulkan.h"
@@ -57,15 +60,109 @@ void initRenderWindow(AssetCache& cache) {
     }    
   }
   ImGui::DragFloat("Line Width", &lineWidth, 1.0f, 1.0f, 64.0f, NULL, ImGuiSliderFlags_AlwaysClamp);
+  ImGui::DragFloat("LOD Error (px)", &Graphics::getLodThreshold(), 0.1f, 0.0f, 64.0f, NULL, ImGuiSliderFlags_AlwaysClamp);
+  ImGui::Checkbox("Frustum Culling", &Graphics::getFrustumCulling());
+  ImGui::Text("Draws: %u submitted, %u culled", Graphics::getDrawnCount(), Graphics::getCulledCount());
+  ImGui::Text("Instanced into %u draw calls", Graphics::getBatchCount());
+  ImGui::Text("Record %.3f ms CPU, scene %.3f ms GPU", Graphics::getRecordTime(), Graphics::getSceneGpuTime());
+  ImGui::Text("Textures still loading: %zu", cache.getPendingTextures());
+  size_t textureBytes = 0, uncompressedBytes = 0;
+  for (Texture *texture : cache.getTextures()) {
+    if (texture->isLoaded()) {
+      textureBytes += texture->getMemorySize();
+      uncompressedBytes += BlockCompressor::getChainSize(texture->getWidth(), texture->getHeight(), BlockCompressor::FORMAT_RGBA8);
+    }
+  }
+  ImGui::Text("Texture memory %.1f MB, %.1f MB as RGBA8", textureBytes / 1048576.0, uncompressedBytes / 1048576.0);
+  ImGui::Text("Texture cache: %zu hits, %zu misses, %.1f MB saved by sharing", cache.getTextureHits(), cache.getTextureMisses(),
+              cache.getTextureBytesSaved() / 1048576.0);
+  // Off, the textures still streaming are filled in whatever their distance.
+  bool streaming = Texture::getStreaming();
+  if (ImGui::Checkbox("Stream Textures", &streaming)) {
+    Texture::getStreaming() = streaming;
+  }
+  int streamBudget = static_cast<int>(TextureStreamer::getFrameBudget() >> 20);
+  if (ImGui::SliderInt("Stream Budget (MB/frame)", &streamBudget, 1, 256)) {
+    TextureStreamer::getFrameBudget() = static_cast<size_t>(streamBudget) << 20;
+  }
+  ImGui::Text("Streaming: %u textures partial, %.2f MB last frame", TextureStreamer::getStreamingCount(),
+              TextureStreamer::getStreamedBytes() / 1048576.0);
+  // Only applied once the slider is let go, every change waits for the uploads
+  // in flight and makes a new ring.
+  static int stagingBudget = static_cast<int>(UploadQueue::getStagingBudget() >> 20);
+  ImGui::SliderInt("Staging Budget (MB)", &stagingBudget, 4, 256);
+  if (ImGui::IsItemDeactivatedAfterEdit()) {
+    UploadQueue::setStagingBudget(static_cast<VkDeviceSize>(stagingBudget) << 20);
+  }
+  ImGui::Text("Uploads: %llu batches, %.2f MB staged in flight, %.2f MB peak", static_cast<unsigned long long>(UploadQueue::getSubmitCount()),
+              UploadQueue::getStagingInFlight() / 1048576.0, UploadQueue::getStagingPeak() / 1048576.0);
   
-  for(Model *model : cache.getModels()) {
-    
-    if(ImGui::Button(("Kill " + model->getID()).c_str())) {
-      cache.remove(model->getID());
+  size_t indexBytesSaved = 0;
+  for (Mesh *mesh : cache.getMeshes()) {
+    indexBytesSaved += mesh->getIndexBytesSaved();
+  }
+  ImGui::Text("16 bit indices saved %.1f KB across the scene", indexBytesSaved / 1024.0);
+  const char *poolNames[GeometryPool::POOL_COUNT] = {"Vertices", "Packed vertices", "16 bit indices", "32 bit indices", "Meshlets"};
+  for (uint32_t kind = 0; kind < GeometryPool::POOL_COUNT; kind++) {
+    GeometryPool &pool = GeometryPool::get(static_cast<GeometryPool::Kind>(kind));
+    ImGui::Text("%s pool: %zu ranges, %.1f / %.1f MB, %u moves", poolNames[kind], pool.getRangeCount(),
+                pool.getUsed() * pool.getStride() / 1048576.0, pool.getCapacity() * pool.getStride() / 1048576.0, pool.getRelocations());
+  }
+  if (ImGui::Button("Compact Geometry")) {
+    GeometryPool::compactAll(true);
+  }
+  // Pools grown from now on, the buffers already there stay where they are.
+  ImGui::BeginDisabled(!Buffers::hasHostVisibleVram());
+  ImGui::Checkbox("Write Geometry Into VRAM (ReBAR/UMA)", &Buffers::getDirectWrite());
+  ImGui::EndDisabled();
+  VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+  vmaGetHeapBudgets(Buffers::getAllocator(), budgets);
+  const VkPhysicalDeviceMemoryProperties *memProperties;
+  vmaGetMemoryProperties(Buffers::getAllocator(), &memProperties);
+  for (uint32_t heap = 0; heap < memProperties->memoryHeapCount; heap++) {
+    ImGui::Text("Heap %u (%s): %.1f / %.1f MB", heap,
+                (memProperties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "device local" : "system",
+                budgets[heap].usage / 1048576.0, budgets[heap].budget / 1048576.0);
+  }
+
+  // Collapsed by default, the stress scene has ten thousand of these.
+  const std::vector<Model *> models = cache.getModels();
+  if(ImGui::TreeNode("Models", "Models (%zu)", models.size())) {
+    for(Model *model : models) {
+      
+      if(ImGui::Button(("Kill " + model->getID()).c_str())) {
+        cache.remove(model->getID());
+        // The model is gone, and so is its mesh if this was the last one using it.
+        continue;
+      }
+      
+      const std::vector<Agnosia_T::LodLevel> &lods = model->getMesh()->getLods();
+      ImGui::Text("LOD %u/%zu: %u triangles", model->getLod(), lods.size() - 1, lods[model->getLod()].indexCount / 3);
     }
-    
-    int polycount =  model->getIndices()/3;
+    ImGui::TreePop();
+  }
+
+  // Each mesh once, however many models share it.
+  for (Mesh *mesh : cache.getMeshes()) {
+    ImGui::SeparatorText(mesh->getID().c_str());
+    ImGui::Text("Used by %u models", mesh->getReferences());
+    int polycount =  mesh->getIndices()/3;
     ImGui::Text("Polycount: %d", polycount);
+    ImGui::Text("Loaded in %.2f ms (%s)", mesh->getLoadTime(), mesh->isCooked() ? "cooked" : "OBJ");
+    ImGui::Text("ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", mesh->getCacheBefore().acmr, mesh->getCacheAfter().acmr,
+                mesh->getCacheBefore().atvr, mesh->getCacheAfter().atvr);
+    ImGui::Text("LOD levels: %zu", mesh->getLods().size());
+    ImGui::Text("Meshlets: %u", mesh->getMeshletCount());
+    if (mesh->getVertexFormat() == Agnosia_T::VERTEX_PACKED) {
+      const Agnosia_T::PackingError error = mesh->getPackingError();
+      ImGui::Text("Packed vertices: %zu -> %zu KB", mesh->getVertices() * sizeof(Agnosia_T::Vertex) / 1024,
+                  mesh->getVertices() * sizeof(Agnosia_T::PackedVertex) / 1024);
+      ImGui::Text("Max error: pos %.2e, normal %.4f deg, uv %.2e", error.position, error.normal, error.uv);
+    } else {
+      ImGui::Text("Full vertices: %zu KB", mesh->getVertices() * sizeof(Agnosia_T::Vertex) / 1024);
+    }
+    ImGui::Text("Indices: %s bit", mesh->getBuffers().indexType == VK_INDEX_TYPE_UINT16 ? "16" : "32");
+    ImGui::Text("Memory: %s", Buffers::getMemoryName(mesh->getMemoryFlags()));
   }
   
 }
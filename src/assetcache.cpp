@@ -1,16 +1,192 @@
-
 #include "assetcache.h"
 #include "devicelibrary.h"
+#include "graphics/buffers.h"
+#include "graphics/geometrypool.h"
+#include "utils/hash.h"
+#include "utils/sourcestamp.h"
+#include "utils/threadpool.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Hashes a file's bytes through an mmap. Blocking fetches pay for it on the
+// main thread, they decode there anyway, async ones next to the decode. Files
+// that can't be read hash their path instead, they fail to decode either way
+// but mustn't alias each other.
+uint64_t hashFile(const std::string& path, uint64_t seed = Hash::SEED) {
+  int file = open(path.c_str(), O_RDONLY);
+  struct stat fileInfo;
+  if(file < 0 || fstat(file, &fileInfo) != 0 || fileInfo.st_size == 0) {
+    if(file >= 0) {
+      close(file);
+    }
+    return Hash::bytes(path.data(), path.size(), seed);
+  }
+  const size_t size = static_cast<size_t>(fileInfo.st_size);
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if(mapping == MAP_FAILED) {
+    return Hash::bytes(path.data(), path.size(), seed);
+  }
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  const uint64_t hash = Hash::bytes(mapping, size, seed);
+  munmap(mapping, size);
+  return hash;
+}
 
-Texture* AssetCache::fetchLoadTexture(const std::string& ID, const std::string& path) {
-  auto it = textureRegistry.find(ID);
-  if(it != textureRegistry.end()) {
-    return &it->second;
+// What any fetch can afford to key on, a stat rather than a read. The path with
+// its size and write time, so an edited file isn't served from before the edit.
+uint64_t hashSource(const std::string& path, uint64_t seed = Hash::SEED) {
+  SourceStamp stamp;
+  if(!stampSource(path, stamp)) {
+    stamp = {};
+  }
+  return Hash::bytes(&stamp, sizeof(stamp), Hash::bytes(path.data(), path.size(), seed));
+}
+
+// The same bytes loaded another way are another image.
+uint64_t contentKey(uint64_t sourceHash, uint32_t usage, bool compress) {
+  const uint32_t loadedAs[2] = {usage, compress};
+  return Hash::bytes(loadedAs, sizeof(loadedAs), sourceHash);
+}
+constexpr uint32_t USAGE_PACKED = ~0u;
+
+Texture* AssetCache::fetchLoadTexture(const std::string& ID, const std::string& path, Texture::Usage usage, bool compress) {
+  return fetchTexture(ID, contentKey(hashSource(path), usage, compress),
+                      [path, usage, compress]() { return contentKey(hashFile(path), usage, compress); },
+                      [path, usage, compress]() { return Texture::decode(path, usage, compress); }, false);
+}
+Texture* AssetCache::fetchLoadTextureAsync(const std::string& ID, const std::string& path, Texture::Usage usage, bool compress) {
+  return fetchTexture(ID, contentKey(hashSource(path), usage, compress),
+                      [path, usage, compress]() { return contentKey(hashFile(path), usage, compress); },
+                      [path, usage, compress]() { return Texture::decode(path, usage, compress); }, true);
+}
+Texture* AssetCache::fetchLoadPackedTextureAsync(const std::string& ID, const std::string& occlusionPath, const std::string& roughnessPath,
+                                                 const std::string& metallicPath, bool compress) {
+  const uint64_t sourceHash = hashSource(metallicPath, hashSource(roughnessPath, hashSource(occlusionPath)));
+  return fetchTexture(ID, contentKey(sourceHash, USAGE_PACKED, compress), [occlusionPath, roughnessPath, metallicPath, compress]() {
+    return contentKey(hashFile(metallicPath, hashFile(roughnessPath, hashFile(occlusionPath))), USAGE_PACKED, compress);
+  }, [occlusionPath, roughnessPath, metallicPath, compress]() {
+    return Texture::decodePacked(occlusionPath, roughnessPath, metallicPath, compress);
+  }, true);
+}
+Texture* AssetCache::fetchTexture(const std::string& ID, uint64_t sourceKey, std::function<uint64_t()>&& hashContent,
+                                  std::function<Texture::Pixels()>&& decode, bool async) {
+  auto alias = textureAliases.find(ID);
+  if(alias != textureAliases.end()) {
+    textureHits++;
+    return alias->second;
+  }
+  auto source = textureSources.find(sourceKey);
+  if(source != textureSources.end()) {
+    textureHits++;
+    source->second->references++;
+    textureAliases.emplace(ID, source->second);
+    return source->second;
+  }
+  // Reading the whole file would stall the frame an async fetch is meant to
+  // keep going, those go by their files until the worker has hashed the bytes.
+  const uint64_t key = async ? sourceKey : hashContent();
+  auto it = textureContents.find(key);
+  if(it != textureContents.end()) {
+    textureHits++;
   } else {
-    textureRegistry.insert_or_assign(ID, Texture(ID, path));
-    return &textureRegistry.at(ID);
+    textureMisses++;
+    auto texture = std::make_unique<Texture>(ID);
+    texture->contentKey = key;
+    if(!async) {
+      texture->upload(decode());
+    } else {
+      auto pending = std::make_shared<PendingTexture>();
+      pending->key = key;
+      pending->hashContent = std::move(hashContent);
+      pending->decode = std::move(decode);
+      pendingTextures.push_back(pending);
+      // The job keeps its own reference, remove() may drop the texture mid decode.
+      ThreadPool::get().enqueue([pending]() {
+        pending->contentKey = pending->hashContent();
+        pending->pixels = pending->decode();
+        pending->decoded.store(true, std::memory_order_release);
+        pending->decoded.notify_all();
+      });
+    }
+    it = textureContents.emplace(key, std::move(texture)).first;
+  }
+  textureSources.emplace(sourceKey, it->second.get());
+  it->second->references++;
+  textureAliases.emplace(ID, it->second.get());
+  return it->second.get();
+}
+void AssetCache::releaseTexture(Texture* texture) {
+  // The GPU may still be sampling it, callers wait for the device to idle first.
+  if(--texture->references == 0) {
+    const uint64_t key = texture->contentKey;
+    std::erase_if(pendingTextures, [&](const std::shared_ptr<PendingTexture>& pending) { return pending->key == key; });
+    std::erase_if(textureSources, [&](const auto& source) { return source.second == texture; });
+    textureContents.erase(key);
+  }
+}
+void AssetCache::pollTextures() {
+  bool uploaded = false;
+  for(auto it = pendingTextures.begin(); it != pendingTextures.end();) {
+    PendingTexture& pending = **it;
+    if(!pending.decoded.load(std::memory_order_acquire)) {
+      it++;
+      continue;
+    }
+    Texture* texture = textureContents.at(pending.key).get();
+    auto original = textureContents.find(pending.contentKey);
+    if(original != textureContents.end()) {
+      // The same bytes under another path, loaded already or by a blocking fetch.
+      mergeTexture(texture, original->second.get());
+    } else {
+      // From here on keyed by its bytes, like a blocking fetch.
+      auto node = textureContents.extract(pending.key);
+      node.key() = pending.contentKey;
+      textureContents.insert(std::move(node));
+      texture->contentKey = pending.contentKey;
+      texture->upload(std::move(pending.pixels));
+    }
+    it = pendingTextures.erase(it);
+    uploaded = true;
+  }
+  // Materials read their textures through the descriptor set, swap the placeholders
+  // out there too once the frames still reading it are done.
+  if(uploaded) {
+    Buffers::getMaterialDescriptorsDirty() = true;
+  }
+}
+void AssetCache::mergeTexture(Texture* duplicate, Texture* original) {
+  for(auto& alias : textureAliases) {
+    if(alias.second == duplicate) {
+      alias.second = original;
+    }
   }
+  for(auto& source : textureSources) {
+    if(source.second == duplicate) {
+      source.second = original;
+    }
+  }
+  for(auto& material : materialRegistry) {
+    material.second->replaceTexture(duplicate, original);
+  }
+  original->references += duplicate->references;
+  // Counted as a miss when it was fetched, it turned out to be a hit.
+  textureMisses--;
+  textureHits++;
+  // Never uploaded, there is only the placeholder to let go of.
+  textureContents.erase(duplicate->contentKey);
+}
+void AssetCache::waitTextures() {
+  for(std::shared_ptr<PendingTexture>& pending : pendingTextures) {
+    pending->decoded.wait(false, std::memory_order_acquire);
+  }
+  pollTextures();
 }
+size_t AssetCache::getPendingTextures() { return pendingTextures.size(); }
+
 Material* AssetCache::findMaterial(const std::string& ID) {
   auto it = materialRegistry.find(ID);
   return it != materialRegistry.end() ? it->second.get() : nullptr;
@@ -19,18 +195,62 @@ Model* AssetCache::findModel(const std::string& ID) {
   auto it = modelRegistry.find(ID);
   return it != modelRegistry.end() ? it->second.get() : nullptr;
 }
+Mesh* AssetCache::fetchLoadMesh(const std::string& path, Agnosia_T::VertexFormat vertexFormat) {
+  const std::string ID = Mesh::getMeshID(path, vertexFormat);
+  auto it = meshRegistry.find(ID);
+  if(it == meshRegistry.end()) {
+    it = meshRegistry.insert_or_assign(ID, std::make_unique<Mesh>(path, vertexFormat)).first;
+  }
+  it->second->references++;
+  return it->second.get();
+}
+void AssetCache::releaseMesh(Mesh* mesh) {
+  // The GPU may still be drawing it, callers wait for the device to idle first.
+  if(--mesh->references == 0) {
+    meshRegistry.erase(mesh->getID());
+    // Gives the pools back their memory once most of them is free.
+    GeometryPool::compactAll(false);
+  }
+}
 
 void AssetCache::store(std::unique_ptr<Material>&& material) {
   materialRegistry.insert_or_assign(material->getID(), std::move(material));
 }
 void AssetCache::store(std::unique_ptr<Model>&& model) {
+  auto it = modelRegistry.find(model->getID());
+  if(it != modelRegistry.end()) {
+    vkDeviceWaitIdle(DeviceControl::getDevice());
+    releaseMesh(it->second->getMesh());
+  }
   modelRegistry.insert_or_assign(model->getID(), std::move(model));
 }
 void AssetCache::remove(const std::string& ID) {
   vkDeviceWaitIdle(DeviceControl::getDevice());
-  textureRegistry.erase(ID);
+  auto alias = textureAliases.find(ID);
+  if(alias != textureAliases.end()) {
+    releaseTexture(alias->second);
+    textureAliases.erase(alias);
+  }
   materialRegistry.erase(ID);
-  modelRegistry.erase(ID);
+  auto it = modelRegistry.find(ID);
+  if(it != modelRegistry.end()) {
+    releaseMesh(it->second->getMesh());
+    modelRegistry.erase(it);
+  }
+}
+void AssetCache::clear() {
+  vkDeviceWaitIdle(DeviceControl::getDevice());
+  modelRegistry.clear();
+  meshRegistry.clear();
+  materialRegistry.clear();
+  // A decode still running would finish into a staging buffer after the allocator is gone.
+  for(std::shared_ptr<PendingTexture>& pending : pendingTextures) {
+    pending->decoded.wait(false, std::memory_order_acquire);
+  }
+  pendingTextures.clear();
+  textureAliases.clear();
+  textureSources.clear();
+  textureContents.clear();
 }
 
 std::vector<Model*> AssetCache::getModels() {
@@ -40,4 +260,26 @@ std::vector<Model*> AssetCache::getModels() {
   }
   return models;
 }
-
+std::vector<Mesh*> AssetCache::getMeshes() {
+  std::vector<Mesh*> meshes;
+  for(auto& it : meshRegistry) {
+    meshes.push_back(it.second.get());
+  }
+  return meshes;
+}
+std::vector<Texture*> AssetCache::getTextures() {
+  std::vector<Texture*> textures;
+  for(auto& it : textureContents) {
+    textures.push_back(it.second.get());
+  }
+  return textures;
+}
+size_t AssetCache::getTextureHits() { return textureHits; }
+size_t AssetCache::getTextureMisses() { return textureMisses; }
+size_t AssetCache::getTextureBytesSaved() {
+  size_t saved = 0;
+  for(auto& it : textureContents) {
+    saved += static_cast<size_t>(it.second->getReferences() - 1) * it.second->getMemorySize();
+  }
+  return saved;
+}
@@ -1,8 +1,12 @@
 #pragma once
 
 #include "graphics/material.h"
+#include "graphics/mesh.h"
 #include "graphics/model.h"
 #include "graphics/texture.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -11,14 +15,60 @@
 
 class AssetCache {
   private:
-    std::unordered_map<std::string, Texture> textureRegistry;
+    // A texture being decoded on the thread pool, the GPU upload waits for the main thread.
+    struct PendingTexture {
+      uint64_t key;
+      // Hashed by the job next to the decode, see pollTextures.
+      std::function<uint64_t()> hashContent;
+      uint64_t contentKey = 0;
+      std::function<Texture::Pixels()> decode;
+      Texture::Pixels pixels;
+      std::atomic<bool> decoded = false;
+    };
+
+    // One texture per distinct source, keyed by a hash of its bytes and how
+    // they're loaded, or by the files it came from while an async load hasn't
+    // hashed them yet. IDs are only aliases onto these, each one a reference.
+    std::unordered_map<uint64_t, std::unique_ptr<Texture>> textureContents;
+    std::unordered_map<std::string, Texture*> textureAliases;
+    // Every file and load mode fetched so far, a fetch finds those with a stat
+    // before anything hashes the bytes.
+    std::unordered_map<uint64_t, Texture*> textureSources;
+    size_t textureHits = 0;
+    size_t textureMisses = 0;
+    std::vector<std::shared_ptr<PendingTexture>> pendingTextures;
     std::unordered_map<std::string, std::unique_ptr<Material>> materialRegistry;
+    std::unordered_map<std::string, std::unique_ptr<Mesh>> meshRegistry;
     std::unordered_map<std::string, std::unique_ptr<Model>> modelRegistry;
+
+    void releaseMesh(Mesh* mesh);
+    Texture* fetchTexture(const std::string& ID, uint64_t sourceKey, std::function<uint64_t()>&& hashContent,
+                          std::function<Texture::Pixels()>&& decode, bool async);
+    void releaseTexture(Texture* texture);
+    // Points every alias, source and material at original and drops duplicate.
+    void mergeTexture(Texture* duplicate, Texture* original);
     
   public:
-    Texture* fetchLoadTexture(const std::string& ID, const std::string& path);
+    // IDs whose files hold the same bytes, loaded the same way, share one texture.
+    Texture* fetchLoadTexture(const std::string& ID, const std::string& path, Texture::Usage usage = Texture::USAGE_COLOR, bool compress = false);
+    // Returns straight away with a texture showing the placeholder, the file is
+    // decoded on a worker and uploaded by a later pollTextures or waitTextures.
+    // If its bytes turn out to be another texture's, that one replaces it in the
+    // materials and aliases, so reach it through those rather than keeping it.
+    Texture* fetchLoadTextureAsync(const std::string& ID, const std::string& path, Texture::Usage usage = Texture::USAGE_COLOR, bool compress = false);
+    // Same for an ORM texture packed from three maps, see Texture::decodePacked.
+    Texture* fetchLoadPackedTextureAsync(const std::string& ID, const std::string& occlusionPath, const std::string& roughnessPath,
+                                         const std::string& metallicPath, bool compress = false);
+    // Upload the textures that finished decoding, once a frame from the main thread.
+    void pollTextures();
+    // Block until every async texture is decoded and uploaded.
+    void waitTextures();
+    size_t getPendingTextures();
     Material* findMaterial(const std::string& ID);
     Model* findModel(const std::string& ID);
+    // Loads the mesh at path the first time, after that hands out the same one.
+    // Every call adds a reference, which the Model stored with it gives back on removal.
+    Mesh* fetchLoadMesh(const std::string& path, Agnosia_T::VertexFormat vertexFormat = Agnosia_T::VERTEX_FULL);
 
     void store(std::unique_ptr<Material>&& material);
     void store(std::unique_ptr<Model>&& model);
@@ -26,4 +76,14 @@ class AssetCache {
     void remove(const std::string& ID);
 
     std::vector<Model*> getModels();
+    std::vector<Mesh*> getMeshes();
+    // Every distinct texture, once however many IDs alias it.
+    std::vector<Texture*> getTextures();
+    // Fetches served by an existing texture, by ID or by content, and ones that loaded a new one.
+    size_t getTextureHits();
+    size_t getTextureMisses();
+    // What the aliases would have taken as textures of their own.
+    size_t getTextureBytesSaved();
+    // Frees every mesh while the allocator is still alive, before the deletion queue flushes.
+    void clear();
 };
@@ -0,0 +1,1265 @@
+#ifdef AGNOSIA_BENCHMARK
+#include "benchmark.h"
+#include "assetcache.h"
+#include "devicelibrary.h"
+#include "graphics/cookedmesh.h"
+#include "graphics/cookedtexture.h"
+#include "graphics/culling.h"
+#include "graphics/geometrypool.h"
+#include "graphics/ktxtexture.h"
+#include "graphics/meshlets.h"
+#include "graphics/mipdownsampler.h"
+#include "graphics/mesh.h"
+#include "graphics/mipgen.h"
+#include "graphics/objparser.h"
+#include "graphics/simplifier.h"
+#include "graphics/blockcompressor.h"
+#include "graphics/buffers.h"
+#include "graphics/texture.h"
+#include "graphics/uploadqueue.h"
+#include "graphics/vertexcache.h"
+#include "graphics/vertexpacking.h"
+#include "graphics/vertexremap.h"
+#include "utils/helpers.h"
+#include "utils/threadpool.h"
+#include "utils/timer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include <tiny_obj_loader.h>
+#include <stb/stb_image.h>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+const char *MODEL_DIRECTORY = "assets/models";
+const char *TEXTURE_DIRECTORY = "assets/textures";
+
+// The hash Model used to dedup with, kept here as the baseline VertexRemap is measured against.
+struct LegacyVertexHash {
+  size_t operator()(Agnosia_T::Vertex const &vertex) const {
+    size_t hashPos = std::hash<glm::vec3>()(vertex.pos);
+    size_t hashColor = std::hash<glm::vec3>()(vertex.color);
+    size_t hashUV = std::hash<glm::vec2>()(vertex.uv);
+    size_t hashNormal = std::hash<glm::vec3>()(vertex.normal);
+
+    return ((hashPos ^ (hashColor << 1)) >> 1) ^ (hashUV << 1) ^ (hashNormal << 2);
+  }
+};
+
+void evictFromPageCache(const std::string &path) {
+  // Ask the kernel to drop the file from the page cache, so we measure a cold
+  // read instead of a memcpy out of RAM. Clean pages only, no privileges needed.
+  int file = open(path.c_str(), O_RDONLY);
+  if (file >= 0) {
+    fdatasync(file);
+    posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+    close(file);
+  }
+}
+
+void benchMeshLoad() {
+  printf("---- Mesh load: OBJ parse vs mmap'd cooked mesh ----\n");
+  for (const auto &entry : std::filesystem::directory_iterator(MODEL_DIRECTORY)) {
+    if (entry.path().extension() != ".obj") {
+      continue;
+    }
+    const std::string objPath = entry.path().string();
+    const std::string cookedPath = CookedMesh::getCookedPath(objPath);
+
+    Agnosia_T::MeshData mesh;
+    std::vector<Agnosia_T::Vertex> &vertices = mesh.vertices;
+    std::vector<uint32_t> &indices = mesh.indices;
+    evictFromPageCache(objPath);
+    Timer objTimer;
+    mesh.bounds = Mesh::loadObj(objPath, vertices, indices);
+    const double objMs = objTimer.elapsedMs();
+
+    if (!CookedMesh(cookedPath, objPath).isValid()) {
+      // Only the load is timed here, a single full detail level is enough to cook.
+      mesh.lods = {{.firstIndex = 0, .indexCount = static_cast<uint32_t>(indices.size()), .error = 0.0f}};
+      CookedMesh::write(cookedPath, objPath, mesh);
+    }
+    // Stand in for the staging buffer, allocated up front like the real one.
+    std::vector<char> staging(vertices.size() * sizeof(Agnosia_T::Vertex) + indices.size() * sizeof(uint32_t));
+
+    evictFromPageCache(cookedPath);
+    Timer cookedTimer;
+    {
+      CookedMesh cooked(cookedPath, objPath);
+      if (!cooked.isValid()) {
+        printf("%-40s could not be cooked, skipping\n", objPath.c_str());
+        continue;
+      }
+      const size_t vertexBytes = cooked.getVertexCount() * sizeof(Agnosia_T::Vertex);
+      memcpy(staging.data(), cooked.getVertices(), vertexBytes);
+      memcpy(staging.data() + vertexBytes, cooked.getIndices(), cooked.getIndexCount() * sizeof(uint32_t));
+    }
+    const double cookedMs = cookedTimer.elapsedMs();
+
+    printf("%-40s %9zu verts | obj %9.2f ms | cooked %8.2f ms | %6.1fx\n",
+           objPath.c_str(), vertices.size(), objMs, cookedMs, objMs / std::max(cookedMs, 0.001));
+  }
+}
+
+bool sameIndexStream(const std::vector<tinyobj::shape_t> &a, const std::vector<tinyobj::shape_t> &b) {
+  // tinyobj splits shapes on o/g records, we emit one, compare the flattened corner lists.
+  std::vector<tinyobj::index_t> flatA, flatB;
+  for (const auto &shape : a) flatA.insert(flatA.end(), shape.mesh.indices.begin(), shape.mesh.indices.end());
+  for (const auto &shape : b) flatB.insert(flatB.end(), shape.mesh.indices.begin(), shape.mesh.indices.end());
+  if (flatA.size() != flatB.size()) return false;
+  for (size_t i = 0; i < flatA.size(); i++) {
+    if (flatA[i].vertex_index != flatB[i].vertex_index ||
+        flatA[i].normal_index != flatB[i].normal_index ||
+        flatA[i].texcoord_index != flatB[i].texcoord_index) return false;
+  }
+  return true;
+}
+
+void benchObjParse() {
+  printf("---- OBJ parse: tinyobj::ObjReader vs ObjParser (%zu threads) ----\n", ThreadPool::get().getThreadCount());
+  for (const auto &entry : std::filesystem::directory_iterator(MODEL_DIRECTORY)) {
+    if (entry.path().extension() != ".obj") {
+      continue;
+    }
+    const std::string objPath = entry.path().string();
+
+    Timer tinyobjTimer;
+    tinyobj::ObjReader reader;
+    reader.ParseFromFile(objPath, tinyobj::ObjReaderConfig());
+    const double tinyobjMs = tinyobjTimer.elapsedMs();
+
+    Timer parserTimer;
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    ObjParser::parse(objPath, attrib, shapes);
+    const double parserMs = parserTimer.elapsedMs();
+
+    const bool match = reader.GetAttrib().vertices == attrib.vertices &&
+                       reader.GetAttrib().normals == attrib.normals &&
+                       reader.GetAttrib().texcoords == attrib.texcoords &&
+                       sameIndexStream(reader.GetShapes(), shapes);
+
+    printf("%-40s tinyobj %9.2f ms | ObjParser %8.2f ms | %6.1fx | %s\n",
+           objPath.c_str(), tinyobjMs, parserMs, tinyobjMs / std::max(parserMs, 0.001), match ? "match" : "MISMATCH");
+  }
+}
+
+void benchRemapStream(const std::string &name, const std::vector<Agnosia_T::Vertex> &corners, size_t expectedVertices) {
+  // Baseline, exactly what Model used to do, count() then operator[].
+  Timer mapTimer;
+  std::unordered_map<Agnosia_T::Vertex, uint32_t, LegacyVertexHash> uniqueVertices;
+  std::vector<uint32_t> mapIndices;
+  mapIndices.reserve(corners.size());
+  uint32_t uniqueCount = 0;
+  for (const Agnosia_T::Vertex &vertex : corners) {
+    if (uniqueVertices.count(vertex) == 0) {
+      uniqueVertices[vertex] = uniqueCount++;
+    }
+    mapIndices.push_back(uniqueVertices[vertex]);
+  }
+  const double mapMs = mapTimer.elapsedMs();
+  // Every element sharing a bucket with another one is a collision.
+  size_t mapCollisions = 0;
+  for (size_t bucket = 0; bucket < uniqueVertices.bucket_count(); bucket++) {
+    mapCollisions += std::max<size_t>(uniqueVertices.bucket_size(bucket), 1) - 1;
+  }
+
+  Timer remapTimer;
+  VertexRemap remap(expectedVertices);
+  std::vector<uint32_t> remapIndices;
+  remapIndices.reserve(corners.size());
+  for (const Agnosia_T::Vertex &vertex : corners) {
+    remapIndices.push_back(remap.insert(vertex));
+  }
+  const double remapMs = remapTimer.elapsedMs();
+  const VertexRemap::Stats stats = remap.getStats();
+
+  printf("%-40s %9zu corners -> %8zu unique%s\n", name.c_str(), corners.size(), remap.getVertices().size(),
+         remap.getVertices().size() == uniqueCount && remapIndices == mapIndices ? "" : " (MISMATCH)");
+  printf("    unordered_map %9.2f ms %8.1f Mcorners/s | %9zu colliding elements\n",
+         mapMs, corners.size() / (mapMs * 1000.0), mapCollisions);
+  printf("    VertexRemap   %9.2f ms %8.1f Mcorners/s | %9zu extra probes, %.3f per lookup, longest %zu\n",
+         remapMs, corners.size() / (remapMs * 1000.0), stats.collisions,
+         stats.collisions / static_cast<double>(std::max<size_t>(stats.lookups, 1)), stats.longestProbe);
+}
+
+void benchVertexRemap() {
+  printf("---- Vertex dedup: std::unordered_map vs VertexRemap ----\n");
+  for (const auto &entry : std::filesystem::directory_iterator(MODEL_DIRECTORY)) {
+    if (entry.path().extension() != ".obj") {
+      continue;
+    }
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    ObjParser::parse(entry.path().string(), attrib, shapes);
+
+    std::vector<Agnosia_T::Vertex> corners;
+    for (const auto &shape : shapes) {
+      for (const auto &index : shape.mesh.indices) {
+        Agnosia_T::Vertex vertex{};
+        vertex.pos = {attrib.vertices[3 * index.vertex_index + 0], attrib.vertices[3 * index.vertex_index + 1], attrib.vertices[3 * index.vertex_index + 2]};
+        if (index.normal_index >= 0) {
+          vertex.normal = {attrib.normals[3 * index.normal_index + 0], attrib.normals[3 * index.normal_index + 1], attrib.normals[3 * index.normal_index + 2]};
+        }
+        if (index.texcoord_index >= 0) {
+          vertex.uv = {attrib.texcoords[2 * index.texcoord_index + 0], 1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+        }
+        vertex.color = {1.0f, 1.0f, 1.0f};
+        corners.push_back(vertex);
+      }
+    }
+    benchRemapStream(entry.path().string(), corners, attrib.vertices.size() / 3);
+  }
+
+  // A dragon sized stream: 800k triangles over a 400k vertex grid, where each
+  // vertex is shared by about six corners like in a closed triangle mesh.
+  const size_t gridSide = 632;
+  std::vector<Agnosia_T::Vertex> grid(gridSide * gridSide);
+  for (size_t y = 0; y < gridSide; y++) {
+    for (size_t x = 0; x < gridSide; x++) {
+      Agnosia_T::Vertex &vertex = grid[y * gridSide + x];
+      vertex.pos = {x * 0.01f, y * 0.01f, std::sin(x * 0.05f) * std::cos(y * 0.05f)};
+      vertex.normal = glm::normalize(glm::vec3(-vertex.pos.z, 0.5f, 1.0f));
+      vertex.uv = {x / float(gridSide), y / float(gridSide)};
+      vertex.color = {1.0f, 1.0f, 1.0f};
+    }
+  }
+  std::vector<Agnosia_T::Vertex> corners;
+  corners.reserve((gridSide - 1) * (gridSide - 1) * 6);
+  for (size_t y = 0; y + 1 < gridSide; y++) {
+    for (size_t x = 0; x + 1 < gridSide; x++) {
+      const size_t quad[4] = {y * gridSide + x, y * gridSide + x + 1, (y + 1) * gridSide + x, (y + 1) * gridSide + x + 1};
+      for (size_t corner : {quad[0], quad[1], quad[2], quad[2], quad[1], quad[3]}) {
+        corners.push_back(grid[corner]);
+      }
+    }
+  }
+  benchRemapStream("synthetic grid", corners, grid.size());
+}
+
+void benchVertexCache() {
+  printf("---- Vertex cache: source order vs optimized (FIFO %u) ----\n", VertexCache::CACHE_SIZE);
+  for (const auto &entry : std::filesystem::directory_iterator(MODEL_DIRECTORY)) {
+    if (entry.path().extension() != ".obj") {
+      continue;
+    }
+    std::vector<Agnosia_T::Vertex> vertices;
+    std::vector<uint32_t> indices;
+    Mesh::loadObj(entry.path().string(), vertices, indices);
+    const Agnosia_T::CacheStats before = VertexCache::analyze(indices, vertices.size());
+
+    // Every stage on its own, so the cost of the overdraw pass is visible.
+    std::vector<uint32_t> tipsified = indices;
+    Timer tipsifyTimer;
+    VertexCache::optimizeTriangleOrder(tipsified, vertices.size());
+    const double tipsifyMs = tipsifyTimer.elapsedMs();
+    const Agnosia_T::CacheStats tipsify = VertexCache::analyze(tipsified, vertices.size());
+
+    Timer overdrawTimer;
+    VertexCache::optimizeOverdraw(tipsified, vertices);
+    const double overdrawMs = overdrawTimer.elapsedMs();
+    const Agnosia_T::CacheStats overdraw = VertexCache::analyze(tipsified, vertices.size());
+
+    Timer fullTimer;
+    const Agnosia_T::CacheStats after = Mesh::optimizeMesh(vertices, indices);
+    const double fullMs = fullTimer.elapsedMs();
+
+    printf("%-40s %8zu tris\n", entry.path().string().c_str(), indices.size() / 3);
+    printf("    source    ACMR %.3f ATVR %.3f\n", before.acmr, before.atvr);
+    printf("    tipsify   ACMR %.3f ATVR %.3f %8.2f ms\n", tipsify.acmr, tipsify.atvr, tipsifyMs);
+    printf("    +overdraw ACMR %.3f ATVR %.3f %8.2f ms\n", overdraw.acmr, overdraw.atvr, overdrawMs);
+    printf("    Mesh      ACMR %.3f ATVR %.3f %8.2f ms total\n", after.acmr, after.atvr, fullMs);
+  }
+}
+
+float pointTriangleDistance(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+  // Closest point on a triangle, Ericson's Real-Time Collision Detection 5.1.5.
+  const glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+  const float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+  if (d1 <= 0.0f && d2 <= 0.0f) return glm::length(p - a);
+  const glm::vec3 bp = p - b;
+  const float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+  if (d3 >= 0.0f && d4 <= d3) return glm::length(p - b);
+  const float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return glm::length(p - (a + ab * (d1 / (d1 - d3))));
+  const glm::vec3 cp = p - c;
+  const float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+  if (d6 >= 0.0f && d5 <= d6) return glm::length(p - c);
+  const float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return glm::length(p - (a + ac * (d2 / (d2 - d6))));
+  const float va = d3 * d6 - d5 * d4;
+  if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) return glm::length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+  const float denominator = 1.0f / (va + vb + vc);
+  return glm::length(p - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+}
+
+// Dragon sized: an 800k triangle torus with some bumps, closed and without seams.
+void buildTorus(std::vector<Agnosia_T::Vertex> &vertices, std::vector<uint32_t> &indices) {
+  const size_t rings = 400, segments = 1000;
+  vertices.resize(rings * segments);
+  for (size_t ring = 0; ring < rings; ring++) {
+    for (size_t segment = 0; segment < segments; segment++) {
+      const float theta = 2.0f * glm::pi<float>() * ring / rings;
+      const float phi = 2.0f * glm::pi<float>() * segment / segments;
+      const float radius = 1.0f + 0.3f * std::cos(theta) + 0.01f * std::sin(phi * 37.0f) * std::cos(theta * 23.0f);
+      Agnosia_T::Vertex &vertex = vertices[ring * segments + segment];
+      vertex.pos = {radius * std::cos(phi), radius * std::sin(phi), 0.3f * std::sin(theta)};
+      vertex.normal = glm::normalize(vertex.pos - glm::vec3(std::cos(phi), std::sin(phi), 0.0f));
+      vertex.color = {1.0f, 1.0f, 1.0f};
+    }
+  }
+  indices.clear();
+  indices.reserve(rings * segments * 6);
+  for (size_t ring = 0; ring < rings; ring++) {
+    for (size_t segment = 0; segment < segments; segment++) {
+      const uint32_t a = ring * segments + segment;
+      const uint32_t b = ring * segments + (segment + 1) % segments;
+      const uint32_t c = ((ring + 1) % rings) * segments + segment;
+      const uint32_t d = ((ring + 1) % rings) * segments + (segment + 1) % segments;
+      indices.insert(indices.end(), {a, c, b, b, c, d});
+    }
+  }
+}
+
+// Checks one LOD chain and prints it. The reported error is a mean over the
+// quadric planes, not a hard bound, so next to it goes the actual distance
+// from a sample of the full mesh's vertices to the simplified surface.
+void checkLodChain(const std::string &name, const std::vector<Agnosia_T::Vertex> &vertices, std::vector<uint32_t> indices) {
+  Timer timer;
+  const std::vector<Agnosia_T::LodLevel> lods = Mesh::buildLods(vertices, indices);
+  const double buildMs = timer.elapsedMs();
+  printf("%-40s %9u tris, %zu levels in %.2f ms\n", name.c_str(), lods[0].indexCount / 3, lods.size(), buildMs);
+
+  const size_t sampleStride = std::max<size_t>(1, vertices.size() / 500);
+  for (size_t level = 1; level < lods.size(); level++) {
+    const Agnosia_T::LodLevel &lod = lods[level];
+    bool valid = lod.indexCount % 3 == 0 && lod.indexCount < lods[level - 1].indexCount && lod.error >= lods[level - 1].error;
+    for (uint32_t i = lod.firstIndex; i < lod.firstIndex + lod.indexCount; i += 3) {
+      const uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+      valid &= a < vertices.size() && b < vertices.size() && c < vertices.size() && a != b && b != c && a != c;
+    }
+    // Brute force, only affordable on the smaller levels.
+    float measured = -1.0f;
+    if (static_cast<size_t>(lod.indexCount / 3) * (vertices.size() / sampleStride) < 200'000'000) {
+      measured = 0.0f;
+      for (size_t vertex = 0; vertex < vertices.size(); vertex += sampleStride) {
+        float closest = FLT_MAX;
+        for (uint32_t i = lod.firstIndex; i < lod.firstIndex + lod.indexCount; i += 3) {
+          closest = std::min(closest, pointTriangleDistance(vertices[vertex].pos, vertices[indices[i]].pos,
+                                                            vertices[indices[i + 1]].pos, vertices[indices[i + 2]].pos));
+        }
+        measured = std::max(measured, closest);
+      }
+    }
+    printf("    LOD %zu %9u tris, error %.5f, ", level, lod.indexCount / 3, lod.error);
+    if (measured >= 0.0f) {
+      printf("sampled max distance %.5f%s\n", measured, valid ? "" : " (INVALID)");
+    } else {
+      printf("too big to measure%s\n", valid ? "" : " (INVALID)");
+    }
+  }
+}
+
+void benchSimplifier() {
+  printf("---- LOD chains: quadric simplification ----\n");
+  for (const auto &entry : std::filesystem::directory_iterator(MODEL_DIRECTORY)) {
+    if (entry.path().extension() != ".obj") {
+      continue;
+    }
+    std::vector<Agnosia_T::Vertex> vertices;
+    std::vector<uint32_t> indices;
+    Mesh::loadObj(entry.path().string(), vertices, indices);
+    Mesh::optimizeMesh(vertices, indices);
+    checkLodChain(entry.path().string(), vertices, indices);
+  }
+
+  std::vector<Agnosia_T::Vertex> vertices;
+  std::vector<uint32_t> indices;
+  buildTorus(vertices, indices);
+  Mesh::optimizeMesh(vertices, indices);
+  checkLodChain("synthetic torus", vertices, indices);
+}
+
+// Builds the meshlets of one mesh and checks them: every meshlet within the
+// budgets, every triangle in exactly one meshlet, every vertex inside its
+// meshlet's sphere, and no meshlet culled by its cone while a camera could
+// still see one of its triangles.
+void checkMeshlets(const std::string &name, const std::vector<Agnosia_T::Vertex> &vertices, const std::vector<uint32_t> &indices) {
+  std::vector<Agnosia_T::Meshlet> meshlets;
+  std::vector<uint32_t> meshletVertices;
+  std::vector<uint8_t> meshletTriangles;
+  Timer timer;
+  Meshlets::build(vertices, indices.data(), indices.size(), meshlets, meshletVertices, meshletTriangles);
+  const double buildMs = timer.elapsedMs();
+
+  bool valid = true;
+  size_t triangleCount = 0;
+  std::vector<uint8_t> covered(indices.size() / 3, 0);
+  // Corners of a triangle to the triangle, to find which one a meshlet triangle is.
+  std::unordered_map<uint64_t, uint32_t> triangleIndex;
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    triangleIndex[(uint64_t(indices[i]) << 42) ^ (uint64_t(indices[i + 1]) << 21) ^ indices[i + 2]] = static_cast<uint32_t>(i / 3);
+  }
+  for (const Agnosia_T::Meshlet &meshlet : meshlets) {
+    valid &= meshlet.vertexCount <= Meshlets::MAX_VERTICES && meshlet.triangleCount <= Meshlets::MAX_TRIANGLES &&
+             meshlet.triangleOffset % 4 == 0;
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+      valid &= glm::length(vertices[meshletVertices[meshlet.vertexOffset + i]].pos - meshlet.center) <= meshlet.radius * 1.0001f + 1e-6f;
+    }
+    for (uint32_t triangle = 0; triangle < meshlet.triangleCount; triangle++) {
+      uint32_t corners[3];
+      for (int corner = 0; corner < 3; corner++) {
+        const uint8_t local = meshletTriangles[meshlet.triangleOffset + triangle * 3 + corner];
+        valid &= local < meshlet.vertexCount;
+        corners[corner] = meshletVertices[meshlet.vertexOffset + local];
+      }
+      const auto found = triangleIndex.find((uint64_t(corners[0]) << 42) ^ (uint64_t(corners[1]) << 21) ^ corners[2]);
+      valid &= found != triangleIndex.end() && covered[found->second]++ == 0;
+    }
+    triangleCount += meshlet.triangleCount;
+  }
+  valid &= triangleCount == indices.size() / 3;
+
+  // Random cameras around the mesh, a wrong cull is any triangle of a culled
+  // meshlet that the camera sees the front of.
+  const size_t cameraCount = 100;
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> coordinate(-5.0f, 5.0f);
+  size_t culled = 0, wrong = 0;
+  for (size_t sample = 0; sample < cameraCount; sample++) {
+    const glm::vec3 camera(coordinate(rng), coordinate(rng), coordinate(rng));
+    for (const Agnosia_T::Meshlet &meshlet : meshlets) {
+      if (!Meshlets::isBackfacing(meshlet, camera)) {
+        continue;
+      }
+      culled++;
+      for (uint32_t triangle = 0; triangle < meshlet.triangleCount; triangle++) {
+        glm::vec3 p[3];
+        for (int corner = 0; corner < 3; corner++) {
+          p[corner] = vertices[meshletVertices[meshlet.vertexOffset + meshletTriangles[meshlet.triangleOffset + triangle * 3 + corner]]].pos;
+        }
+        const glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        if (glm::dot(p[0] - camera, normal) < -1e-5f * glm::length(normal)) {
+          wrong++;
+          break;
+        }
+      }
+    }
+  }
+  valid &= wrong == 0;
+
+  printf("%-40s %9zu tris -> %6zu meshlets (%.1f tris, %.1f verts avg), %.2f ms, %.1f Mtris/s, %.1f%% cone culled%s\n",
+         name.c_str(), indices.size() / 3, meshlets.size(), triangleCount / double(meshlets.size()),
+         meshletVertices.size() / double(meshlets.size()), buildMs, indices.size() / 3 / (buildMs * 1000.0),
+         100.0 * culled / double(cameraCount * meshlets.size()), valid ? "" : " (INVALID)");
+}
+
+void benchMeshlets() {
+  printf("---- Meshlets: build throughput and bounds ----\n");
+  for (const auto &entry : std::filesystem::directory_iterator(MODEL_DIRECTORY)) {
+    if (entry.path().extension() != ".obj") {
+      continue;
+    }
+    std::vector<Agnosia_T::Vertex> vertices;
+    std::vector<uint32_t> indices;
+    Mesh::loadObj(entry.path().string(), vertices, indices);
+    Mesh::optimizeMesh(vertices, indices);
+    checkMeshlets(entry.path().string(), vertices, indices);
+  }
+  std::vector<Agnosia_T::Vertex> vertices;
+  std::vector<uint32_t> indices;
+  buildTorus(vertices, indices);
+  Mesh::optimizeMesh(vertices, indices);
+  checkMeshlets("synthetic torus", vertices, indices);
+}
+
+void benchVertexPacking() {
+  printf("---- Vertex packing: size and precision ----\n");
+  auto report = [](const std::string &name, const std::vector<Agnosia_T::Vertex> &vertices, const Agnosia_T::Bounds &bounds) {
+    std::vector<Agnosia_T::PackedVertex> packed(vertices.size());
+    Timer timer;
+    VertexPacking::packAll(vertices.data(), vertices.size(), bounds, packed.data());
+    const double packMs = timer.elapsedMs();
+    const Agnosia_T::PackingError error = VertexPacking::measureError(vertices.data(), vertices.size(), bounds);
+    // Half of one quantization step along the bounds diagonal, the most a position can be off by.
+    const float positionBound = glm::length(bounds.max - bounds.min) / 65535.0f * 0.5f;
+    printf("%-40s %8zu verts, %9zu -> %9zu bytes, %.2f ms, pos %.2e (bound %.2e), normal %.4f deg, uv %.2e%s\n",
+           name.c_str(), vertices.size(), vertices.size() * sizeof(Agnosia_T::Vertex), packed.size() * sizeof(Agnosia_T::PackedVertex),
+           packMs, error.position, positionBound, error.normal, error.uv, error.position <= positionBound * 1.01f ? "" : " (INVALID)");
+  };
+  for (const auto &entry : std::filesystem::directory_iterator(MODEL_DIRECTORY)) {
+    if (entry.path().extension() != ".obj") {
+      continue;
+    }
+    std::vector<Agnosia_T::Vertex> vertices;
+    std::vector<uint32_t> indices;
+    const Agnosia_T::Bounds bounds = Mesh::loadObj(entry.path().string(), vertices, indices);
+    report(entry.path().string(), vertices, bounds);
+  }
+  std::vector<Agnosia_T::Vertex> vertices;
+  std::vector<uint32_t> indices;
+  buildTorus(vertices, indices);
+  Agnosia_T::Bounds bounds = {.min = glm::vec3(FLT_MAX), .max = glm::vec3(-FLT_MAX)};
+  for (const Agnosia_T::Vertex &vertex : vertices) {
+    bounds.min = glm::min(bounds.min, vertex.pos);
+    bounds.max = glm::max(bounds.max, vertex.pos);
+  }
+  report("synthetic torus", vertices, bounds);
+}
+
+void benchCulling() {
+  printf("---- Frustum culling: 100k bounds ----\n");
+  // Boxes of all sizes scattered around a camera looking down +x, about a
+  // tenth of them end up inside the frustum.
+  const size_t boundsCount = 100'000;
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+  std::uniform_real_distribution<float> size(0.1f, 5.0f);
+  Culling::BoundsList bounds;
+  for (size_t i = 0; i < boundsCount; i++) {
+    const glm::vec3 extent(size(rng), size(rng), size(rng));
+    // Any sphere inside the box's corners will do, the kernel takes whichever is tighter.
+    const Agnosia_T::Bounds box = {.min = -extent, .max = extent, .radius = glm::length(extent) * 0.9f};
+    bounds.add(box, glm::vec3(position(rng), position(rng), position(rng)));
+  }
+  const glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+  const glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 150.0f);
+  const Culling::Frustum frustum = Culling::extractFrustum(proj * view);
+
+  std::vector<uint8_t> visible(boundsCount), reference(boundsCount);
+  auto best = [&](auto kernel, std::vector<uint8_t> &result, size_t &visibleCount) {
+    double bestMs = DBL_MAX;
+    for (int run = 0; run < 50; run++) {
+      Timer timer;
+      visibleCount = kernel(bounds, frustum, result.data());
+      bestMs = std::min(bestMs, timer.elapsedMs());
+    }
+    return bestMs;
+  };
+  size_t scalarVisible = 0, simdVisible = 0;
+  const double scalarMs = best([](const Culling::BoundsList &b, const Culling::Frustum &f, uint8_t *v) { return Culling::cullScalar(b, f, v); },
+                               reference, scalarVisible);
+  const double simdMs = best(Culling::cull, visible, simdVisible);
+  printf("    scalar %8.3f ms, %.1f M bounds/s\n", scalarMs, boundsCount / (scalarMs * 1000.0));
+  printf("    SIMD   %8.3f ms, %.1f M bounds/s, %zu visible%s\n", simdMs, boundsCount / (simdMs * 1000.0), simdVisible,
+         visible == reference && simdVisible == scalarVisible ? "" : " (MISMATCH)");
+}
+
+void benchTextureDecode() {
+  printf("---- Texture decode: heap + staging copy vs straight into staging vs thread pool (%zu threads) ----\n", ThreadPool::get().getThreadCount());
+  std::vector<std::string> paths;
+  for (const auto &entry : std::filesystem::directory_iterator(TEXTURE_DIRECTORY)) {
+    paths.push_back(entry.path().string());
+  }
+
+  // What Texture used to do, decode to the heap then copy into a fresh staging buffer.
+  Timer legacyTimer;
+  for (const std::string &path : paths) {
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+      continue;
+    }
+    const size_t imageSize = static_cast<size_t>(width) * height * 4;
+    Agnosia_T::AllocatedBuffer staging = Buffers::createBuffer(imageSize, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                                               VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_AUTO);
+    memcpy(staging.info.pMappedData, pixels, imageSize);
+    stbi_image_free(pixels);
+    vmaDestroyBuffer(Buffers::getAllocator(), staging.buffer, staging.allocation);
+  }
+  const double legacyMs = legacyTimer.elapsedMs();
+
+  Timer serialTimer;
+  std::vector<Texture::Pixels> serial(paths.size());
+  for (size_t i = 0; i < paths.size(); i++) {
+    serial[i] = Texture::decode(paths[i]);
+  }
+  const double serialMs = serialTimer.elapsedMs();
+
+  // What fetchLoadTextureAsync does, one decode job per texture.
+  Timer parallelTimer;
+  std::vector<Texture::Pixels> parallel(paths.size());
+  ThreadPool::get().parallelFor(paths.size(), [&](size_t i) { parallel[i] = Texture::decode(paths[i]); });
+  const double parallelMs = parallelTimer.elapsedMs();
+
+  bool match = true;
+  for (size_t i = 0; i < paths.size(); i++) {
+    match &= serial[i].width == parallel[i].width && serial[i].height == parallel[i].height &&
+             (!serial[i].data || memcmp(serial[i].data, parallel[i].data, static_cast<size_t>(serial[i].width) * serial[i].height * 4) == 0);
+  }
+  printf("%zu textures, heap + copy %8.2f ms | into staging %8.2f ms | pool %8.2f ms | %5.1fx | %s\n", paths.size(), legacyMs, serialMs,
+         parallelMs, legacyMs / std::max(parallelMs, 0.001), match ? "match" : "MISMATCH");
+}
+
+void benchMipGeneration() {
+  printf("---- Mip generation: GPU blit chain vs CPU box / Kaiser in linear space (%zu threads) ----\n", ThreadPool::get().getThreadCount());
+  std::atomic<Texture::MipMode> &mode = Texture::getMipMode();
+  const Texture::MipMode previousMode = mode;
+  for (const auto &entry : std::filesystem::directory_iterator(TEXTURE_DIRECTORY)) {
+    const std::string path = entry.path().string();
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+      continue;
+    }
+    const size_t imageSize = static_cast<size_t>(width) * height * 4;
+    std::vector<uint8_t> chain(MipGenerator::getChainSize(width, height));
+    std::vector<uint8_t> reference(chain.size());
+    memcpy(chain.data(), pixels, imageSize);
+    memcpy(reference.data(), pixels, imageSize);
+    stbi_image_free(pixels);
+
+    Timer boxTimer;
+    MipGenerator::generate(chain.data(), width, height, MipGenerator::FILTER_BOX, true);
+    const double boxMs = boxTimer.elapsedMs();
+    // The Kaiser reference takes tens of seconds on a 4K image, the box one is enough to check the SIMD path.
+    Timer scalarTimer;
+    MipGenerator::generateScalar(reference.data(), width, height, MipGenerator::FILTER_BOX, true);
+    const double scalarMs = scalarTimer.elapsedMs();
+    int maxError = 0;
+    for (size_t i = imageSize; i < chain.size(); i++) {
+      maxError = std::max(maxError, std::abs(static_cast<int>(chain[i]) - static_cast<int>(reference[i])));
+    }
+    Timer kaiserTimer;
+    MipGenerator::generate(chain.data(), width, height, MipGenerator::FILTER_KAISER, true);
+    const double kaiserMs = kaiserTimer.elapsedMs();
+
+    // Whole loads, decode and upload included. Each one keeps its image until
+    // shutdown, so only the blit and cached paths build one.
+    const std::string cookedPath = CookedTexture::getCookedPath(path, BlockCompressor::FORMAT_RGBA8);
+    std::filesystem::remove(cookedPath);
+    mode = Texture::MIPS_BLIT;
+    Timer blitTimer;
+    Texture blit("mipBenchBlit", path);
+    UploadQueue::wait(UploadQueue::submit());
+    const double blitMs = blitTimer.elapsedMs();
+    mode = Texture::MIPS_KAISER;
+    Timer cookTimer;
+    Texture::decode(path);
+    const double cookMs = cookTimer.elapsedMs();
+    evictFromPageCache(cookedPath);
+    Timer cachedTimer;
+    Texture cached("mipBenchCached", path);
+    UploadQueue::wait(UploadQueue::submit());
+    const double cachedMs = cachedTimer.elapsedMs();
+
+    printf("%-40s %4dx%-4d box %7.2f ms (scalar %8.2f ms, max error %d) | kaiser %7.2f ms\n", path.c_str(), width, height,
+           boxMs, scalarMs, maxError, kaiserMs);
+    printf("%-40s load with blits %7.2f ms | first load + cook %7.2f ms | cached %7.2f ms | %5.1fx\n", "", blitMs, cookMs, cachedMs,
+           blitMs / std::max(cachedMs, 0.001));
+  }
+  mode = previousMode;
+}
+
+void benchBlockCompression() {
+  printf("---- Block compression: encode throughput and PSNR of level 0 (%zu threads) ----\n", ThreadPool::get().getThreadCount());
+  const BlockCompressor::Format formats[] = {BlockCompressor::FORMAT_BC1, BlockCompressor::FORMAT_BC4, BlockCompressor::FORMAT_BC5, BlockCompressor::FORMAT_BC7};
+  const char *names[] = {"RGBA8", "BC1", "BC4", "BC5", "BC7"};
+  for (const auto &entry : std::filesystem::directory_iterator(TEXTURE_DIRECTORY)) {
+    const std::string path = entry.path().string();
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+      continue;
+    }
+    const size_t rawSize = BlockCompressor::getChainSize(width, height, BlockCompressor::FORMAT_RGBA8);
+    printf("%-40s %4dx%-4d %7.1f MB with mips as RGBA8\n", path.c_str(), width, height, rawSize / 1048576.0);
+    std::vector<uint8_t> decoded(static_cast<size_t>(width) * height * 4);
+    for (BlockCompressor::Format format : formats) {
+      std::vector<uint8_t> blocks(BlockCompressor::getLevelSize(width, height, format));
+      Timer encodeTimer;
+      BlockCompressor::compress(pixels, width, height, format, blocks.data());
+      const double encodeMs = encodeTimer.elapsedMs();
+      BlockCompressor::decompress(blocks.data(), width, height, format, decoded.data());
+      const double psnr = BlockCompressor::psnr(pixels, decoded.data(), width, height, format);
+      printf("    %-5s %8.2f ms %7.1f Mpixel/s | PSNR %6.2f dB | %7.1f MB with mips, %.0fx smaller\n", names[format], encodeMs,
+             static_cast<double>(width) * height / (encodeMs * 1000.0), psnr,
+             BlockCompressor::getChainSize(width, height, format) / 1048576.0,
+             static_cast<double>(rawSize) / BlockCompressor::getChainSize(width, height, format));
+    }
+    stbi_image_free(pixels);
+  }
+}
+
+void benchKtxLoad() {
+  printf("---- KTX2 load: PNG/JPEG decode + blits vs BC7 levels copied straight from the file ----\n");
+  if (!DeviceControl::supportsTextureCompressionBC()) {
+    printf("BC formats unsupported on this device, skipped\n");
+    return;
+  }
+  std::atomic<Texture::MipMode> &mode = Texture::getMipMode();
+  const Texture::MipMode previousMode = mode;
+  for (const auto &entry : std::filesystem::directory_iterator(TEXTURE_DIRECTORY)) {
+    const std::string path = entry.path().string();
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+      continue;
+    }
+    // Build the file the way an offline tool would, then check every level reads back as written.
+    std::vector<uint8_t> chain(MipGenerator::getChainSize(width, height));
+    memcpy(chain.data(), pixels, static_cast<size_t>(width) * height * 4);
+    stbi_image_free(pixels);
+    MipGenerator::generate(chain.data(), width, height, MipGenerator::FILTER_KAISER, true);
+    std::vector<uint8_t> blocks(BlockCompressor::getChainSize(width, height, BlockCompressor::FORMAT_BC7));
+    BlockCompressor::compressChain(chain.data(), width, height, BlockCompressor::FORMAT_BC7, blocks.data());
+    const std::string ktxPath = (std::filesystem::temp_directory_path() / entry.path().filename()).replace_extension(".ktx2").string();
+    KtxTexture::write(ktxPath, blocks.data(), width, height, BlockCompressor::FORMAT_BC7, true);
+
+    bool match;
+    {
+      KtxTexture ktx(ktxPath);
+      match = ktx.isValid() && ktx.getLevelCount() == MipGenerator::getLevelCount(width, height);
+      for (uint32_t level = 0; match && level < ktx.getLevelCount(); level++) {
+        match = memcmp(ktx.getData() + ktx.getLevelOffset(level),
+                       blocks.data() + BlockCompressor::getLevelOffset(width, height, level, BlockCompressor::FORMAT_BC7),
+                       ktx.getLevel(level).byteLength) == 0;
+      }
+    }
+
+    mode = Texture::MIPS_BLIT;
+    evictFromPageCache(path);
+    Timer decodeTimer;
+    Texture decoded("ktxBenchDecoded", path);
+    const double decodeMs = decodeTimer.elapsedMs();
+    evictFromPageCache(ktxPath);
+    Timer ktxTimer;
+    Texture ktx("ktxBenchKtx", ktxPath);
+    const double ktxMs = ktxTimer.elapsedMs();
+    std::filesystem::remove(ktxPath);
+
+    printf("%-40s %4dx%-4d decode + blits %7.2f ms, %6.1f MB | ktx2 %7.2f ms, %6.1f MB, %2u levels | %5.1fx | %s\n", path.c_str(),
+           width, height, decodeMs, decoded.getMemorySize() / 1048576.0, ktxMs, ktx.getMemorySize() / 1048576.0, ktx.getMipLevels(),
+           decodeMs / std::max(ktxMs, 0.001), match ? "match" : "MISMATCH");
+  }
+  mode = previousMode;
+}
+
+void benchTextureUsage() {
+  printf("---- Texture usage: staged bytes of the whole chain per usage, masks keep only red ----\n");
+  // Data is RGBA8 like color, and would fight it over the same cooked file.
+  const Texture::Usage usages[] = {Texture::USAGE_COLOR, Texture::USAGE_MASK, Texture::USAGE_VECTOR};
+  const char *names[] = {"color", "data", "mask", "vector"};
+  for (const auto &entry : std::filesystem::directory_iterator(TEXTURE_DIRECTORY)) {
+    const std::string path = entry.path().string();
+    if (KtxTexture::isKtxPath(path)) {
+      continue;
+    }
+    printf("%-40s", path.c_str());
+    Texture::Pixels reference;
+    for (Texture::Usage usage : usages) {
+      Texture::Pixels pixels = Texture::decode(path, usage);
+      if (!pixels.data) {
+        break;
+      }
+      // Level 0 is never filtered, whatever the channel count it has to be the decoded image.
+      bool match = true;
+      if (usage == Texture::USAGE_COLOR) {
+        reference = std::move(pixels);
+      } else {
+        const size_t channels = BlockCompressor::getBlockBytes(Texture::getStorageFormat(usage, false));
+        for (size_t pixel = 0; match && pixel < static_cast<size_t>(pixels.width) * pixels.height; pixel++) {
+          match = memcmp(pixels.data + pixel * channels, reference.data + pixel * 4, channels) == 0;
+        }
+      }
+      const Texture::Pixels &staged = usage == Texture::USAGE_COLOR ? reference : pixels;
+      printf(" | %s %6.1f MB%s", names[usage], staged.size / 1048576.0, match ? "" : " MISMATCH");
+    }
+    printf("\n");
+  }
+}
+
+void benchOrmPacking() {
+  printf("---- ORM packing: three mask textures vs one packed texture ----\n");
+  const std::string directory = TEXTURE_DIRECTORY;
+  const std::string maps[] = {directory + "/placeholderAO.jpg", directory + "/placeholderRoughness.jpg", directory + "/placeholderMetallic.jpg"};
+  size_t separateBytes = 0;
+  Texture::Pixels separate[3];
+  Timer separateTimer;
+  for (int i = 0; i < 3; i++) {
+    separate[i] = Texture::decode(maps[i], Texture::USAGE_MASK);
+    separateBytes += separate[i].size;
+  }
+  const double separateMs = separateTimer.elapsedMs();
+  Timer packedTimer;
+  Texture::Pixels packed = Texture::decodePacked(maps[0], maps[1], maps[2]);
+  const double packedMs = packedTimer.elapsedMs();
+  if (!packed.data) {
+    printf("Failed to pack the placeholder maps\n");
+    return;
+  }
+  // Level 0 of the packed texture is each mask in its own channel.
+  bool match = true;
+  for (int i = 0; i < 3; i++) {
+    for (size_t pixel = 0; match && pixel < static_cast<size_t>(packed.width) * packed.height; pixel++) {
+      match = separate[i].data && packed.data[pixel * 4 + i] == separate[i].data[pixel];
+    }
+  }
+  printf("separate %8.2f ms, %6.1f MB, 3 fetches | packed %8.2f ms, %6.1f MB, 1 fetch | %s\n", separateMs, separateBytes / 1048576.0,
+         packedMs, packed.size / 1048576.0, match ? "match" : "MISMATCH");
+}
+
+void benchTextureDedup() {
+  printf("---- Texture dedup: the same bytes under three IDs, one of them a copy of the file ----\n");
+  const std::string path = std::string(TEXTURE_DIRECTORY) + "/checkermap.png";
+  const std::string copyPath = (std::filesystem::temp_directory_path() / "checkermapCopy.png").string();
+  std::filesystem::copy_file(path, copyPath, std::filesystem::copy_options::overwrite_existing);
+  AssetCache cache;
+  Timer fetchTimer;
+  Texture *first = cache.fetchLoadTexture("dedupFirst", path);
+  const double missMs = fetchTimer.elapsedMs();
+  Timer hitTimer;
+  Texture *second = cache.fetchLoadTexture("dedupSecond", path);
+  Texture *copy = cache.fetchLoadTexture("dedupCopy", copyPath);
+  const double hitMs = hitTimer.elapsedMs() / 2.0;
+  const bool shared = first == second && first == copy && first->getReferences() == 3 &&
+                      cache.getTextureHits() == 2 && cache.getTextureMisses() == 1;
+  printf("miss %8.2f ms | hit %6.3f ms | %zu hits %zu misses, %.1f MB saved | %s\n", missMs, hitMs, cache.getTextureHits(),
+         cache.getTextureMisses(), cache.getTextureBytesSaved() / 1048576.0, shared ? "shared" : "NOT SHARED");
+  cache.remove("dedupFirst");
+  cache.remove("dedupSecond");
+  printf("after removing two aliases: %zu texture, %u reference\n", cache.getTextures().size(), copy->getReferences());
+  // Async fetches only find out it's a copy once the worker hashed it.
+  const std::string asyncCopyPath = (std::filesystem::temp_directory_path() / "checkermapAsyncCopy.png").string();
+  std::filesystem::copy_file(path, asyncCopyPath, std::filesystem::copy_options::overwrite_existing);
+  cache.fetchLoadTextureAsync("dedupAsyncCopy", asyncCopyPath);
+  cache.waitTextures();
+  const bool merged = cache.getTextures().size() == 1 && copy->getReferences() == 2;
+  printf("async copy after its decode: %zu texture, %u references | %s\n", cache.getTextures().size(), copy->getReferences(),
+         merged ? "shared" : "NOT SHARED");
+  cache.clear();
+  std::filesystem::remove(copyPath);
+  std::filesystem::remove(asyncCopyPath);
+}
+
+void benchTextureStreaming() {
+  printf("---- Texture streaming: tail levels on load, then a level at a time ----\n");
+  // A 2x2 quad mapped once, half a texture width per unit.
+  Agnosia_T::Vertex quad[4] = {};
+  quad[1].pos = {2.0f, 0.0f, 0.0f};
+  quad[2].pos = {2.0f, 2.0f, 0.0f};
+  quad[3].pos = {0.0f, 2.0f, 0.0f};
+  quad[1].uv = {1.0f, 0.0f};
+  quad[2].uv = {1.0f, 1.0f};
+  quad[3].uv = {0.0f, 1.0f};
+  const uint32_t quadIndices[6] = {0, 1, 2, 0, 2, 3};
+  const float density = Mesh::measureUvDensity(quad, quadIndices, 6);
+  printf("quad UV density %.3f | %s\n", density, std::abs(density - 0.5f) < 1e-5f ? "ok" : "WRONG");
+
+  std::atomic<bool> &streaming = Texture::getStreaming();
+  const bool previousStreaming = streaming;
+  streaming = true;
+  const std::string path = std::string(TEXTURE_DIRECTORY) + "/checkermap.png";
+  AssetCache cache;
+  Texture *texture = cache.fetchLoadTexture("streamed", path, Texture::USAGE_COLOR, true);
+  const size_t fullSize = texture->getStreamSize(0);
+  printf("%ux%u, %u levels, resident from level %u, %.1f KB of %.1f KB up\n", texture->getWidth(), texture->getHeight(),
+         texture->getMipLevels(), texture->getResidentLevel(), texture->getMemorySize() / 1024.0, fullSize / 1024.0);
+  while (texture->isStreaming()) {
+    const uint32_t level = texture->getResidentLevel() - 1;
+    Timer streamTimer;
+    const size_t copied = texture->streamIn(level);
+    UploadQueue::wait(UploadQueue::submit());
+    printf("level %2u: %8.1f KB in %6.2f ms\n", level, copied / 1024.0, streamTimer.elapsedMs());
+  }
+  printf("fully resident %.1f KB | %s\n", texture->getMemorySize() / 1024.0,
+         fullSize == 0 || texture->getMemorySize() == fullSize ? "ok" : "SIZE MISMATCH");
+  cache.clear();
+  streaming = previousStreaming;
+}
+
+// Fills level 0 of an image with noise, builds the rest with MipDownsampler and
+// reads every level back, returns the largest difference from the CPU reference.
+int checkComputeMips(uint32_t width, uint32_t height, bool srgb, double &computeMs) {
+  const VkFormat format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+  const uint32_t mipLevels = MipGenerator::getLevelCount(width, height);
+  const size_t imageSize = static_cast<size_t>(width) * height * 4;
+  const size_t chainSize = MipGenerator::getChainSize(width, height);
+  std::vector<uint8_t> reference(chainSize);
+  std::mt19937 random(width * 31 + height);
+  for (size_t i = 0; i < imageSize; i++) {
+    reference[i] = static_cast<uint8_t>(random());
+  }
+
+  Agnosia_T::AllocatedBuffer buffer = Buffers::createBuffer(chainSize, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_AUTO);
+  uint8_t *mapped = static_cast<uint8_t *>(buffer.info.pMappedData);
+  memcpy(mapped, reference.data(), imageSize);
+  vmaFlushAllocation(Buffers::getAllocator(), buffer.allocation, 0, VK_WHOLE_SIZE);
+
+  VkImageCreateInfo imageInfo = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .flags = MipDownsampler::getImageFlags(),
+    .imageType = VK_IMAGE_TYPE_2D,
+    .format = format,
+    .extent = {width, height, 1},
+    .mipLevels = mipLevels,
+    .arrayLayers = 1,
+    .samples = VK_SAMPLE_COUNT_1_BIT,
+    .tiling = VK_IMAGE_TILING_OPTIMAL,
+    .usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | MipDownsampler::getImageUsage(),
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+  VmaAllocationCreateInfo vmaCreateInfo = {
+    .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+  };
+  VkImage image;
+  VmaAllocation allocation;
+  vmaCreateImage(Buffers::getAllocator(), &imageInfo, &vmaCreateInfo, &image, &allocation, nullptr);
+
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask = 0,
+    .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = image,
+    .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1},
+  };
+  std::vector<VkBufferImageCopy> regions(mipLevels);
+  for (uint32_t level = 0; level < mipLevels; level++) {
+    regions[level] = {
+      .bufferOffset = MipGenerator::getLevelOffset(width, height, level),
+      .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1},
+      .imageExtent = {MipGenerator::getLevelSize(width, level), MipGenerator::getLevelSize(height, level), 1},
+    };
+  }
+  VkCommandBuffer cmd = UploadQueue::getCommandBuffer();
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+  vkCmdCopyBufferToImage(cmd, buffer.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, regions.data());
+  UploadQueue::wait(UploadQueue::submit());
+  Timer computeTimer;
+  MipDownsampler::generate(image, format, width, height, mipLevels);
+  UploadQueue::wait(UploadQueue::submit());
+  computeMs = computeTimer.elapsedMs();
+  barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  cmd = UploadQueue::getCommandBuffer();
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+  vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer.buffer, mipLevels - 1, regions.data() + 1);
+  UploadQueue::wait(UploadQueue::submit());
+  vmaInvalidateAllocation(Buffers::getAllocator(), buffer.allocation, 0, VK_WHOLE_SIZE);
+
+  MipDownsampler::generateReference(reference.data(), width, height, srgb);
+  int maxError = 0;
+  for (size_t i = imageSize; i < chainSize; i++) {
+    maxError = std::max(maxError, std::abs(static_cast<int>(mapped[i]) - static_cast<int>(reference[i])));
+  }
+  vmaDestroyImage(Buffers::getAllocator(), image, allocation);
+  vmaDestroyBuffer(Buffers::getAllocator(), buffer.buffer, buffer.allocation);
+  return maxError;
+}
+
+void benchComputeMips() {
+  printf("---- Compute mips: five levels a dispatch vs a blit and barrier per level ----\n");
+  if (!MipDownsampler::supports(VK_FORMAT_R8G8B8A8_SRGB)) {
+    printf("compute mips unavailable on this device, skipped\n");
+    return;
+  }
+  const uint32_t sizes[][2] = {{37, 5}, {1000, 600}, {1024, 1024}, {4096, 4096}};
+  for (const auto &size : sizes) {
+    for (bool srgb : {false, true}) {
+      double computeMs;
+      const int maxError = checkComputeMips(size[0], size[1], srgb, computeMs);
+      printf("%4ux%-4u %-5s compute %7.2f ms | max error %d vs CPU reference | %s\n", size[0], size[1], srgb ? "sRGB" : "UNORM",
+             computeMs, maxError, maxError <= 1 ? "ok" : "MISMATCH");
+    }
+  }
+
+  // Whole uploads of level 0 only, decode included.
+  std::atomic<Texture::MipMode> &mode = Texture::getMipMode();
+  const Texture::MipMode previousMode = mode;
+  mode = Texture::MIPS_BLIT;
+  const std::string path = std::string(TEXTURE_DIRECTORY) + "/checkermap.png";
+  bool &enabled = MipDownsampler::getEnabled();
+  enabled = false;
+  Timer blitTimer;
+  {
+    Texture blit("computeMipsBlit", path);
+    UploadQueue::wait(UploadQueue::submit());
+  }
+  const double blitMs = blitTimer.elapsedMs();
+  enabled = true;
+  Timer computeTimer;
+  {
+    Texture compute("computeMipsCompute", path);
+    UploadQueue::wait(UploadQueue::submit());
+  }
+  const double computeMs = computeTimer.elapsedMs();
+  printf("%-40s load with blits %7.2f ms | with compute %7.2f ms\n", path.c_str(), blitMs, computeMs);
+  mode = previousMode;
+}
+
+void benchUploadQueue() {
+  printf("---- Upload queue: a submit and wait per asset vs every asset in one batch ----\n");
+  constexpr uint32_t UPLOAD_COUNT = 64;
+  constexpr VkDeviceSize UPLOAD_SIZE = 256 << 10;
+  Agnosia_T::AllocatedBuffer target = Buffers::createBuffer(UPLOAD_COUNT * UPLOAD_SIZE, 0, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+  auto upload = [&](uint32_t i, uint8_t value) {
+    const UploadQueue::Allocation staging = UploadQueue::stage(UPLOAD_SIZE);
+    memset(staging.data, value, UPLOAD_SIZE);
+    const VkBufferCopy copy = {.srcOffset = staging.offset, .dstOffset = i * UPLOAD_SIZE, .size = UPLOAD_SIZE};
+    vkCmdCopyBuffer(UploadQueue::getCommandBuffer(), staging.buffer, target.buffer, 1, &copy);
+  };
+
+  // What every load used to do, wait for the queue after each one.
+  uint64_t submits = UploadQueue::getSubmitCount();
+  Timer stallTimer;
+  for (uint32_t i = 0; i < UPLOAD_COUNT; i++) {
+    upload(i, static_cast<uint8_t>(i));
+    UploadQueue::wait(UploadQueue::submit());
+  }
+  const double stallMs = stallTimer.elapsedMs();
+  const uint64_t stallSubmits = UploadQueue::getSubmitCount() - submits;
+  submits = UploadQueue::getSubmitCount();
+  Timer batchTimer;
+  for (uint32_t i = 0; i < UPLOAD_COUNT; i++) {
+    upload(i, static_cast<uint8_t>(UPLOAD_COUNT + i));
+  }
+  UploadQueue::wait(UploadQueue::submit());
+  const double batchMs = batchTimer.elapsedMs();
+  const uint64_t batchSubmits = UploadQueue::getSubmitCount() - submits;
+
+  // Every upload of the batch landed where it was meant to.
+  Agnosia_T::AllocatedBuffer readback = Buffers::createBuffer(UPLOAD_COUNT * UPLOAD_SIZE, 0, Buffers::INTENT_READBACK);
+  const VkBufferCopy copy = {.size = UPLOAD_COUNT * UPLOAD_SIZE};
+  vkCmdCopyBuffer(UploadQueue::getCommandBuffer(), target.buffer, readback.buffer, 1, &copy);
+  UploadQueue::wait(UploadQueue::submit());
+  vmaInvalidateAllocation(Buffers::getAllocator(), readback.allocation, 0, VK_WHOLE_SIZE);
+  const uint8_t *mapped = static_cast<const uint8_t *>(readback.info.pMappedData);
+  bool match = true;
+  for (VkDeviceSize i = 0; i < UPLOAD_COUNT * UPLOAD_SIZE; i++) {
+    match &= mapped[i] == UPLOAD_COUNT + i / UPLOAD_SIZE;
+  }
+  vmaDestroyBuffer(Buffers::getAllocator(), readback.buffer, readback.allocation);
+  vmaDestroyBuffer(Buffers::getAllocator(), target.buffer, target.allocation);
+  printf("%u x %llu KB, waiting %8.2f ms in %llu submits | batched %8.2f ms in %llu submit | %5.1fx | %s\n", UPLOAD_COUNT,
+         static_cast<unsigned long long>(UPLOAD_SIZE >> 10), stallMs, static_cast<unsigned long long>(stallSubmits), batchMs,
+         static_cast<unsigned long long>(batchSubmits), stallMs / std::max(batchMs, 0.001), match ? "match" : "MISMATCH");
+}
+
+void benchChunkedUpload() {
+  printf("---- Chunked upload: one staging buffer for everything vs chunks through a small ring ----\n");
+  constexpr size_t ELEMENT_COUNT = 16 << 20;
+  constexpr VkDeviceSize UPLOAD_SIZE = ELEMENT_COUNT * sizeof(uint32_t);
+  constexpr VkDeviceSize BUDGET = 8 << 20;
+  const VkDeviceSize previousBudget = UploadQueue::getStagingBudget();
+  Agnosia_T::AllocatedBuffer target = Buffers::createBuffer(UPLOAD_SIZE, 0, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+  auto write = [](void *destination, size_t first, size_t count) {
+    uint32_t *values = static_cast<uint32_t *>(destination);
+    for (size_t i = 0; i < count; i++) {
+      values[i] = static_cast<uint32_t>(first + i);
+    }
+  };
+  auto copy = [&](VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, size_t first, size_t count) {
+    const VkBufferCopy region = {.srcOffset = offset, .dstOffset = first * sizeof(uint32_t), .size = count * sizeof(uint32_t)};
+    vkCmdCopyBuffer(cmd, buffer, target.buffer, 1, &region);
+  };
+
+  // Bigger than the ring, staged in one piece it gets a buffer of its own.
+  UploadQueue::setStagingBudget(BUDGET);
+  Timer wholeTimer;
+  const UploadQueue::Allocation staging = UploadQueue::stage(UPLOAD_SIZE);
+  write(staging.data, 0, ELEMENT_COUNT);
+  copy(UploadQueue::getCommandBuffer(), staging.buffer, staging.offset, 0, ELEMENT_COUNT);
+  UploadQueue::wait(UploadQueue::submit());
+  const double wholeMs = wholeTimer.elapsedMs();
+  const VkDeviceSize wholePeak = UploadQueue::getStagingPeak();
+
+  UploadQueue::setStagingBudget(BUDGET);
+  Timer chunkTimer;
+  UploadQueue::stageChunked(ELEMENT_COUNT, sizeof(uint32_t), write, copy);
+  UploadQueue::wait(UploadQueue::submit());
+  const double chunkMs = chunkTimer.elapsedMs();
+  const VkDeviceSize chunkPeak = UploadQueue::getStagingPeak();
+  UploadQueue::setStagingBudget(previousBudget);
+
+  // Every chunk landed where it was meant to.
+  Agnosia_T::AllocatedBuffer readback = Buffers::createBuffer(UPLOAD_SIZE, 0, Buffers::INTENT_READBACK);
+  const VkBufferCopy region = {.size = UPLOAD_SIZE};
+  vkCmdCopyBuffer(UploadQueue::getCommandBuffer(), target.buffer, readback.buffer, 1, &region);
+  UploadQueue::wait(UploadQueue::submit());
+  vmaInvalidateAllocation(Buffers::getAllocator(), readback.allocation, 0, VK_WHOLE_SIZE);
+  const uint32_t *mapped = static_cast<const uint32_t *>(readback.info.pMappedData);
+  bool match = true;
+  for (size_t i = 0; i < ELEMENT_COUNT; i++) {
+    match &= mapped[i] == i;
+  }
+  vmaDestroyBuffer(Buffers::getAllocator(), readback.buffer, readback.allocation);
+  vmaDestroyBuffer(Buffers::getAllocator(), target.buffer, target.allocation);
+  printf("%llu MB, whole %8.2f ms peak %6.1f MB | chunked %8.2f ms peak %6.1f MB | %s\n", static_cast<unsigned long long>(UPLOAD_SIZE >> 20),
+         wholeMs, wholePeak / 1048576.0, chunkMs, chunkPeak / 1048576.0, match ? "match" : "MISMATCH");
+}
+
+void benchGeometryMemory() {
+  printf("---- Geometry memory: mapped host visible vs device local, staged or written in place (%s) ----\n",
+         Buffers::hasHostVisibleVram() ? "ReBAR/UMA" : "no ReBAR");
+  constexpr size_t ELEMENT_COUNT = 8 << 20;
+  constexpr VkDeviceSize BUFFER_SIZE = ELEMENT_COUNT * sizeof(uint32_t);
+  constexpr uint32_t READS = 16;
+  const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  Agnosia_T::AllocatedBuffer target = Buffers::createBuffer(BUFFER_SIZE, 0, Buffers::INTENT_STATIC);
+  auto write = [](void *destination, size_t first, size_t count) {
+    uint32_t *values = static_cast<uint32_t *>(destination);
+    for (size_t i = 0; i < count; i++) {
+      values[i] = static_cast<uint32_t>(first + i);
+    }
+  };
+  // Filling the buffer, then the GPU reading it READS times the way a frame
+  // reads geometry, over PCIe when it sits in system memory.
+  auto run = [&](const char *name, Agnosia_T::AllocatedBuffer buffer) {
+    Timer uploadTimer;
+    if (buffer.info.pMappedData != nullptr) {
+      write(buffer.info.pMappedData, 0, ELEMENT_COUNT);
+      vmaFlushAllocation(Buffers::getAllocator(), buffer.allocation, 0, VK_WHOLE_SIZE);
+    } else {
+      UploadQueue::stageChunked(ELEMENT_COUNT, sizeof(uint32_t), write,
+                                [&](VkCommandBuffer cmd, VkBuffer staging, VkDeviceSize offset, size_t first, size_t count) {
+        const VkBufferCopy region = {.srcOffset = offset, .dstOffset = first * sizeof(uint32_t), .size = count * sizeof(uint32_t)};
+        vkCmdCopyBuffer(cmd, staging, buffer.buffer, 1, &region);
+      });
+      UploadQueue::wait(UploadQueue::submit());
+    }
+    const double uploadMs = uploadTimer.elapsedMs();
+    Timer readTimer;
+    const VkBufferCopy region = {.size = BUFFER_SIZE};
+    for (uint32_t i = 0; i < READS; i++) {
+      vkCmdCopyBuffer(UploadQueue::getCommandBuffer(), buffer.buffer, target.buffer, 1, &region);
+    }
+    UploadQueue::wait(UploadQueue::submit());
+    const double readMs = readTimer.elapsedMs();
+    printf("%-14s %-16s upload %8.2f ms | %u GPU reads %8.2f ms\n", name, Buffers::getMemoryName(Buffers::getMemoryFlags(buffer)),
+           uploadMs, READS, readMs);
+    vmaDestroyBuffer(Buffers::getAllocator(), buffer.buffer, buffer.allocation);
+  };
+
+  // What meshes used to get.
+  run("mapped", Buffers::createBuffer(BUFFER_SIZE, VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+                                      usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_AUTO));
+  const bool directWrite = Buffers::getDirectWrite();
+  Buffers::getDirectWrite() = false;
+  run("static staged", Buffers::createBuffer(BUFFER_SIZE, usage, Buffers::INTENT_STATIC));
+  Buffers::getDirectWrite() = true;
+  run("static direct", Buffers::createBuffer(BUFFER_SIZE, usage, Buffers::INTENT_STATIC));
+  Buffers::getDirectWrite() = directWrite;
+  vmaDestroyBuffer(Buffers::getAllocator(), target.buffer, target.allocation);
+}
+
+void benchGeometryPool() {
+  printf("---- Geometry pool: a buffer per mesh vs ranges of one pool, then compacted ----\n");
+  constexpr uint32_t MESH_COUNT = 8192;
+  constexpr VkDeviceSize MESH_ELEMENTS = 1024;
+  const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+  // What every mesh used to get, its own allocation.
+  std::vector<Agnosia_T::AllocatedBuffer> buffers(MESH_COUNT);
+  Timer bufferTimer;
+  for (Agnosia_T::AllocatedBuffer &buffer : buffers) {
+    buffer = Buffers::createBuffer(MESH_ELEMENTS * sizeof(uint32_t), usage, Buffers::INTENT_STATIC);
+  }
+  for (Agnosia_T::AllocatedBuffer &buffer : buffers) {
+    vmaDestroyBuffer(Buffers::getAllocator(), buffer.buffer, buffer.allocation);
+  }
+  const double bufferMs = bufferTimer.elapsedMs();
+
+  // Each range holds its own index, so every value shows where it was meant to end up.
+  GeometryPool pool(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  std::vector<GeometryPool::Range> ranges(MESH_COUNT);
+  Timer poolTimer;
+  for (uint32_t i = 0; i < MESH_COUNT; i++) {
+    pool.allocate(ranges[i], MESH_ELEMENTS);
+  }
+  for (uint32_t i = 0; i < MESH_COUNT; i++) {
+    const VkDeviceSize start = ranges[i].offset * sizeof(uint32_t);
+    UploadQueue::stageChunked(MESH_ELEMENTS, sizeof(uint32_t),
+                              [&](void *destination, size_t first, size_t count) {
+      std::fill_n(static_cast<uint32_t *>(destination), count, i);
+    },
+                              [&](VkCommandBuffer cmd, VkBuffer staging, VkDeviceSize offset, size_t first, size_t count) {
+      const VkBufferCopy region = {.srcOffset = offset, .dstOffset = start + first * sizeof(uint32_t), .size = count * sizeof(uint32_t)};
+      vkCmdCopyBuffer(cmd, staging, pool.getBuffer(), 1, &region);
+    });
+  }
+  UploadQueue::wait(UploadQueue::submit());
+  const double poolMs = poolTimer.elapsedMs();
+
+  // Three meshes in four removed, then the rest packed to the front.
+  for (uint32_t i = 0; i < MESH_COUNT; i++) {
+    if (i % 4 != 3) {
+      pool.free(ranges[i]);
+    }
+  }
+  const VkDeviceSize capacityBefore = pool.getCapacity();
+  Timer compactTimer;
+  pool.compact();
+  UploadQueue::wait(UploadQueue::submit());
+  const double compactMs = compactTimer.elapsedMs();
+
+  Agnosia_T::AllocatedBuffer readback = Buffers::createBuffer(pool.getCapacity() * sizeof(uint32_t), 0, Buffers::INTENT_READBACK);
+  const VkBufferCopy region = {.size = pool.getCapacity() * sizeof(uint32_t)};
+  vkCmdCopyBuffer(UploadQueue::getCommandBuffer(), pool.getBuffer(), readback.buffer, 1, &region);
+  UploadQueue::wait(UploadQueue::submit());
+  vmaInvalidateAllocation(Buffers::getAllocator(), readback.allocation, 0, VK_WHOLE_SIZE);
+  const uint32_t *mapped = static_cast<const uint32_t *>(readback.info.pMappedData);
+  bool match = true;
+  for (uint32_t i = 3; i < MESH_COUNT; i += 4) {
+    for (VkDeviceSize element = 0; element < MESH_ELEMENTS; element++) {
+      match &= mapped[ranges[i].offset + element] == i;
+    }
+  }
+  vmaDestroyBuffer(Buffers::getAllocator(), readback.buffer, readback.allocation);
+  for (uint32_t i = 3; i < MESH_COUNT; i += 4) {
+    pool.free(ranges[i]);
+  }
+  // The frees are deferred to the upload queue, they have to run before the pool goes.
+  UploadQueue::wait(UploadQueue::submit());
+  pool.destroy();
+  printf("%u meshes, buffers %8.2f ms | pool %8.2f ms, %u moves | compacted %.1f -> %.1f MB in %8.2f ms | %s\n", MESH_COUNT, bufferMs,
+         poolMs, pool.getRelocations(), capacityBefore * sizeof(uint32_t) / 1048576.0, pool.getCapacity() * sizeof(uint32_t) / 1048576.0,
+         compactMs, match ? "match" : "MISMATCH");
+}
+
+void Benchmark::runAll() {
+  benchMeshLoad();
+  benchObjParse();
+  benchVertexRemap();
+  benchVertexCache();
+  benchSimplifier();
+  benchMeshlets();
+  benchVertexPacking();
+  benchCulling();
+  benchTextureDecode();
+  benchMipGeneration();
+  benchBlockCompression();
+  benchKtxLoad();
+  benchTextureUsage();
+  benchOrmPacking();
+  benchTextureDedup();
+  benchTextureStreaming();
+  benchComputeMips();
+  benchUploadQueue();
+  benchChunkedUpload();
+  benchGeometryMemory();
+  benchGeometryPool();
+}
+#endif
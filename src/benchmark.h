@@ -0,0 +1,8 @@
+#pragma once
+
+// CPU side benchmarks, compiled in with -DAGNOSIA_BENCHMARK=ON. They run once
+// after the engine is initialized and print their results to stdout.
+class Benchmark {
+public:
+  static void runAll();
+};
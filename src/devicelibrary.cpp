@@ -14,6 +14,7 @@ VkQueue graphicsQueue;
 VkQueue presentQueue;
 VkPhysicalDevice physicalDevice;
 VkSampleCountFlagBits perPixelSampleCount;
+bool textureCompressionBC = false;
 
 VkSwapchainKHR swapChain;
 std::vector<VkImage> swapChainImages;
@@ -132,8 +133,7 @@ bool isDeviceSuitable(VkPhysicalDevice device) {
     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
   }
 
-  return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-         supportedFeatures.samplerAnisotropy && indices.isComplete() &&
+  return supportedFeatures.samplerAnisotropy && indices.isComplete() &&
          extensionSupported && swapChainAdequate;
 }
 // -------------------------------------- Swap Chain Settings ----------------------------------------- //
@@ -236,18 +236,26 @@ void DeviceControl::pickPhysicalDevice(VkInstance &instance) {
       deviceCount); // Direct Initialization is weird af, yo
   vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
+  // A discrete GPU if there is one, otherwise whatever works, down to a
+  // software driver like lavapipe.
   for (const auto &device : devices) {
     if (isDeviceSuitable(device)) {
       // Once we have buttons or such, maybe ask the user or write a config file
       // for which GPU to use?
-      physicalDevice = device;
-      perPixelSampleCount = getMaxUsableSampleCount();
-      break;
+      if (physicalDevice == VK_NULL_HANDLE || deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+        physicalDevice = device;
+      }
+      if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+        break;
+      }
     }
   }
   if (physicalDevice == VK_NULL_HANDLE) {
     throw std::runtime_error("Failed to find a suitable GPU! (DeviceLibrary.cpp:269)");
   }
+  // isDeviceSuitable leaves the last device it looked at in deviceProperties.
+  vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+  perPixelSampleCount = getMaxUsableSampleCount();
 }
 void DeviceControl::createSurface(VkInstance &instance, GLFWwindow *window) {
   VK_CHECK(glfwCreateWindowSurface(instance, window, nullptr, &surface));
@@ -299,6 +307,7 @@ void DeviceControl::createLogicalDevice() {
       .descriptorBindingPartiallyBound = true,
       .runtimeDescriptorArray = true,
       .scalarBlockLayout = true,
+      .timelineSemaphore = true,
       .bufferDeviceAddress = true,
 
   };
@@ -309,6 +318,11 @@ void DeviceControl::createLogicalDevice() {
       .dynamicRendering = true,
 
   };
+  // Every desktop GPU has BCn, but only ask for it when it's there, textures fall back to RGBA8 otherwise.
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+  textureCompressionBC = supportedFeatures.textureCompressionBC;
+
   VkPhysicalDeviceFeatures featuresBase{
       .robustBufferAccess = true,
       .sampleRateShading = true,
@@ -316,6 +330,9 @@ void DeviceControl::createLogicalDevice() {
       .wideLines = true,
       .largePoints = true,
       .samplerAnisotropy = true,
+      .textureCompressionBC = textureCompressionBC,
+      // MipDownsampler picks its storage image by push constant, it blits without.
+      .shaderStorageImageArrayDynamicIndexing = supportedFeatures.shaderStorageImageArrayDynamicIndexing,
   };
 
   VkPhysicalDeviceFeatures2 deviceFeatures{
@@ -412,10 +429,15 @@ void DeviceControl::createSwapChain(GLFWwindow *window) {
   swapChainExtent = extent;
 }
 
-VkImageView DeviceControl::createImageView(VkImage image, VkFormat format, VkImageAspectFlags flags, uint32_t mipLevels) {
+VkImageView DeviceControl::createImageView(VkImage image, VkFormat format, VkImageAspectFlags flags, uint32_t mipLevels, VkImageUsageFlags usage) {
   // This defines the parameters of a newly created image object!
+  VkImageViewUsageCreateInfo usageInfo = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO,
+    .usage = usage,
+  };
   VkImageViewCreateInfo viewInfo{};
   viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.pNext = usage != 0 ? &usageInfo : nullptr;
   viewInfo.image = image;
   viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
   viewInfo.format = format;
@@ -452,6 +474,7 @@ std::vector<VkImageView> &DeviceControl::getSwapChainImageViews() {
 }
 VkDevice &DeviceControl::getDevice() { return device; }
 VkPhysicalDevice &DeviceControl::getPhysicalDevice() { return physicalDevice; }
+bool DeviceControl::supportsTextureCompressionBC() { return textureCompressionBC; }
 VkSampleCountFlagBits &DeviceControl::getPerPixelSampleCount() {
   return perPixelSampleCount;
 }
@@ -22,9 +22,12 @@ public:
   static void createLogicalDevice();
   static void createSurface(VkInstance &instance, GLFWwindow *window);
   static void createSwapChain(GLFWwindow *window);
+  // usage narrows what the view is for, needed when the image's other uses
+  // aren't supported by the view's format. 0 keeps the image's.
   static VkImageView createImageView(VkImage image, VkFormat format,
                                      VkImageAspectFlags flags,
-                                     uint32_t mipLevels);
+                                     uint32_t mipLevels,
+                                     VkImageUsageFlags usage = 0);
   static void createImageViews();
   static void createCommandPool();
   static QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
@@ -40,6 +43,8 @@ public:
   static VkQueue &getGraphicsQueue();
   static VkQueue &getPresentQueue();
   static VkPhysicalDevice &getPhysicalDevice();
+  // Whether the BC1-BC7 image formats were enabled on the device.
+  static bool supportsTextureCompressionBC();
   static VkSampleCountFlagBits &getPerPixelSampleCount();
   static std::vector<VkImageView> &getSwapChainImageViews();
   static VkSwapchainKHR &getSwapChain();
@@ -1,14 +1,19 @@
 #include "agnosiaimgui.h"
 #include "assetcache.h"
+#include "benchmark.h"
 #include "devicelibrary.h"
 #include "entrypoint.h"
 #include "graphics/buffers.h"
+#include "graphics/geometrypool.h"
 #include "graphics/graphicspipeline.h"
+#include "graphics/mipdownsampler.h"
 
 #include "graphics/model.h"
 #include "graphics/pipelinebuilder.h"
 #include "graphics/render.h"
 #include "graphics/texture.h"
+#include "graphics/texturestreamer.h"
+#include "graphics/uploadqueue.h"
 #include "utils/helpers.h"
 #include "utils/types.h"
 #include <memory>
@@ -81,25 +86,41 @@ void createInstance() {
   DeletionQueue::get().push_function([=](){vkDestroyInstance(vulkaninstance, nullptr);});
 }
 void initAgnosia() {
-  Texture* checkermap = cache.fetchLoadTexture("checkermap", "assets/textures/checkermap.png");
-  Texture* metallicPlaceholder = cache.fetchLoadTexture("metallicPlaceholder", "assets/textures/placeholderMetallic.jpg");
-  Texture* roughnessPlaceholder = cache.fetchLoadTexture("roughnessPlaceholder", "assets/textures/placeholderRoughness.jpg");
-  Texture* ambientOcclusionPlaceholder = cache.fetchLoadTexture("ambientOcclusionPlaceholder", "assets/textures/placeholderAO.jpg");
+  // Decoded in parallel on the thread pool while the meshes load, uploaded as they finish.
+  // Block compressed and cooked on the first run. The three material maps are
+  // packed into one ORM texture, two fetches a pixel instead of four.
+  Texture* checkermap = cache.fetchLoadTextureAsync("checkermap", "assets/textures/checkermap.png", Texture::USAGE_COLOR, true);
+  Texture* ormPlaceholder = cache.fetchLoadPackedTextureAsync("ormPlaceholder", "assets/textures/placeholderAO.jpg",
+                                                              "assets/textures/placeholderRoughness.jpg", "assets/textures/placeholderMetallic.jpg", true);
   
-  auto sphereMaterial = std::make_unique<Material>("sphereMaterial", checkermap, metallicPlaceholder, roughnessPlaceholder, ambientOcclusionPlaceholder);
-  auto stanfordDragonMaterial = std::make_unique<Material>("stanfordDragonMaterial", checkermap, metallicPlaceholder, roughnessPlaceholder, ambientOcclusionPlaceholder);
-  auto teapotMaterial = std::make_unique<Material>("teapotMaterial", checkermap, metallicPlaceholder, roughnessPlaceholder, ambientOcclusionPlaceholder);
+  auto sphereMaterial = std::make_unique<Material>("sphereMaterial", checkermap, ormPlaceholder);
+  auto stanfordDragonMaterial = std::make_unique<Material>("stanfordDragonMaterial", checkermap, ormPlaceholder);
+  auto teapotMaterial = std::make_unique<Material>("teapotMaterial", checkermap, ormPlaceholder);
   cache.store(std::move(sphereMaterial));
   cache.store(std::move(stanfordDragonMaterial));
   cache.store(std::move(teapotMaterial));
 
-  auto uvSphere = std::make_unique<Model>("uvSphere", *cache.findMaterial("sphereMaterial"), "assets/models/UVSphere.obj", glm::vec3(0.0f, 0.0f, 0.0f));
-  auto stanfordDragon = std::make_unique<Model>("stanfordDragon", *cache.findMaterial("stanfordDragonMaterial"), "assets/models/StanfordDragon800k.obj", glm::vec3(0.0f, 2.0f, 0.0f));
-  auto teapot = std::make_unique<Model>("teapot", *cache.findMaterial("teapotMaterial"), "assets/models/teapot.obj", glm::vec3(1.0f, -3.0f, -1.0f));
+  auto uvSphere = std::make_unique<Model>("uvSphere", *cache.findMaterial("sphereMaterial"), cache.fetchLoadMesh("assets/models/UVSphere.obj"), glm::vec3(0.0f, 0.0f, 0.0f));
+  auto stanfordDragon = std::make_unique<Model>("stanfordDragon", *cache.findMaterial("stanfordDragonMaterial"), cache.fetchLoadMesh("assets/models/StanfordDragon800k.obj", Agnosia_T::VERTEX_PACKED), glm::vec3(0.0f, 2.0f, 0.0f));
+  auto teapot = std::make_unique<Model>("teapot", *cache.findMaterial("teapotMaterial"), cache.fetchLoadMesh("assets/models/teapot.obj"), glm::vec3(1.0f, -3.0f, -1.0f));
   cache.store(std::move(uvSphere));
   cache.store(std::move(stanfordDragon));
   cache.store(std::move(teapot));
-  
+
+#ifdef AGNOSIA_STRESS_SCENE
+  // A grid of teapots sharing one mesh and material, they should all end up in
+  // a handful of instanced draws. Most are past the far plane from the default
+  // camera, turn frustum culling off in the UI to push all of them.
+  constexpr int STRESS_GRID = 100;
+  constexpr float STRESS_SPACING = 4.0f;
+  for(int y = 0; y < STRESS_GRID; y++) {
+    for(int x = 0; x < STRESS_GRID; x++) {
+      const glm::vec3 position((x - STRESS_GRID / 2) * STRESS_SPACING, (y - STRESS_GRID / 2) * STRESS_SPACING, -4.0f);
+      cache.store(std::make_unique<Model>("stressTeapot" + std::to_string(y * STRESS_GRID + x), *cache.findMaterial("teapotMaterial"),
+                                          cache.fetchLoadMesh("assets/models/teapot.obj"), position));
+    }
+  }
+#endif
 }
 void initVulkan() {
   // Initialize volk and continue if successful.
@@ -127,31 +148,44 @@ void initVulkan() {
                                       
   Graphics::addGraphicsPipeline(graphics);
   Graphics::addFullscreenPipeline(fullscreen);
+  MipDownsampler::createPipeline();
   Buffers::createDescriptorPool();
   Graphics::createCommandPool();
+  UploadQueue::create();
+  GeometryPool::create();
+  Texture::createPlaceholderImage();
   initAgnosia();
   // Image creation MUST be after command pool, because command buffers are utilized.
   Texture::createColorImage();
   Texture::createDepthImage();
   Buffers::createDescriptorSet(cache.getModels());
   Graphics::createCommandBuffer();
+  Graphics::createTimestampQueries();
   Render::createSyncObject();
   
 
   Gui::initImgui(vulkaninstance);
+#ifdef AGNOSIA_BENCHMARK
+  Benchmark::runAll();
+#endif
 }
 
 void mainLoop() {
   while (!glfwWindowShouldClose(window)) {
     glfwPollEvents();
 
+    cache.pollTextures();
+    TextureStreamer::update(cache);
     Gui::drawImGui(cache);
+    // Everything recorded this frame goes in one batch, ahead of the frame using it.
+    UploadQueue::submit();
     Render::drawFrame(cache);
   }
   vkDeviceWaitIdle(DeviceControl::getDevice());
 }
 
 void cleanup() {
+  cache.clear();
   DeletionQueue::get().push_function([=](){Render::cleanupSwapChain();});
   DeletionQueue::get().flush();
   
@@ -0,0 +1,657 @@
+#include "blockcompressor.h"
+#include "mipgen.h"
+#include "../utils/threadpool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AGNOSIA_BLOCKS_SSE
+#endif
+
+// Rows of blocks per job, a 4K level has 1024 of them.
+constexpr uint32_t BLOCK_ROWS_PER_JOB = 8;
+// Least squares passes over the endpoints after the first fit. Each one usually
+// shaves off a little more error, the best encoding seen is kept either way.
+constexpr int REFINE_PASSES = 2;
+// Interpolation weights of BC7's 4 bit indices, out of 64.
+constexpr int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// The 16 pixels of a block a channel at a time, so four pixels fill an SSE register.
+struct Block {
+  alignas(16) float channels[4][16];
+};
+// Colors a block can pick from, only the channels being encoded are filled in.
+struct Palette {
+  float colors[16][4];
+  int size;
+};
+
+// BC7 packs its fields at arbitrary bit offsets, least significant bit first.
+struct BitWriter {
+  uint8_t *out;
+  uint32_t position = 0;
+
+  void write(uint32_t value, uint32_t bits) {
+    for (uint32_t bit = 0; bit < bits; bit++, this->position++) {
+      if ((value >> bit) & 1) {
+        this->out[this->position >> 3] |= static_cast<uint8_t>(1 << (this->position & 7));
+      }
+    }
+  }
+};
+struct BitReader {
+  const uint8_t *in;
+  uint32_t position = 0;
+
+  uint32_t read(uint32_t bits) {
+    uint32_t value = 0;
+    for (uint32_t bit = 0; bit < bits; bit++, this->position++) {
+      value |= static_cast<uint32_t>((this->in[this->position >> 3] >> (this->position & 7)) & 1) << bit;
+    }
+    return value;
+  }
+};
+
+// The RGBA channels a format keeps, always a run starting at red.
+int getChannelCount(BlockCompressor::Format format) {
+  switch (format) {
+  case BlockCompressor::FORMAT_BC1:
+    return 3;
+  case BlockCompressor::FORMAT_BC4:
+  case BlockCompressor::FORMAT_R8:
+    return 1;
+  case BlockCompressor::FORMAT_BC5:
+  case BlockCompressor::FORMAT_RG8:
+    return 2;
+  default:
+    return 4;
+  }
+}
+
+void loadBlock(const uint8_t *pixels, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, Block &block) {
+  for (uint32_t y = 0; y < 4; y++) {
+    // Blocks hanging over the edge repeat the last row and column, those pixels are never sampled.
+    const uint32_t row = std::min(blockY * 4 + y, height - 1);
+    for (uint32_t x = 0; x < 4; x++) {
+      const uint8_t *pixel = pixels + (static_cast<size_t>(row) * width + std::min(blockX * 4 + x, width - 1)) * 4;
+      for (int channel = 0; channel < 4; channel++) {
+        block.channels[channel][y * 4 + x] = pixel[channel];
+      }
+    }
+  }
+}
+
+// Picks the closest palette color for every pixel over the first count channels,
+// returns the summed squared error of the picks.
+float selectIndices(const Block &block, int first, int count, const Palette &palette, uint8_t indices[16]) {
+#ifdef AGNOSIA_BLOCKS_SSE
+  __m128 total = _mm_setzero_ps();
+  for (int group = 0; group < 16; group += 4) {
+    __m128 best = _mm_set1_ps(FLT_MAX);
+    __m128i bestIndex = _mm_setzero_si128();
+    for (int entry = 0; entry < palette.size; entry++) {
+      __m128 error = _mm_setzero_ps();
+      for (int channel = first; channel < first + count; channel++) {
+        const __m128 difference = _mm_sub_ps(_mm_load_ps(&block.channels[channel][group]), _mm_set1_ps(palette.colors[entry][channel]));
+        error = _mm_add_ps(error, _mm_mul_ps(difference, difference));
+      }
+      // Strictly closer only, so ties go to the lower index like the scalar version.
+      const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(error, best));
+      best = _mm_min_ps(error, best);
+      bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(entry)), _mm_andnot_si128(closer, bestIndex));
+    }
+    total = _mm_add_ps(total, best);
+    alignas(16) int32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), bestIndex);
+    for (int lane = 0; lane < 4; lane++) {
+      indices[group + lane] = static_cast<uint8_t>(lanes[lane]);
+    }
+  }
+  alignas(16) float sums[4];
+  _mm_store_ps(sums, total);
+  return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+  float total = 0.0f;
+  for (int pixel = 0; pixel < 16; pixel++) {
+    float best = FLT_MAX;
+    for (int entry = 0; entry < palette.size; entry++) {
+      float error = 0.0f;
+      for (int channel = first; channel < first + count; channel++) {
+        const float difference = block.channels[channel][pixel] - palette.colors[entry][channel];
+        error += difference * difference;
+      }
+      if (error < best) {
+        best = error;
+        indices[pixel] = static_cast<uint8_t>(entry);
+      }
+    }
+    total += best;
+  }
+  return total;
+#endif
+}
+
+// The line through the block's colors they spread out along the most, the
+// principal axis of their covariance, cut off where the colors end.
+void fitLine(const Block &block, int first, int count, float start[4], float end[4]) {
+  float mean[4] = {};
+  for (int channel = first; channel < first + count; channel++) {
+    for (int pixel = 0; pixel < 16; pixel++) {
+      mean[channel] += block.channels[channel][pixel];
+    }
+    mean[channel] /= 16.0f;
+  }
+  float covariance[4][4] = {};
+  for (int pixel = 0; pixel < 16; pixel++) {
+    for (int i = first; i < first + count; i++) {
+      for (int j = first; j < first + count; j++) {
+        covariance[i][j] += (block.channels[i][pixel] - mean[i]) * (block.channels[j][pixel] - mean[j]);
+      }
+    }
+  }
+
+  // Power iteration, starting from the row of the widest channel it settles in a few steps.
+  int widest = first;
+  for (int channel = first; channel < first + count; channel++) {
+    if (covariance[channel][channel] > covariance[widest][widest]) {
+      widest = channel;
+    }
+  }
+  float axis[4] = {};
+  for (int channel = first; channel < first + count; channel++) {
+    axis[channel] = covariance[widest][channel];
+  }
+  for (int iteration = 0; iteration < 8; iteration++) {
+    float next[4] = {};
+    float largest = 0.0f;
+    for (int i = first; i < first + count; i++) {
+      for (int j = first; j < first + count; j++) {
+        next[i] += covariance[i][j] * axis[j];
+      }
+      largest = std::max(largest, std::abs(next[i]));
+    }
+    if (largest == 0.0f) {
+      break;
+    }
+    for (int channel = first; channel < first + count; channel++) {
+      axis[channel] = next[channel] / largest;
+    }
+  }
+  float length = 0.0f;
+  for (int channel = first; channel < first + count; channel++) {
+    length += axis[channel] * axis[channel];
+  }
+  length = std::sqrt(length);
+  if (length < 1e-6f) {
+    // A flat block, both endpoints on its one color.
+    std::copy(mean, mean + 4, start);
+    std::copy(mean, mean + 4, end);
+    return;
+  }
+
+  float lowest = FLT_MAX, highest = -FLT_MAX;
+  for (int pixel = 0; pixel < 16; pixel++) {
+    float projection = 0.0f;
+    for (int channel = first; channel < first + count; channel++) {
+      projection += (block.channels[channel][pixel] - mean[channel]) * axis[channel] / length;
+    }
+    lowest = std::min(lowest, projection);
+    highest = std::max(highest, projection);
+  }
+  for (int channel = first; channel < first + count; channel++) {
+    start[channel] = std::clamp(mean[channel] + axis[channel] / length * lowest, 0.0f, 255.0f);
+    end[channel] = std::clamp(mean[channel] + axis[channel] / length * highest, 0.0f, 255.0f);
+  }
+}
+
+// Least squares endpoints for the indices already picked, weights[i] is how far
+// index i sits along the way from start to end.
+void refineLine(const Block &block, int first, int count, const uint8_t indices[16], const float *weights, float start[4], float end[4]) {
+  float startStart = 0.0f, startEnd = 0.0f, endEnd = 0.0f;
+  float startSum[4] = {}, endSum[4] = {};
+  for (int pixel = 0; pixel < 16; pixel++) {
+    const float toEnd = weights[indices[pixel]];
+    const float toStart = 1.0f - toEnd;
+    startStart += toStart * toStart;
+    startEnd += toStart * toEnd;
+    endEnd += toEnd * toEnd;
+    for (int channel = first; channel < first + count; channel++) {
+      startSum[channel] += toStart * block.channels[channel][pixel];
+      endSum[channel] += toEnd * block.channels[channel][pixel];
+    }
+  }
+  const float determinant = startStart * endEnd - startEnd * startEnd;
+  if (determinant < 1e-6f) {
+    // Every pixel on the same index, there is nothing to solve for.
+    return;
+  }
+  for (int channel = first; channel < first + count; channel++) {
+    start[channel] = std::clamp((endEnd * startSum[channel] - startEnd * endSum[channel]) / determinant, 0.0f, 255.0f);
+    end[channel] = std::clamp((startStart * endSum[channel] - startEnd * startSum[channel]) / determinant, 0.0f, 255.0f);
+  }
+}
+
+uint16_t packColor565(const float color[4]) {
+  const uint32_t red = static_cast<uint32_t>(std::lround(color[0] * 31.0f / 255.0f));
+  const uint32_t green = static_cast<uint32_t>(std::lround(color[1] * 63.0f / 255.0f));
+  const uint32_t blue = static_cast<uint32_t>(std::lround(color[2] * 31.0f / 255.0f));
+  return static_cast<uint16_t>(red << 11 | green << 5 | blue);
+}
+void unpackColor565(uint16_t packed, int color[3]) {
+  const int red = packed >> 11, green = (packed >> 5) & 63, blue = packed & 31;
+  color[0] = red << 3 | red >> 2;
+  color[1] = green << 2 | green >> 4;
+  color[2] = blue << 3 | blue >> 2;
+}
+// The two colors between the endpoints of a 4 color BC1 block.
+int bc1Third(int near, int far) { return (2 * near + far + 1) / 3; }
+
+void encodeBC1(const Block &block, uint8_t *out) {
+  float start[4] = {}, end[4] = {};
+  fitLine(block, 0, 3, start, end);
+  // Index 0 is color0, 1 is color1 and 2, 3 the thirds in between.
+  const float weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+  float bestError = FLT_MAX;
+  uint16_t bestColors[2] = {};
+  uint8_t bestIndices[16] = {};
+  for (int pass = 0; pass <= REFINE_PASSES; pass++) {
+    uint16_t color0 = packColor565(start);
+    uint16_t color1 = packColor565(end);
+    // color0 > color1 is what selects 4 colors, the other order trades one for transparent black.
+    if (color0 < color1) {
+      std::swap(color0, color1);
+      std::swap_ranges(start, start + 4, end);
+    }
+    if (color0 == color1) {
+      if (color1 > 0) {
+        color1--;
+      } else {
+        color0++;
+      }
+    }
+    int expanded0[3], expanded1[3];
+    unpackColor565(color0, expanded0);
+    unpackColor565(color1, expanded1);
+    Palette palette = {.colors = {}, .size = 4};
+    for (int channel = 0; channel < 3; channel++) {
+      palette.colors[0][channel] = static_cast<float>(expanded0[channel]);
+      palette.colors[1][channel] = static_cast<float>(expanded1[channel]);
+      palette.colors[2][channel] = static_cast<float>(bc1Third(expanded0[channel], expanded1[channel]));
+      palette.colors[3][channel] = static_cast<float>(bc1Third(expanded1[channel], expanded0[channel]));
+    }
+    uint8_t indices[16];
+    const float error = selectIndices(block, 0, 3, palette, indices);
+    if (error < bestError) {
+      bestError = error;
+      bestColors[0] = color0;
+      bestColors[1] = color1;
+      std::copy(indices, indices + 16, bestIndices);
+    }
+    if (error == 0.0f) {
+      break;
+    }
+    refineLine(block, 0, 3, indices, weights, start, end);
+  }
+
+  uint32_t indexBits = 0;
+  for (int pixel = 0; pixel < 16; pixel++) {
+    indexBits |= static_cast<uint32_t>(bestIndices[pixel]) << (pixel * 2);
+  }
+  memcpy(out, bestColors, sizeof(bestColors));
+  memcpy(out + 4, &indexBits, sizeof(indexBits));
+}
+
+// The value of every BC4 index, rounded to 8 bits.
+void bc4Palette(int red0, int red1, int values[8]) {
+  values[0] = red0;
+  values[1] = red1;
+  if (red0 > red1) {
+    for (int i = 2; i < 8; i++) {
+      values[i] = ((8 - i) * red0 + (i - 1) * red1 + 3) / 7;
+    }
+  } else {
+    for (int i = 2; i < 6; i++) {
+      values[i] = ((6 - i) * red0 + (i - 1) * red1 + 2) / 5;
+    }
+    values[6] = 0;
+    values[7] = 255;
+  }
+}
+
+void encodeBC4(const Block &block, int channel, uint8_t *out) {
+  float lowest = 255.0f, highest = 0.0f;
+  for (int pixel = 0; pixel < 16; pixel++) {
+    lowest = std::min(lowest, block.channels[channel][pixel]);
+    highest = std::max(highest, block.channels[channel][pixel]);
+  }
+  // red0 > red1 gets 8 evenly spaced levels, the other order 6 plus 0 and 255.
+  // Equal endpoints mean a flat block where index 0 alone is exact.
+  const int red0 = static_cast<int>(std::lround(highest));
+  const int red1 = static_cast<int>(std::lround(lowest));
+  uint8_t indices[16] = {};
+  if (red0 > red1) {
+    int values[8];
+    bc4Palette(red0, red1, values);
+    Palette palette = {.colors = {}, .size = 8};
+    for (int i = 0; i < 8; i++) {
+      palette.colors[i][channel] = static_cast<float>(values[i]);
+    }
+    selectIndices(block, channel, 1, palette, indices);
+  }
+
+  uint64_t indexBits = 0;
+  for (int pixel = 0; pixel < 16; pixel++) {
+    indexBits |= static_cast<uint64_t>(indices[pixel]) << (pixel * 3);
+  }
+  out[0] = static_cast<uint8_t>(red0);
+  out[1] = static_cast<uint8_t>(red1);
+  for (int byte = 0; byte < 6; byte++) {
+    out[2 + byte] = static_cast<uint8_t>(indexBits >> (byte * 8));
+  }
+}
+
+// Rounds an endpoint to 7 bits a channel plus the low bit they share, trying both values of that bit.
+void quantizeBC7Endpoint(const float color[4], uint32_t quantized[4], uint32_t &pBit) {
+  float bestError = FLT_MAX;
+  for (uint32_t bit = 0; bit < 2; bit++) {
+    uint32_t candidate[4];
+    float error = 0.0f;
+    for (int channel = 0; channel < 4; channel++) {
+      candidate[channel] = static_cast<uint32_t>(std::clamp(std::lround((color[channel] - bit) * 0.5f), 0L, 127L));
+      const float difference = static_cast<float>(candidate[channel] * 2 + bit) - color[channel];
+      error += difference * difference;
+    }
+    if (error < bestError) {
+      bestError = error;
+      std::copy(candidate, candidate + 4, quantized);
+      pBit = bit;
+    }
+  }
+}
+
+void encodeBC7(const Block &block, uint8_t *out) {
+  float start[4], end[4];
+  fitLine(block, 0, 4, start, end);
+  float weights[16];
+  for (int i = 0; i < 16; i++) {
+    weights[i] = BC7_WEIGHTS[i] / 64.0f;
+  }
+
+  float bestError = FLT_MAX;
+  uint32_t bestEndpoints[2][4] = {};
+  uint32_t bestBits[2] = {};
+  uint8_t bestIndices[16] = {};
+  for (int pass = 0; pass <= REFINE_PASSES; pass++) {
+    uint32_t endpoints[2][4], bits[2];
+    quantizeBC7Endpoint(start, endpoints[0], bits[0]);
+    quantizeBC7Endpoint(end, endpoints[1], bits[1]);
+    Palette palette = {.colors = {}, .size = 16};
+    for (int channel = 0; channel < 4; channel++) {
+      const int value0 = static_cast<int>(endpoints[0][channel] * 2 + bits[0]);
+      const int value1 = static_cast<int>(endpoints[1][channel] * 2 + bits[1]);
+      for (int i = 0; i < 16; i++) {
+        palette.colors[i][channel] = static_cast<float>(((64 - BC7_WEIGHTS[i]) * value0 + BC7_WEIGHTS[i] * value1 + 32) >> 6);
+      }
+    }
+    uint8_t indices[16];
+    const float error = selectIndices(block, 0, 4, palette, indices);
+    if (error < bestError) {
+      bestError = error;
+      std::copy(&endpoints[0][0], &endpoints[0][0] + 8, &bestEndpoints[0][0]);
+      std::copy(bits, bits + 2, bestBits);
+      std::copy(indices, indices + 16, bestIndices);
+    }
+    if (error == 0.0f) {
+      break;
+    }
+    refineLine(block, 0, 4, indices, weights, start, end);
+  }
+
+  // The first pixel's index is stored without its top bit, which has to be 0.
+  // The weights are symmetric, swapping the endpoints and mirroring every index
+  // gives the same colors.
+  if (bestIndices[0] >= 8) {
+    std::swap_ranges(bestEndpoints[0], bestEndpoints[0] + 4, bestEndpoints[1]);
+    std::swap(bestBits[0], bestBits[1]);
+    for (uint8_t &index : bestIndices) {
+      index = static_cast<uint8_t>(15 - index);
+    }
+  }
+
+  memset(out, 0, 16);
+  BitWriter writer = {.out = out};
+  // Mode 6 is a 1 after six 0 bits.
+  writer.write(1 << 6, 7);
+  for (int channel = 0; channel < 4; channel++) {
+    writer.write(bestEndpoints[0][channel], 7);
+    writer.write(bestEndpoints[1][channel], 7);
+  }
+  writer.write(bestBits[0], 1);
+  writer.write(bestBits[1], 1);
+  writer.write(bestIndices[0], 3);
+  for (int pixel = 1; pixel < 16; pixel++) {
+    writer.write(bestIndices[pixel], 4);
+  }
+}
+
+// Decodes one block into 16 RGBA pixels, row by row.
+void decodeBlock(const uint8_t *in, BlockCompressor::Format format, uint8_t pixels[16][4]) {
+  switch (format) {
+  case BlockCompressor::FORMAT_BC1: {
+    uint16_t color0, color1;
+    uint32_t indexBits;
+    memcpy(&color0, in, 2);
+    memcpy(&color1, in + 2, 2);
+    memcpy(&indexBits, in + 4, 4);
+    int colors[4][4];
+    unpackColor565(color0, colors[0]);
+    unpackColor565(color1, colors[1]);
+    colors[0][3] = colors[1][3] = colors[2][3] = 255;
+    for (int channel = 0; channel < 3; channel++) {
+      if (color0 > color1) {
+        colors[2][channel] = bc1Third(colors[0][channel], colors[1][channel]);
+        colors[3][channel] = bc1Third(colors[1][channel], colors[0][channel]);
+      } else {
+        colors[2][channel] = (colors[0][channel] + colors[1][channel]) / 2;
+        colors[3][channel] = 0;
+      }
+    }
+    colors[3][3] = color0 > color1 ? 255 : 0;
+    for (int pixel = 0; pixel < 16; pixel++) {
+      const int index = (indexBits >> (pixel * 2)) & 3;
+      for (int channel = 0; channel < 4; channel++) {
+        pixels[pixel][channel] = static_cast<uint8_t>(colors[index][channel]);
+      }
+    }
+    break;
+  }
+  case BlockCompressor::FORMAT_BC4:
+  case BlockCompressor::FORMAT_BC5: {
+    const int channels = format == BlockCompressor::FORMAT_BC5 ? 2 : 1;
+    for (int pixel = 0; pixel < 16; pixel++) {
+      pixels[pixel][1] = pixels[pixel][2] = 0;
+      pixels[pixel][3] = 255;
+    }
+    for (int channel = 0; channel < channels; channel++) {
+      const uint8_t *half = in + channel * 8;
+      int values[8];
+      bc4Palette(half[0], half[1], values);
+      uint64_t indexBits = 0;
+      for (int byte = 0; byte < 6; byte++) {
+        indexBits |= static_cast<uint64_t>(half[2 + byte]) << (byte * 8);
+      }
+      for (int pixel = 0; pixel < 16; pixel++) {
+        pixels[pixel][channel] = static_cast<uint8_t>(values[(indexBits >> (pixel * 3)) & 7]);
+      }
+    }
+    break;
+  }
+  case BlockCompressor::FORMAT_BC7: {
+    BitReader reader = {.in = in};
+    if (reader.read(7) != 1 << 6) {
+      // Not a mode we write, leave it black.
+      memset(pixels, 0, 16 * 4);
+      break;
+    }
+    int endpoints[2][4];
+    for (int channel = 0; channel < 4; channel++) {
+      endpoints[0][channel] = static_cast<int>(reader.read(7)) << 1;
+      endpoints[1][channel] = static_cast<int>(reader.read(7)) << 1;
+    }
+    const int bit0 = static_cast<int>(reader.read(1));
+    const int bit1 = static_cast<int>(reader.read(1));
+    for (int channel = 0; channel < 4; channel++) {
+      endpoints[0][channel] |= bit0;
+      endpoints[1][channel] |= bit1;
+    }
+    for (int pixel = 0; pixel < 16; pixel++) {
+      const int weight = BC7_WEIGHTS[reader.read(pixel == 0 ? 3 : 4)];
+      for (int channel = 0; channel < 4; channel++) {
+        pixels[pixel][channel] = static_cast<uint8_t>(((64 - weight) * endpoints[0][channel] + weight * endpoints[1][channel] + 32) >> 6);
+      }
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+bool BlockCompressor::isCompressed(Format format) {
+  return format != FORMAT_RGBA8 && format != FORMAT_R8 && format != FORMAT_RG8;
+}
+uint32_t BlockCompressor::getBlockBytes(Format format) {
+  switch (format) {
+  case FORMAT_BC1:
+  case FORMAT_BC4:
+    return 8;
+  case FORMAT_BC5:
+  case FORMAT_BC7:
+    return 16;
+  default:
+    return static_cast<uint32_t>(getChannelCount(format));
+  }
+}
+size_t BlockCompressor::getLevelSize(uint32_t width, uint32_t height, Format format) {
+  if (!isCompressed(format)) {
+    return static_cast<size_t>(width) * height * getBlockBytes(format);
+  }
+  return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+}
+size_t BlockCompressor::getLevelOffset(uint32_t width, uint32_t height, uint32_t level, Format format) {
+  size_t offset = 0;
+  for (uint32_t i = 0; i < level; i++) {
+    offset += getLevelSize(MipGenerator::getLevelSize(width, i), MipGenerator::getLevelSize(height, i), format);
+  }
+  return offset;
+}
+size_t BlockCompressor::getChainSize(uint32_t width, uint32_t height, Format format) {
+  return getLevelOffset(width, height, MipGenerator::getLevelCount(width, height), format);
+}
+
+void BlockCompressor::compress(const uint8_t *pixels, uint32_t width, uint32_t height, Format format, uint8_t *blocks) {
+  if (format == FORMAT_RGBA8) {
+    memcpy(blocks, pixels, getLevelSize(width, height, format));
+    return;
+  }
+  if (!isCompressed(format)) {
+    const int channels = getChannelCount(format);
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    for (size_t pixel = 0; pixel < pixelCount; pixel++) {
+      memcpy(blocks + pixel * channels, pixels + pixel * 4, channels);
+    }
+    return;
+  }
+  const uint32_t blocksWide = (width + 3) / 4;
+  const uint32_t blocksHigh = (height + 3) / 4;
+  const uint32_t blockBytes = getBlockBytes(format);
+  const uint32_t jobCount = (blocksHigh + BLOCK_ROWS_PER_JOB - 1) / BLOCK_ROWS_PER_JOB;
+  ThreadPool::get().parallelFor(jobCount, [&](size_t job) {
+    const uint32_t firstRow = static_cast<uint32_t>(job) * BLOCK_ROWS_PER_JOB;
+    const uint32_t lastRow = std::min(firstRow + BLOCK_ROWS_PER_JOB, blocksHigh);
+    Block block;
+    for (uint32_t blockY = firstRow; blockY < lastRow; blockY++) {
+      for (uint32_t blockX = 0; blockX < blocksWide; blockX++) {
+        loadBlock(pixels, width, height, blockX, blockY, block);
+        uint8_t *out = blocks + (static_cast<size_t>(blockY) * blocksWide + blockX) * blockBytes;
+        switch (format) {
+        case FORMAT_BC1:
+          encodeBC1(block, out);
+          break;
+        case FORMAT_BC4:
+          encodeBC4(block, 0, out);
+          break;
+        case FORMAT_BC5:
+          encodeBC4(block, 0, out);
+          encodeBC4(block, 1, out + 8);
+          break;
+        case FORMAT_BC7:
+          encodeBC7(block, out);
+          break;
+        default:
+          break;
+        }
+      }
+    }
+  });
+}
+
+void BlockCompressor::compressChain(const uint8_t *chain, uint32_t width, uint32_t height, Format format, uint8_t *blocks) {
+  const uint32_t levelCount = MipGenerator::getLevelCount(width, height);
+  for (uint32_t level = 0; level < levelCount; level++) {
+    compress(chain + MipGenerator::getLevelOffset(width, height, level),
+             MipGenerator::getLevelSize(width, level), MipGenerator::getLevelSize(height, level), format,
+             blocks + getLevelOffset(width, height, level, format));
+  }
+}
+
+void BlockCompressor::decompress(const uint8_t *blocks, uint32_t width, uint32_t height, Format format, uint8_t *pixels) {
+  if (format == FORMAT_RGBA8) {
+    memcpy(pixels, blocks, getLevelSize(width, height, format));
+    return;
+  }
+  if (!isCompressed(format)) {
+    const int channels = getChannelCount(format);
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    for (size_t pixel = 0; pixel < pixelCount; pixel++) {
+      const uint8_t expanded[4] = {blocks[pixel * channels], channels > 1 ? blocks[pixel * channels + 1] : uint8_t(0), 0, 255};
+      memcpy(pixels + pixel * 4, expanded, 4);
+    }
+    return;
+  }
+  const uint32_t blocksWide = (width + 3) / 4;
+  const uint32_t blocksHigh = (height + 3) / 4;
+  const uint32_t blockBytes = getBlockBytes(format);
+  for (uint32_t blockY = 0; blockY < blocksHigh; blockY++) {
+    for (uint32_t blockX = 0; blockX < blocksWide; blockX++) {
+      uint8_t decoded[16][4];
+      decodeBlock(blocks + (static_cast<size_t>(blockY) * blocksWide + blockX) * blockBytes, format, decoded);
+      for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++) {
+        for (uint32_t x = 0; x < 4 && blockX * 4 + x < width; x++) {
+          memcpy(pixels + ((static_cast<size_t>(blockY) * 4 + y) * width + blockX * 4 + x) * 4, decoded[y * 4 + x], 4);
+        }
+      }
+    }
+  }
+}
+
+double BlockCompressor::psnr(const uint8_t *original, const uint8_t *decoded, uint32_t width, uint32_t height, Format format) {
+  const int channels = getChannelCount(format);
+  double squaredError = 0.0;
+  for (size_t pixel = 0; pixel < static_cast<size_t>(width) * height; pixel++) {
+    for (int channel = 0; channel < channels; channel++) {
+      const double difference = double(original[pixel * 4 + channel]) - double(decoded[pixel * 4 + channel]);
+      squaredError += difference * difference;
+    }
+  }
+  const double meanSquaredError = squaredError / (double(width) * height * channels);
+  if (meanSquaredError == 0.0) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Encodes RGBA8 images into the BCn block formats GPUs sample natively, every
+// 4x4 pixels become one 8 or 16 byte block. Blocks don't depend on each other,
+// so rows of them are spread over the thread pool and each block is fit with SSE.
+class BlockCompressor {
+public:
+  enum Format : uint32_t {
+    // Uncompressed, 4 bytes a pixel. Lets a chain be handled the same way either way.
+    FORMAT_RGBA8,
+    // RGB at half a byte a pixel, two 565 endpoints and 4 colors per block. Opaque color.
+    FORMAT_BC1,
+    // The red channel at half a byte a pixel, 8 levels between two endpoints. Masks and PBR maps.
+    FORMAT_BC4,
+    // Red and green as two BC4 blocks, a byte a pixel. Normal maps and packed pairs.
+    FORMAT_BC5,
+    // RGBA at a byte a pixel. Only mode 6 is written, a single RGBA line with 16 steps per block.
+    FORMAT_BC7,
+    // Uncompressed red, a byte a pixel, and red and green, two. What BC4 and
+    // BC5 fall back to, a quarter and half of RGBA8.
+    FORMAT_R8,
+    FORMAT_RG8,
+  };
+
+  // False for the plain per pixel formats.
+  static bool isCompressed(Format format);
+  // Bytes of a 4x4 block, or of one pixel for the uncompressed formats.
+  static uint32_t getBlockBytes(Format format);
+  static size_t getLevelSize(uint32_t width, uint32_t height, Format format);
+  // Levels are packed one after the other like MipGenerator's, level 0 first.
+  static size_t getLevelOffset(uint32_t width, uint32_t height, uint32_t level, Format format);
+  static size_t getChainSize(uint32_t width, uint32_t height, Format format);
+
+  // Encodes a width x height RGBA8 image into getLevelSize bytes of blocks. The
+  // uncompressed formats just keep their channels.
+  static void compress(const uint8_t *pixels, uint32_t width, uint32_t height, Format format, uint8_t *blocks);
+  // Encodes every level of a MipGenerator chain, blocks gets getChainSize bytes.
+  static void compressChain(const uint8_t *chain, uint32_t width, uint32_t height, Format format, uint8_t *blocks);
+  // Back to RGBA8 the way the GPU samples it, to measure what the encoding lost.
+  // Channels the format lacks come back as 0 and alpha as 255. Only decodes the
+  // BC7 mode compress writes.
+  static void decompress(const uint8_t *blocks, uint32_t width, uint32_t height, Format format, uint8_t *pixels);
+  // Peak signal to noise ratio in dB over the channels the format keeps, infinite for an exact match.
+  static double psnr(const uint8_t *original, const uint8_t *decoded, uint32_t width, uint32_t height, Format format);
+};
@@ -2,10 +2,12 @@
 #include "../utils/helpers.h"
 #include "buffers.h"
 #include "model.h"
+#include <algorithm>
 #include <cstdint>
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <stdexcept>
+#include <unordered_map>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 #include "../utils/deletion.h"
@@ -18,6 +20,7 @@ uint32_t indicesSize;
 constexpr int STORAGE_BINDING = 0;
 constexpr int IMAGE_BINDING = 1;
 constexpr int SAMPLER_BINDING = 2;
+constexpr int STORAGE_IMAGE_BINDING = 3;
 
 // Max count of each descriptor type
 // You can query the max values for these with
@@ -25,6 +28,8 @@ constexpr int SAMPLER_BINDING = 2;
 constexpr int STORAGE_COUNT = 65536;
 constexpr int SAMPLER_COUNT = 65536;
 constexpr int IMAGE_COUNT = 65536;
+// Only MipDownsampler writes to images, one level each, 16 levels is a 32768 texture.
+constexpr int STORAGE_IMAGE_COUNT = 64;
 
 // Create descriptor pool
 VkDescriptorPool descriptorPool;
@@ -39,9 +44,13 @@ VkDescriptorSet samplerDescriptorSet;
 VkCommandPool commandPool;
 std::vector<VkCommandBuffer> commandBuffers;
 
+bool materialDescriptorsDirty = false;
+
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
 VmaAllocator allocator;
+bool hostVisibleVram = false;
+bool directWrite = true;
 
 void Buffers::createMemoryAllocator(VkInstance vkInstance) {
   VmaVulkanFunctions vulkanFuncs = {
@@ -59,6 +68,24 @@ void Buffers::createMemoryAllocator(VkInstance vkInstance) {
   };
   vmaCreateAllocator(&allocInfo, &allocator);
   DeletionQueue::get().push_function([=](){vmaDestroyAllocator(allocator);});
+
+  // Without ReBAR the host visible part of VRAM is a 256 MB window, geometry
+  // written straight into it would crowd out the per frame buffers.
+  const VkPhysicalDeviceMemoryProperties *memProperties;
+  vmaGetMemoryProperties(allocator, &memProperties);
+  VkDeviceSize largestHeap = 0;
+  for (uint32_t heap = 0; heap < memProperties->memoryHeapCount; heap++) {
+    if (memProperties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      largestHeap = std::max(largestHeap, memProperties->memoryHeaps[heap].size);
+    }
+  }
+  for (uint32_t type = 0; type < memProperties->memoryTypeCount; type++) {
+    const VkMemoryType &memoryType = memProperties->memoryTypes[type];
+    const VkMemoryPropertyFlags vramFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    if ((memoryType.propertyFlags & vramFlags) == vramFlags && memProperties->memoryHeaps[memoryType.heapIndex].size == largestHeap) {
+      hostVisibleVram = true;
+    }
+  }
 }
 
 void Buffers::createDescriptorSetLayout() {
@@ -88,17 +115,26 @@ void Buffers::createDescriptorSetLayout() {
       .pImmutableSamplers = nullptr,
   };
 
+  VkDescriptorSetLayoutBinding storageImageLayoutBinding = {
+      .binding = STORAGE_IMAGE_BINDING,
+      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .descriptorCount = STORAGE_IMAGE_COUNT,
+      .stageFlags = VK_SHADER_STAGE_ALL,
+      .pImmutableSamplers = nullptr,
+  };
+
   std::vector<VkDescriptorSetLayoutBinding> bindings = {
-      storageLayoutBinding, imageLayoutBinding, samplerLayoutBinding};
+      storageLayoutBinding, imageLayoutBinding, samplerLayoutBinding, storageImageLayoutBinding};
 
   std::vector<VkDescriptorBindingFlags> bindingFlags = {
       VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
       VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
       VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
   };
   VkDescriptorSetLayoutBindingFlagsCreateInfo setLayoutBindingsFlags = {
       .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
-      .bindingCount = 3,
+      .bindingCount = static_cast<uint32_t>(bindingFlags.size()),
       .pBindingFlags = bindingFlags.data(),
   };
 
@@ -124,6 +160,8 @@ void Buffers::createDescriptorPool() {
       {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, STORAGE_COUNT},
       {VK_DESCRIPTOR_TYPE_SAMPLER, SAMPLER_COUNT},
       {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, IMAGE_COUNT},
+      // Both sets are allocated with the same layout.
+      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 * STORAGE_IMAGE_COUNT},
   };
   VkDescriptorPoolCreateInfo poolInfo = {
     .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
@@ -154,29 +192,7 @@ void Buffers::createDescriptorSet(std::vector<Model *> models) {
   };
   VK_CHECK(vkAllocateDescriptorSets(DeviceControl::getDevice(), &samplerAllocInfo, &samplerDescriptorSet));
   
-  for(int model = 0; model < models.size(); model++) {
-    // Textures for each model
-    VkDescriptorImageInfo modelTexInfo[4];
-    for(int i = 0; i < 4; i++) {
-      modelTexInfo[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    }
-    
-    modelTexInfo[0].imageView = models[model]->getMaterial().getDiffuseTexture()->getImageView();
-    modelTexInfo[1].imageView = models[model]->getMaterial().getMetallicTexture()->getImageView();
-    modelTexInfo[2].imageView = models[model]->getMaterial().getAOTexture()->getImageView();
-    modelTexInfo[3].imageView = models[model]->getMaterial().getRoughnessTexture()->getImageView();
-
-    VkWriteDescriptorSet modelTexWriter = {
-      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-      .dstSet = texturesSets,
-      .dstBinding = IMAGE_BINDING,
-      .dstArrayElement = static_cast<uint32_t>(4*(model+1)),
-      .descriptorCount = 4,
-      .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
-      .pImageInfo = modelTexInfo,
-    };
-    vkUpdateDescriptorSets(DeviceControl::getDevice(), 1, &modelTexWriter, 0, nullptr);
-  }  
+  writeMaterialDescriptors(models);
 
   // Now we create the one sampler we are going to use right now.
   VkPhysicalDeviceProperties properties{};
@@ -221,6 +237,68 @@ void Buffers::createDescriptorSet(std::vector<Model *> models) {
   vkUpdateDescriptorSets(DeviceControl::getDevice(), 1, &samplerWriteSet, 0, nullptr);
 }
 
+void Buffers::writeMaterialDescriptors(const std::vector<Model *> &models) {
+  // Textures for each material, written once no matter how many models share it.
+  std::unordered_map<std::string, uint32_t> materialSlots;
+  for(Model *model : models) {
+    Material &material = model->getMaterial();
+    auto slot = materialSlots.find(material.getID());
+    if(slot != materialSlots.end()) {
+      material.setTextureSlot(slot->second);
+      continue;
+    }
+    const uint32_t textureSlot = 4*(materialSlots.size()+1);
+    materialSlots.emplace(material.getID(), textureSlot);
+    material.setTextureSlot(textureSlot);
+
+    VkDescriptorImageInfo modelTexInfo[4];
+    for(int i = 0; i < 4; i++) {
+      modelTexInfo[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+    
+    // Packed materials only fill the first two of their four slots.
+    uint32_t textureCount = 4;
+    modelTexInfo[0].imageView = material.getDiffuseTexture()->getImageView();
+    if(material.getMode() == Material::MODE_PACKED) {
+      modelTexInfo[1].imageView = material.getPackedTexture()->getImageView();
+      textureCount = 2;
+    } else {
+      modelTexInfo[1].imageView = material.getMetallicTexture()->getImageView();
+      modelTexInfo[2].imageView = material.getAOTexture()->getImageView();
+      modelTexInfo[3].imageView = material.getRoughnessTexture()->getImageView();
+    }
+
+    VkWriteDescriptorSet modelTexWriter = {
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet = texturesSets,
+      .dstBinding = IMAGE_BINDING,
+      .dstArrayElement = textureSlot,
+      .descriptorCount = textureCount,
+      .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+      .pImageInfo = modelTexInfo,
+    };
+    vkUpdateDescriptorSets(DeviceControl::getDevice(), 1, &modelTexWriter, 0, nullptr);
+  }
+}
+void Buffers::writeStorageImages(uint32_t firstSlot, const std::vector<VkImageView> &views) {
+  std::vector<VkDescriptorImageInfo> imageInfos(views.size());
+  for(size_t i = 0; i < views.size(); i++) {
+    imageInfos[i] = {
+      .imageView = views[i],
+      .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+  }
+  VkWriteDescriptorSet storageWriter = {
+    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+    .dstSet = texturesSets,
+    .dstBinding = STORAGE_IMAGE_BINDING,
+    .dstArrayElement = firstSlot,
+    .descriptorCount = static_cast<uint32_t>(imageInfos.size()),
+    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    .pImageInfo = imageInfos.data(),
+  };
+  vkUpdateDescriptorSets(DeviceControl::getDevice(), 1, &storageWriter, 0, nullptr);
+}
 uint32_t Buffers::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
   // Graphics cards offer different types of memory to allocate from, here we
   // query to find the right type of memory for our needs. Query the available
@@ -237,40 +315,6 @@ uint32_t Buffers::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags prop
   throw std::runtime_error("Failed to find suitable memory type!");
 }
 
-void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-  VkCommandBufferAllocateInfo allocInfo = {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-    .commandPool = commandPool,
-    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-    .commandBufferCount = 1,
-  };
-  
-  VkCommandBuffer commandBuffer;
-  vkAllocateCommandBuffers(DeviceControl::getDevice(), &allocInfo, &commandBuffer);
-
-  VkCommandBufferBeginInfo beginInfo = {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-  };
-  vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-  VkBufferCopy copyRegion = {
-    .size = size,
-  };
-  vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-  vkEndCommandBuffer(commandBuffer);
-
-  VkSubmitInfo submitInfo = {
-    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-    .commandBufferCount = 1,
-    .pCommandBuffers = &commandBuffer,
-  };
-  vkQueueSubmit(DeviceControl::getGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(DeviceControl::getGraphicsQueue());
-  vkFreeCommandBuffers(DeviceControl::getDevice(), commandPool, 1, &commandBuffer);
-}
-
 Agnosia_T::AllocatedBuffer Buffers::createBuffer(size_t allocSize, VmaAllocationCreateFlags vmaFlags, VkBufferUsageFlags usageFlags, VmaMemoryUsage memUsage) {
   // Allocate a VMA Buffer and return it back.
   VkBufferCreateInfo bufferInfo = {
@@ -289,14 +333,62 @@ Agnosia_T::AllocatedBuffer Buffers::createBuffer(size_t allocSize, VmaAllocation
   return buffer;
 }
 
+Agnosia_T::AllocatedBuffer Buffers::createBuffer(size_t allocSize, VkBufferUsageFlags usageFlags, Intent intent) {
+  switch (intent) {
+  case INTENT_STATIC:
+    if (directWrite && hostVisibleVram) {
+      // VMA still falls back to plain device local memory if the mapped kind
+      // runs out, the caller stages then.
+      return createBuffer(allocSize,
+                          VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT |
+                              VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                          usageFlags | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    }
+    return createBuffer(allocSize, 0, usageFlags | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+  case INTENT_DYNAMIC:
+    // Not a transfer source, so VMA picks the BAR over system memory when it can.
+    return createBuffer(allocSize, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                        usageFlags, VMA_MEMORY_USAGE_AUTO);
+  case INTENT_STAGING:
+    return createBuffer(allocSize, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                        usageFlags | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_HOST);
+  default:
+    return createBuffer(allocSize, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                        usageFlags | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_HOST);
+  }
+}
+
+VkMemoryPropertyFlags Buffers::getMemoryFlags(const Agnosia_T::AllocatedBuffer &buffer) {
+  VkMemoryPropertyFlags flags = 0;
+  if (buffer.allocation != VK_NULL_HANDLE) {
+    vmaGetAllocationMemoryProperties(allocator, buffer.allocation, &flags);
+  }
+  return flags;
+}
+const char *Buffers::getMemoryName(VkMemoryPropertyFlags flags) {
+  const bool deviceLocal = flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  const bool hostVisible = flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  if (deviceLocal && hostVisible) {
+    return hostVisibleVram ? "VRAM, mapped" : "BAR";
+  }
+  if (deviceLocal) {
+    return "VRAM";
+  }
+  return (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) ? "system, cached" : "system";
+}
+bool Buffers::hasHostVisibleVram() { return hostVisibleVram; }
+bool &Buffers::getDirectWrite() { return directWrite; }
+
 VkDescriptorPool &Buffers::getDescriptorPool() { return descriptorPool; }
 VkDescriptorSet &Buffers::getTextureDescriptorSets() { return texturesSets; }
 VkDescriptorSetLayout &Buffers::getTextureDescriptorSetLayouts() { return texturesSetLayouts; }
+bool &Buffers::getMaterialDescriptorsDirty() { return materialDescriptorsDirty; }
 
 VkDescriptorSet &Buffers::getSamplerDescriptorSet() { return samplerDescriptorSet; }
 VkDescriptorSetLayout &Buffers::getSamplerDescriptorSetLayout() { return samplerDescriptorSetLayout; }
 
 uint32_t Buffers::getMaxFramesInFlight() { return MAX_FRAMES_IN_FLIGHT; }
+uint32_t Buffers::getStorageImageCount() { return STORAGE_IMAGE_COUNT; }
 std::vector<VkCommandBuffer> &Buffers::getCommandBuffers() { return commandBuffers; }
 VkCommandPool &Buffers::getCommandPool() { return commandPool; }
 uint32_t Buffers::getIndicesSize() { return indicesSize; }
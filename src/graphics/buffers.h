@@ -10,14 +10,51 @@
 
 class Buffers {
 public:
+  // What a buffer is used for, which decides the memory it goes in.
+  enum Intent {
+    // Filled once and read by the GPU every frame from then on, geometry.
+    // Device local and copied into through UploadQueue. With getDirectWrite on
+    // and the whole of VRAM host visible (ReBAR, UMA) it may come back mapped
+    // instead, write it in place then.
+    INTENT_STATIC,
+    // Rewritten by the host every frame, read by the GPU in that frame.
+    // Mapped, in the BAR when there is one.
+    INTENT_DYNAMIC,
+    // Written once by the host and copied from by the GPU. Mapped.
+    INTENT_STAGING,
+    // Written by the GPU and read by the host. Mapped and cached.
+    INTENT_READBACK,
+  };
+
   static Agnosia_T::AllocatedBuffer createBuffer(size_t allocSize,
                                                  VmaAllocationCreateFlags vmaFlags,
                                                  VkBufferUsageFlags usageFlags,
                                                  VmaMemoryUsage memUsage);
+  // The flags and usage that fit intent, see Intent.
+  static Agnosia_T::AllocatedBuffer createBuffer(size_t allocSize, VkBufferUsageFlags usageFlags, Intent intent);
   static void createMemoryAllocator(VkInstance vkInstance);
   static VmaAllocator getAllocator();
+  // Properties of the memory type a buffer ended up in, and a short name for them.
+  static VkMemoryPropertyFlags getMemoryFlags(const Agnosia_T::AllocatedBuffer &buffer);
+  static const char *getMemoryName(VkMemoryPropertyFlags flags);
+  // Whether the largest device local heap is host visible, a resizable BAR or
+  // memory shared with the CPU. Known once the allocator is.
+  static bool hasHostVisibleVram();
+  // Static buffers written straight into VRAM where hasHostVisibleVram, no
+  // staging copy. Only buffers created after it changes follow it.
+  static bool &getDirectWrite();
   static void createDescriptorSetLayout();
   static void createDescriptorSet(std::vector<Model *> models);
+  // Point each material's slots in the bindless texture array at its current image views.
+  // Nothing in flight may be using the set, Render::drawFrame calls it once the
+  // frames are done whenever getMaterialDescriptorsDirty is set.
+  static void writeMaterialDescriptors(const std::vector<Model *> &models);
+  // Set it when a material's textures changed, uploads no longer wait for the
+  // queue so whoever swaps an image can't rewrite the set itself.
+  static bool &getMaterialDescriptorsDirty();
+  // Point storage image slots from firstSlot on at views, in the GENERAL layout.
+  // Nothing in flight may be using those slots, frames never do.
+  static void writeStorageImages(uint32_t firstSlot, const std::vector<VkImageView> &views);
   static void createDescriptorPool();
   
   
@@ -30,6 +67,8 @@ public:
   static VkDescriptorSetLayout &getSamplerDescriptorSetLayout();
   
   static uint32_t getMaxFramesInFlight();
+  // Storage image slots in the texture set.
+  static uint32_t getStorageImageCount();
   static std::vector<VkCommandBuffer> &getCommandBuffers();
 
   static VkCommandPool &getCommandPool();
@@ -0,0 +1,183 @@
+#include "cookedmesh.h"
+#include "../utils/sourcestamp.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr char COOKED_MAGIC[4] = {'A', 'G', 'M', 'S'};
+
+// The sizes adding up doesn't mean the ranges inside do, a truncated or hand
+// edited file would have the uploads read past the arrays.
+bool rangesFit(const CookedMesh &mesh) {
+  const Agnosia_T::LodLevel *lods = mesh.getLods();
+  for (uint32_t i = 0; i < mesh.getLodCount(); i++) {
+    if (static_cast<uint64_t>(lods[i].firstIndex) + lods[i].indexCount > mesh.getIndexCount()) {
+      return false;
+    }
+  }
+  const Agnosia_T::Meshlet *meshlets = mesh.getMeshlets();
+  for (uint32_t i = 0; i < mesh.getMeshletCount(); i++) {
+    if (static_cast<uint64_t>(meshlets[i].vertexOffset) + meshlets[i].vertexCount > mesh.getMeshletVertexCount() ||
+        static_cast<uint64_t>(meshlets[i].triangleOffset) + meshlets[i].triangleCount * 3ull > mesh.getMeshletTriangleBytes()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+CookedMesh::CookedMesh(const std::string &cookedPath, const std::string &sourcePath) {
+  SourceStamp stamp;
+  if (!stampSource(sourcePath, stamp)) {
+    return;
+  }
+  int file = open(cookedPath.c_str(), O_RDONLY);
+  if (file < 0) {
+    return;
+  }
+  struct stat fileInfo;
+  if (fstat(file, &fileInfo) != 0 || static_cast<size_t>(fileInfo.st_size) < sizeof(Header)) {
+    close(file);
+    return;
+  }
+  this->mappingSize = static_cast<size_t>(fileInfo.st_size);
+  this->mapping = mmap(nullptr, this->mappingSize, PROT_READ, MAP_PRIVATE, file, 0);
+  // The mapping holds its own reference to the file, the descriptor is no longer needed.
+  close(file);
+  if (this->mapping == MAP_FAILED) {
+    this->mapping = nullptr;
+    return;
+  }
+  // We read the whole thing front to back exactly once, let the kernel read ahead.
+  madvise(this->mapping, this->mappingSize, MADV_SEQUENTIAL);
+  madvise(this->mapping, this->mappingSize, MADV_WILLNEED);
+
+  const Header *cooked = static_cast<const Header *>(this->mapping);
+  const size_t expectedSize = sizeof(Header) +
+                              static_cast<size_t>(cooked->vertexCount) * sizeof(Agnosia_T::Vertex) +
+                              static_cast<size_t>(cooked->indexCount) * sizeof(uint32_t) +
+                              static_cast<size_t>(cooked->lodCount) * sizeof(Agnosia_T::LodLevel) +
+                              static_cast<size_t>(cooked->meshletCount) * sizeof(Agnosia_T::Meshlet) +
+                              static_cast<size_t>(cooked->meshletVertexCount) * sizeof(uint32_t) +
+                              static_cast<size_t>(cooked->meshletTriangleBytes);
+
+  if (memcmp(cooked->magic, COOKED_MAGIC, sizeof(COOKED_MAGIC)) != 0 ||
+      cooked->version != VERSION ||
+      cooked->vertexStride != sizeof(Agnosia_T::Vertex) ||
+      cooked->lodCount == 0 ||
+      cooked->sourceSize != stamp.size ||
+      cooked->sourceTime != stamp.time ||
+      expectedSize != this->mappingSize) {
+    munmap(this->mapping, this->mappingSize);
+    this->mapping = nullptr;
+    return;
+  }
+  this->header = cooked;
+  if (!rangesFit(*this)) {
+    this->header = nullptr;
+    munmap(this->mapping, this->mappingSize);
+    this->mapping = nullptr;
+  }
+}
+
+CookedMesh::~CookedMesh() {
+  if (this->mapping != nullptr) {
+    munmap(this->mapping, this->mappingSize);
+  }
+}
+
+bool CookedMesh::isValid() const { return this->header != nullptr; }
+
+const Agnosia_T::Vertex *CookedMesh::getVertices() const {
+  return reinterpret_cast<const Agnosia_T::Vertex *>(reinterpret_cast<const char *>(this->header) + sizeof(Header));
+}
+const uint32_t *CookedMesh::getIndices() const {
+  return reinterpret_cast<const uint32_t *>(getVertices() + this->header->vertexCount);
+}
+uint32_t CookedMesh::getVertexCount() const { return this->header->vertexCount; }
+uint32_t CookedMesh::getIndexCount() const { return this->header->indexCount; }
+const Agnosia_T::LodLevel *CookedMesh::getLods() const {
+  return reinterpret_cast<const Agnosia_T::LodLevel *>(getIndices() + this->header->indexCount);
+}
+uint32_t CookedMesh::getLodCount() const { return this->header->lodCount; }
+Agnosia_T::Bounds CookedMesh::getBounds() const {
+  return {
+    .min = glm::vec3(this->header->boundsMin[0], this->header->boundsMin[1], this->header->boundsMin[2]),
+    .max = glm::vec3(this->header->boundsMax[0], this->header->boundsMax[1], this->header->boundsMax[2]),
+    .radius = this->header->boundsRadius,
+  };
+}
+Agnosia_T::CacheStats CookedMesh::getCacheBefore() const { return this->header->cacheBefore; }
+Agnosia_T::CacheStats CookedMesh::getCacheAfter() const { return this->header->cacheAfter; }
+const Agnosia_T::Meshlet *CookedMesh::getMeshlets() const {
+  return reinterpret_cast<const Agnosia_T::Meshlet *>(getLods() + this->header->lodCount);
+}
+uint32_t CookedMesh::getMeshletCount() const { return this->header->meshletCount; }
+const uint32_t *CookedMesh::getMeshletVertices() const {
+  return reinterpret_cast<const uint32_t *>(getMeshlets() + this->header->meshletCount);
+}
+uint32_t CookedMesh::getMeshletVertexCount() const { return this->header->meshletVertexCount; }
+const uint8_t *CookedMesh::getMeshletTriangles() const {
+  return reinterpret_cast<const uint8_t *>(getMeshletVertices() + this->header->meshletVertexCount);
+}
+uint32_t CookedMesh::getMeshletTriangleBytes() const { return this->header->meshletTriangleBytes; }
+
+std::string CookedMesh::getCookedPath(const std::string &sourcePath) {
+  return std::filesystem::path(sourcePath).replace_extension(".agmesh").string();
+}
+
+void CookedMesh::write(const std::string &cookedPath, const std::string &sourcePath, const Agnosia_T::MeshData &mesh) {
+  SourceStamp stamp;
+  if (!stampSource(sourcePath, stamp)) {
+    throw std::runtime_error("Failed to stat mesh source: " + sourcePath);
+  }
+  Header header = {
+    .magic = {},
+    .version = VERSION,
+    .vertexStride = sizeof(Agnosia_T::Vertex),
+    .vertexCount = static_cast<uint32_t>(mesh.vertices.size()),
+    .indexCount = static_cast<uint32_t>(mesh.indices.size()),
+    .lodCount = static_cast<uint32_t>(mesh.lods.size()),
+    .sourceSize = stamp.size,
+    .sourceTime = stamp.time,
+    .boundsMin = {mesh.bounds.min.x, mesh.bounds.min.y, mesh.bounds.min.z},
+    .boundsMax = {mesh.bounds.max.x, mesh.bounds.max.y, mesh.bounds.max.z},
+    .cacheBefore = mesh.cacheBefore,
+    .cacheAfter = mesh.cacheAfter,
+    .meshletCount = static_cast<uint32_t>(mesh.meshlets.size()),
+    .meshletVertexCount = static_cast<uint32_t>(mesh.meshletVertices.size()),
+    .meshletTriangleBytes = static_cast<uint32_t>(mesh.meshletTriangles.size()),
+    .boundsRadius = mesh.bounds.radius,
+  };
+  memcpy(header.magic, COOKED_MAGIC, sizeof(COOKED_MAGIC));
+
+  // Write to a temporary and rename it over the old file, so a crash mid-write
+  // never leaves a truncated mesh behind that passes the staleness check.
+  const std::string tempPath = cookedPath + ".tmp";
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      // Read-only asset directories are fine, we just parse the OBJ every launch.
+      return;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char *>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Agnosia_T::Vertex));
+    file.write(reinterpret_cast<const char *>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char *>(mesh.lods.data()), mesh.lods.size() * sizeof(Agnosia_T::LodLevel));
+    file.write(reinterpret_cast<const char *>(mesh.meshlets.data()), mesh.meshlets.size() * sizeof(Agnosia_T::Meshlet));
+    file.write(reinterpret_cast<const char *>(mesh.meshletVertices.data()), mesh.meshletVertices.size() * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char *>(mesh.meshletTriangles.data()), mesh.meshletTriangles.size());
+    if (!file) {
+      file.close();
+      std::filesystem::remove(tempPath);
+      return;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(tempPath, cookedPath, error);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../utils/types.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A cooked mesh is the deduplicated vertex and index arrays of a model, dumped
+// to disk in the exact layout we upload to the GPU. Loading one is just an mmap
+// and a memcpy into the staging buffer, no text parsing or hashing involved.
+class CookedMesh {
+public:
+  // Bump this whenever the layout of the file or of Agnosia_T::Vertex changes,
+  // old files will then be treated as stale and recooked from the source.
+  static constexpr uint32_t VERSION = 5;
+
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    // Indices of every LOD level, level 0 first.
+    uint32_t indexCount;
+    uint32_t lodCount;
+    // Size and modification time of the source file this was cooked from.
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    float boundsMin[3];
+    float boundsMax[3];
+    // Vertex cache efficiency of the source order and of the cooked order.
+    Agnosia_T::CacheStats cacheBefore;
+    Agnosia_T::CacheStats cacheAfter;
+    // Clusters of LOD 0, see Meshlets::build.
+    uint32_t meshletCount;
+    uint32_t meshletVertexCount;
+    uint32_t meshletTriangleBytes;
+    float boundsRadius;
+  };
+
+  // Maps the cooked file, if it is missing, corrupt or older than the source
+  // path, isValid() returns false and nothing is kept mapped.
+  CookedMesh(const std::string &cookedPath, const std::string &sourcePath);
+  CookedMesh(const CookedMesh &) = delete;
+  CookedMesh &operator=(const CookedMesh &) = delete;
+  ~CookedMesh();
+
+  bool isValid() const;
+  const Agnosia_T::Vertex *getVertices() const;
+  const uint32_t *getIndices() const;
+  uint32_t getVertexCount() const;
+  uint32_t getIndexCount() const;
+  const Agnosia_T::LodLevel *getLods() const;
+  uint32_t getLodCount() const;
+  Agnosia_T::Bounds getBounds() const;
+  Agnosia_T::CacheStats getCacheBefore() const;
+  Agnosia_T::CacheStats getCacheAfter() const;
+  const Agnosia_T::Meshlet *getMeshlets() const;
+  uint32_t getMeshletCount() const;
+  const uint32_t *getMeshletVertices() const;
+  uint32_t getMeshletVertexCount() const;
+  const uint8_t *getMeshletTriangles() const;
+  uint32_t getMeshletTriangleBytes() const;
+
+  static std::string getCookedPath(const std::string &sourcePath);
+  // The header is followed by the vertices, the indices, the LOD table, then
+  // the meshlets with their vertex and triangle arrays.
+  static void write(const std::string &cookedPath, const std::string &sourcePath, const Agnosia_T::MeshData &mesh);
+
+private:
+  void *mapping = nullptr;
+  size_t mappingSize = 0;
+  const Header *header = nullptr;
+};
@@ -0,0 +1,105 @@
+#include "cookedtexture.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr char COOKED_MAGIC[4] = {'A', 'G', 'T', 'X'};
+
+CookedTexture::CookedTexture(const std::string &cookedPath, const SourceStamp &stamp, MipGenerator::Filter filter, BlockCompressor::Format format, bool srgb) {
+  int file = open(cookedPath.c_str(), O_RDONLY);
+  if (file < 0) {
+    return;
+  }
+  struct stat fileInfo;
+  if (fstat(file, &fileInfo) != 0 || static_cast<size_t>(fileInfo.st_size) < sizeof(Header)) {
+    close(file);
+    return;
+  }
+  this->mappingSize = static_cast<size_t>(fileInfo.st_size);
+  this->mapping = mmap(nullptr, this->mappingSize, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (this->mapping == MAP_FAILED) {
+    this->mapping = nullptr;
+    return;
+  }
+  madvise(this->mapping, this->mappingSize, MADV_SEQUENTIAL);
+  madvise(this->mapping, this->mappingSize, MADV_WILLNEED);
+
+  const Header *cooked = static_cast<const Header *>(this->mapping);
+  if (memcmp(cooked->magic, COOKED_MAGIC, sizeof(COOKED_MAGIC)) != 0 ||
+      cooked->version != VERSION ||
+      cooked->filter != filter ||
+      cooked->format != format ||
+      cooked->srgb != srgb ||
+      cooked->width == 0 || cooked->height == 0 ||
+      cooked->mipLevels != MipGenerator::getLevelCount(cooked->width, cooked->height) ||
+      cooked->sourceSize != stamp.size ||
+      cooked->sourceTime != stamp.time ||
+      sizeof(Header) + BlockCompressor::getChainSize(cooked->width, cooked->height, format) != this->mappingSize) {
+    munmap(this->mapping, this->mappingSize);
+    this->mapping = nullptr;
+    return;
+  }
+  this->header = cooked;
+}
+
+CookedTexture::~CookedTexture() {
+  if (this->mapping != nullptr) {
+    munmap(this->mapping, this->mappingSize);
+  }
+}
+
+bool CookedTexture::isValid() const { return this->header != nullptr; }
+uint32_t CookedTexture::getWidth() const { return this->header->width; }
+uint32_t CookedTexture::getHeight() const { return this->header->height; }
+uint32_t CookedTexture::getMipLevels() const { return this->header->mipLevels; }
+BlockCompressor::Format CookedTexture::getFormat() const { return this->header->format; }
+const uint8_t *CookedTexture::getChain() const {
+  return reinterpret_cast<const uint8_t *>(this->header) + sizeof(Header);
+}
+size_t CookedTexture::getChainSize() const { return this->mappingSize - sizeof(Header); }
+
+std::string CookedTexture::getCookedPath(const std::string &sourcePath, BlockCompressor::Format format) {
+  const char *extensions[] = {".agtex", ".bc1.agtex", ".bc4.agtex", ".bc5.agtex", ".bc7.agtex", ".r8.agtex", ".rg8.agtex"};
+  return std::filesystem::path(sourcePath).replace_extension(extensions[format]).string();
+}
+
+void CookedTexture::write(const std::string &cookedPath, const SourceStamp &stamp, const uint8_t *chain,
+                          uint32_t width, uint32_t height, MipGenerator::Filter filter, bool srgb, BlockCompressor::Format format) {
+  Header header = {
+    .magic = {},
+    .version = VERSION,
+    .width = width,
+    .height = height,
+    .mipLevels = MipGenerator::getLevelCount(width, height),
+    .filter = filter,
+    .srgb = srgb,
+    .format = format,
+    .sourceSize = stamp.size,
+    .sourceTime = stamp.time,
+  };
+  memcpy(header.magic, COOKED_MAGIC, sizeof(COOKED_MAGIC));
+
+  // Same as CookedMesh, a crash mid-write must never leave a truncated chain behind.
+  const std::string tempPath = cookedPath + ".tmp";
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char *>(chain), BlockCompressor::getChainSize(width, height, format));
+    if (!file) {
+      file.close();
+      std::filesystem::remove(tempPath);
+      return;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(tempPath, cookedPath, error);
+}
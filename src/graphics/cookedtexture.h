@@ -0,0 +1,60 @@
+#pragma once
+
+#include "blockcompressor.h"
+#include "mipgen.h"
+#include "../utils/sourcestamp.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A cooked texture is the full mip chain of an image, built once by
+// MipGenerator, block compressed if asked to, and dumped to disk in the layout
+// the staging buffer wants. Loading one skips the PNG/JPEG decode, the mip
+// generation and the encoding, it is an mmap and a memcpy.
+class CookedTexture {
+public:
+  // Bump this whenever the file layout or the filters change.
+  static constexpr uint32_t VERSION = 2;
+
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    MipGenerator::Filter filter;
+    uint32_t srgb;
+    BlockCompressor::Format format;
+    // Size and modification time of the source images this was cooked from, see stampSources.
+    uint64_t sourceSize;
+    int64_t sourceTime;
+  };
+
+  // Maps the cooked file, if it is missing, corrupt, older than the source or
+  // built with another filter, format or color space, isValid() returns false
+  // and nothing stays mapped.
+  CookedTexture(const std::string &cookedPath, const SourceStamp &stamp, MipGenerator::Filter filter, BlockCompressor::Format format, bool srgb);
+  CookedTexture(const CookedTexture &) = delete;
+  CookedTexture &operator=(const CookedTexture &) = delete;
+  ~CookedTexture();
+
+  bool isValid() const;
+  uint32_t getWidth() const;
+  uint32_t getHeight() const;
+  uint32_t getMipLevels() const;
+  BlockCompressor::Format getFormat() const;
+  // Every level tightly packed, see BlockCompressor::getLevelOffset.
+  const uint8_t *getChain() const;
+  size_t getChainSize() const;
+
+  // Each format gets its own file, an image can be loaded both raw and compressed.
+  static std::string getCookedPath(const std::string &sourcePath, BlockCompressor::Format format);
+  // The header is followed by the chain, BlockCompressor::getChainSize bytes.
+  static void write(const std::string &cookedPath, const SourceStamp &stamp, const uint8_t *chain,
+                    uint32_t width, uint32_t height, MipGenerator::Filter filter, bool srgb, BlockCompressor::Format format);
+
+private:
+  void *mapping = nullptr;
+  size_t mappingSize = 0;
+  const Header *header = nullptr;
+};
@@ -0,0 +1,112 @@
+#include "culling.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AGNOSIA_CULLING_SSE
+#endif
+
+void Culling::BoundsList::clear() {
+  this->centerX.clear();
+  this->centerY.clear();
+  this->centerZ.clear();
+  this->extentX.clear();
+  this->extentY.clear();
+  this->extentZ.clear();
+  this->radius.clear();
+}
+
+void Culling::BoundsList::add(const Agnosia_T::Bounds &bounds, const glm::vec3 &position) {
+  const glm::vec3 center = position + (bounds.min + bounds.max) * 0.5f;
+  const glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+  this->centerX.push_back(center.x);
+  this->centerY.push_back(center.y);
+  this->centerZ.push_back(center.z);
+  this->extentX.push_back(extent.x);
+  this->extentY.push_back(extent.y);
+  this->extentZ.push_back(extent.z);
+  this->radius.push_back(bounds.radius);
+}
+
+size_t Culling::BoundsList::size() const { return this->radius.size(); }
+
+Culling::Frustum Culling::extractFrustum(const glm::mat4 &viewProj) {
+  // GLM is column major, row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i]).
+  auto row = [&](int i) { return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]); };
+  Frustum frustum = {{
+    row(3) + row(0),
+    row(3) - row(0),
+    row(3) + row(1),
+    row(3) - row(1),
+    // Vulkan clips depth at 0 rather than -w, the near plane is the z row alone.
+    row(2),
+    row(3) - row(2),
+  }};
+  for (glm::vec4 &plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+size_t Culling::cullScalar(const BoundsList &bounds, const Frustum &frustum, uint8_t *visible, size_t first) {
+  size_t visibleCount = 0;
+  for (size_t i = first; i < bounds.size(); i++) {
+    bool outside = false;
+    for (const glm::vec4 &plane : frustum.planes) {
+      const float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+      // How far the box reaches toward the plane, or the sphere if that's closer.
+      const float boxReach = std::abs(plane.x) * bounds.extentX[i] + std::abs(plane.y) * bounds.extentY[i] + std::abs(plane.z) * bounds.extentZ[i];
+      outside |= distance < -std::min(boxReach, bounds.radius[i]);
+    }
+    visible[i] = outside ? 0 : 1;
+    visibleCount += visible[i];
+  }
+  return visibleCount;
+}
+
+size_t Culling::cull(const BoundsList &bounds, const Frustum &frustum, uint8_t *visible) {
+  size_t i = 0;
+  size_t visibleCount = 0;
+#ifdef AGNOSIA_CULLING_SSE
+  // Four entries at a time against every plane, the same math as cullScalar.
+  __m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+  for (int plane = 0; plane < 6; plane++) {
+    planeX[plane] = _mm_set1_ps(frustum.planes[plane].x);
+    planeY[plane] = _mm_set1_ps(frustum.planes[plane].y);
+    planeZ[plane] = _mm_set1_ps(frustum.planes[plane].z);
+    planeW[plane] = _mm_set1_ps(frustum.planes[plane].w);
+    absX[plane] = _mm_set1_ps(std::abs(frustum.planes[plane].x));
+    absY[plane] = _mm_set1_ps(std::abs(frustum.planes[plane].y));
+    absZ[plane] = _mm_set1_ps(std::abs(frustum.planes[plane].z));
+  }
+  const __m128 zero = _mm_setzero_ps();
+  for (; i + 4 <= bounds.size(); i += 4) {
+    const __m128 centerX = _mm_loadu_ps(&bounds.centerX[i]);
+    const __m128 centerY = _mm_loadu_ps(&bounds.centerY[i]);
+    const __m128 centerZ = _mm_loadu_ps(&bounds.centerZ[i]);
+    const __m128 extentX = _mm_loadu_ps(&bounds.extentX[i]);
+    const __m128 extentY = _mm_loadu_ps(&bounds.extentY[i]);
+    const __m128 extentZ = _mm_loadu_ps(&bounds.extentZ[i]);
+    const __m128 radius = _mm_loadu_ps(&bounds.radius[i]);
+    __m128 outside = _mm_setzero_ps();
+    for (int plane = 0; plane < 6; plane++) {
+      __m128 distance = _mm_add_ps(_mm_mul_ps(planeX[plane], centerX), planeW[plane]);
+      distance = _mm_add_ps(distance, _mm_mul_ps(planeY[plane], centerY));
+      distance = _mm_add_ps(distance, _mm_mul_ps(planeZ[plane], centerZ));
+      __m128 boxReach = _mm_mul_ps(absX[plane], extentX);
+      boxReach = _mm_add_ps(boxReach, _mm_mul_ps(absY[plane], extentY));
+      boxReach = _mm_add_ps(boxReach, _mm_mul_ps(absZ[plane], extentZ));
+      const __m128 reach = _mm_sub_ps(zero, _mm_min_ps(boxReach, radius));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, reach));
+    }
+    const int outsideMask = _mm_movemask_ps(outside);
+    for (int lane = 0; lane < 4; lane++) {
+      visible[i + lane] = (outsideMask >> lane) & 1 ? 0 : 1;
+    }
+    visibleCount += 4 - std::popcount(static_cast<unsigned>(outsideMask));
+  }
+#endif
+  return visibleCount + cullScalar(bounds, frustum, visible, i);
+}
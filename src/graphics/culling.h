@@ -0,0 +1,38 @@
+#pragma once
+
+#include "../utils/types.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Frustum culling of world space bounds, kept as a structure of arrays so the
+// kernel can test four of them per instruction.
+class Culling {
+public:
+  struct Frustum {
+    // Left, right, bottom, top, near, far. Normalized, xyz points inside.
+    glm::vec4 planes[6];
+  };
+  struct BoundsList {
+    // One entry per object, a box (center and half extent) and a sphere
+    // around the same center. Filled through add(), read by the kernels.
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    std::vector<float> radius;
+
+    void clear();
+    void add(const Agnosia_T::Bounds &bounds, const glm::vec3 &position);
+    size_t size() const;
+  };
+
+  // Gribb & Hartmann plane extraction, for a zero to one depth projection.
+  static Frustum extractFrustum(const glm::mat4 &viewProj);
+
+  // Writes 1 to visible for every entry touching the frustum and 0 for the
+  // rest, returns how many are visible. An entry is culled as soon as either
+  // its box or its sphere is completely outside one of the planes.
+  static size_t cull(const BoundsList &bounds, const Frustum &frustum, uint8_t *visible);
+  // Reference version, one entry at a time. Also handles the SIMD tail.
+  static size_t cullScalar(const BoundsList &bounds, const Frustum &frustum, uint8_t *visible, size_t first = 0);
+};
@@ -0,0 +1,160 @@
+#include "geometrypool.h"
+#include "../devicelibrary.h"
+#include "../utils/deletion.h"
+#include "../utils/helpers.h"
+#include "../utils/types.h"
+#include "buffers.h"
+#include "uploadqueue.h"
+
+#include <algorithm>
+#include <utility>
+
+// What a pool starts with once something goes in it, the dragon fits in the
+// vertex pool twice over. Past that it doubles.
+constexpr VkDeviceSize INITIAL_POOL_BYTES = 16ull << 20;
+
+GeometryPool pools[GeometryPool::POOL_COUNT] = {
+  {sizeof(Agnosia_T::Vertex), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT},
+  {sizeof(Agnosia_T::PackedVertex), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT},
+  {sizeof(uint16_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT},
+  {sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT},
+  {16, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT},
+};
+
+void GeometryPool::create() {
+  DeletionQueue::get().push_function([=](){
+    // Frees deferred by the last meshes run before the blocks go.
+    UploadQueue::wait(UploadQueue::submit());
+    for (GeometryPool &pool : pools) {
+      pool.destroy();
+    }
+  });
+}
+
+GeometryPool &GeometryPool::get(Kind kind) { return pools[kind]; }
+
+void GeometryPool::compactAll(bool force) {
+  for (GeometryPool &pool : pools) {
+    // Only worth a copy once most of the buffer sits unused.
+    const VkDeviceSize initialCapacity = INITIAL_POOL_BYTES / pool.stride;
+    if (pool.buffer != VK_NULL_HANDLE && (force || (pool.capacity > initialCapacity && pool.used < pool.capacity / 4))) {
+      pool.compact();
+    }
+  }
+}
+
+GeometryPool::GeometryPool(VkDeviceSize stride, VkBufferUsageFlags usage) : stride(stride), usage(usage) {}
+
+void GeometryPool::allocate(Range &range, VkDeviceSize count) {
+  VmaVirtualAllocationCreateInfo allocInfo = {
+    .size = count,
+  };
+  if (this->block == VK_NULL_HANDLE || vmaVirtualAllocate(this->block, &allocInfo, &range.allocation, &range.offset) != VK_SUCCESS) {
+    // Everything is packed at the front of the new buffer, the range always fits after it.
+    relocate(std::max({this->capacity * 2, this->used + count, INITIAL_POOL_BYTES / this->stride}));
+    VK_CHECK(vmaVirtualAllocate(this->block, &allocInfo, &range.allocation, &range.offset));
+  }
+  range.count = count;
+  this->used += count;
+  this->ranges.push_back(&range);
+}
+
+void GeometryPool::free(Range &range) {
+  if (range.allocation == VK_NULL_HANDLE) {
+    return;
+  }
+  this->ranges.erase(std::find(this->ranges.begin(), this->ranges.end(), &range));
+  this->used -= range.count;
+  const VmaVirtualAllocation allocation = std::exchange(range.allocation, VK_NULL_HANDLE);
+  const uint64_t generation = this->generation;
+  UploadQueue::release([this, allocation, generation]() {
+    // A relocation since then left the range behind with the old block.
+    if (this->generation == generation) {
+      vmaVirtualFree(this->block, allocation);
+    }
+  });
+}
+
+void GeometryPool::relocate(VkDeviceSize capacity) {
+  capacity = std::max<VkDeviceSize>(capacity, std::max<VkDeviceSize>(this->used, 1));
+  VmaVirtualBlockCreateInfo blockInfo = {
+    .size = capacity,
+  };
+  VmaVirtualBlock block;
+  VK_CHECK(vmaCreateVirtualBlock(&blockInfo, &block));
+  Agnosia_T::AllocatedBuffer buffer = Buffers::createBuffer(capacity * this->stride,
+                                                            this->usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                            Buffers::INTENT_STATIC);
+
+  // Back to back in the order they were allocated.
+  std::vector<VkBufferCopy> regions;
+  for (Range *range : this->ranges) {
+    VmaVirtualAllocationCreateInfo allocInfo = {
+      .size = range->count,
+    };
+    VkDeviceSize offset;
+    VK_CHECK(vmaVirtualAllocate(block, &allocInfo, &range->allocation, &offset));
+    regions.push_back({.srcOffset = range->offset * this->stride, .dstOffset = offset * this->stride, .size = range->count * this->stride});
+    range->offset = offset;
+  }
+  if (!regions.empty()) {
+    VkCommandBuffer cmd = UploadQueue::getCommandBuffer();
+    // Copies into the old buffer recorded earlier in this batch land before it's read.
+    VkMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+    };
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    vkCmdCopyBuffer(cmd, this->buffer, buffer.buffer, static_cast<uint32_t>(regions.size()), regions.data());
+  }
+  if (this->buffer != VK_NULL_HANDLE) {
+    // Frames in flight may still draw from the old buffer.
+    UploadQueue::release(Agnosia_T::AllocatedBuffer{this->buffer, this->allocation, {}});
+    vmaClearVirtualBlock(this->block);
+    vmaDestroyVirtualBlock(this->block);
+    this->relocations++;
+  }
+
+  VkBufferDeviceAddressInfo addressInfo = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+    .buffer = buffer.buffer,
+  };
+  this->block = block;
+  this->buffer = buffer.buffer;
+  this->allocation = buffer.allocation;
+  this->address = vkGetBufferDeviceAddress(DeviceControl::getDevice(), &addressInfo);
+  this->mapped = buffer.info.pMappedData;
+  this->capacity = capacity;
+  this->generation++;
+}
+
+void GeometryPool::compact() {
+  relocate(std::max(this->used * 2, INITIAL_POOL_BYTES / this->stride));
+}
+
+void GeometryPool::destroy() {
+  if (this->buffer == VK_NULL_HANDLE) {
+    return;
+  }
+  vmaDestroyBuffer(Buffers::getAllocator(), this->buffer, this->allocation);
+  vmaClearVirtualBlock(this->block);
+  vmaDestroyVirtualBlock(this->block);
+  this->buffer = VK_NULL_HANDLE;
+  this->block = VK_NULL_HANDLE;
+}
+
+VkDeviceSize GeometryPool::getStride() { return this->stride; }
+VkBuffer GeometryPool::getBuffer() { return this->buffer; }
+VkDeviceAddress GeometryPool::getAddress() { return this->address; }
+void *GeometryPool::getMapped() { return this->mapped; }
+VkMemoryPropertyFlags GeometryPool::getMemoryFlags() { return Buffers::getMemoryFlags({this->buffer, this->allocation, {}}); }
+void GeometryPool::flush(const Range &range) {
+  if (this->mapped != nullptr) {
+    vmaFlushAllocation(Buffers::getAllocator(), this->allocation, range.offset * this->stride, range.count * this->stride);
+  }
+}
+VkDeviceSize GeometryPool::getCapacity() { return this->capacity; }
+VkDeviceSize GeometryPool::getUsed() { return this->used; }
+size_t GeometryPool::getRangeCount() { return this->ranges.size(); }
+uint32_t GeometryPool::getRelocations() { return this->relocations; }
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "volk.h"
+#include "vk_mem_alloc.h"
+#include <cstdint>
+#include <vector>
+
+// One device local buffer every mesh's geometry of a kind is suballocated from,
+// instead of a handful of buffers per mesh. A mesh is a range of elements in
+// each pool, drawn with its index range's start as firstIndex and its vertex
+// range's as vertexOffset, so the index buffer is bound once per index type
+// for the whole frame rather than once per draw. Ranges are handed out by a VMA
+// virtual block counting elements, vertices don't come in power of two sizes.
+//
+// Growing or compacting copies the live ranges into a new buffer and moves
+// them, read offsets and addresses again every frame instead of keeping them.
+// Main thread only, the copies go through UploadQueue.
+class GeometryPool {
+public:
+  enum Kind {
+    POOL_VERTICES_FULL,
+    POOL_VERTICES_PACKED,
+    POOL_INDICES_16,
+    POOL_INDICES_32,
+    // Meshlets, their vertex lists and triangles, in 16 byte elements.
+    POOL_MESHLETS,
+    POOL_COUNT,
+  };
+
+  // Where a piece of geometry lives, in elements. Registered with the pool
+  // until freed so compaction can move it, it must not move itself meanwhile.
+  struct Range {
+    VmaVirtualAllocation allocation = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize count = 0;
+  };
+
+  // After UploadQueue. The buffers are only made once something goes in them.
+  static void create();
+  static GeometryPool &get(Kind kind);
+  // Compacts every pool less than a quarter full, or all of them with force.
+  static void compactAll(bool force);
+
+  GeometryPool(VkDeviceSize stride, VkBufferUsageFlags usage);
+  GeometryPool(const GeometryPool &) = delete;
+  GeometryPool &operator=(const GeometryPool &) = delete;
+
+  // Reserves count elements, growing the pool if they don't fit. Anything
+  // recorded into the old buffer lands in the new one, but take the buffer to
+  // copy into only after the last allocation.
+  void allocate(Range &range, VkDeviceSize count);
+  // The range stops moving right away, its elements are reused once the
+  // frames submitted so far and the open upload batch are done with them.
+  void free(Range &range);
+  // Moves every range to the front of a new buffer of capacity elements, at
+  // least what the ranges need. The old one goes once nothing reads it.
+  void relocate(VkDeviceSize capacity);
+  void compact();
+  void destroy();
+
+  VkDeviceSize getStride();
+  VkBuffer getBuffer();
+  VkDeviceAddress getAddress();
+  // Null unless the buffer landed in host visible VRAM, see Buffers::INTENT_STATIC.
+  void *getMapped();
+  VkMemoryPropertyFlags getMemoryFlags();
+  void flush(const Range &range);
+  // Elements the buffer holds and the ranges use, and how many times it was
+  // grown or compacted.
+  VkDeviceSize getCapacity();
+  VkDeviceSize getUsed();
+  size_t getRangeCount();
+  uint32_t getRelocations();
+
+private:
+  VkDeviceSize stride;
+  VkBufferUsageFlags usage;
+  VmaVirtualBlock block = VK_NULL_HANDLE;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VmaAllocation allocation = VK_NULL_HANDLE;
+  VkDeviceAddress address = 0;
+  void *mapped = nullptr;
+  VkDeviceSize capacity = 0;
+  VkDeviceSize used = 0;
+  std::vector<Range *> ranges;
+  // Bumped with every new block, a free deferred past a relocation has nothing left to free.
+  uint64_t generation = 0;
+  uint32_t relocations = 0;
+};
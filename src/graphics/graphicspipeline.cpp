@@ -9,8 +9,12 @@
 #include "render.h"
 #include "texture.h"
 #include "../utils/deletion.h"
+#include "culling.h"
+#include "../utils/timer.h"
 #include "vulkan/vulkan_core.h"
 #include <algorithm>
+#include <cmath>
+#include <functional>
  
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/ext/matrix_clip_space.hpp>
@@ -24,6 +28,37 @@ float centerPos[4] = {0.0f, 0.0f, 0.0f, 0.44f};
 float upDir[4] = {0.0f, 0.0f, 1.0f, 0.44f};
 float depthField = 45.0f;
 float distanceField[2] = {0.1f, 100.0f};
+// How many pixels an LOD level may be off from the full mesh on screen.
+float lodThreshold = 1.0f;
+bool frustumCulling = true;
+// Models drawn and skipped by frustum culling in the last recorded frame, for the UI.
+uint32_t drawnCount = 0;
+uint32_t culledCount = 0;
+// Instanced draws recorded for the visible models in the last frame.
+uint32_t batchCount = 0;
+// Kept around so the per frame culling doesn't reallocate.
+Culling::BoundsList modelBounds;
+std::vector<uint8_t> modelVisible;
+std::vector<uint32_t> drawOrder;
+
+// Host visible buffers the draws read their SceneData and instances from, one
+// pair per frame in flight so recording a frame never writes over one the GPU
+// is still reading. They only ever grow.
+struct FrameBuffer {
+  Agnosia_T::AllocatedBuffer buffer{};
+  size_t capacity = 0;
+  VkDeviceAddress address = 0;
+};
+std::vector<FrameBuffer> sceneBuffers;
+std::vector<FrameBuffer> instanceBuffers;
+
+// Two timestamps per frame in flight around the scene draws, read back the
+// next time the frame comes around, once its fence has been waited on.
+VkQueryPool timestampPool = VK_NULL_HANDLE;
+float timestampPeriod = 0.0f;
+std::vector<bool> timestampsWritten;
+double recordTime = 0.0;
+double sceneGpuTime = 0.0;
 
 std::deque<Agnosia_T::Pipeline> graphicsHistory;
 std::deque<Agnosia_T::Pipeline> fullscreenHistory;
@@ -53,12 +88,77 @@ void Graphics::createCommandBuffer() {
   allocInfo.commandBufferCount = (uint32_t)Buffers::getCommandBuffers().size();
 
   VK_CHECK(vkAllocateCommandBuffers(DeviceControl::getDevice(), &allocInfo, Buffers::getCommandBuffers().data()));
+
+  sceneBuffers.resize(Buffers::getMaxFramesInFlight());
+  instanceBuffers.resize(Buffers::getMaxFramesInFlight());
+  DeletionQueue::get().push_function([=](){
+    for(std::vector<FrameBuffer> *frameBuffers : {&sceneBuffers, &instanceBuffers}) {
+      for(FrameBuffer &frameBuffer : *frameBuffers) {
+        if(frameBuffer.capacity != 0) {
+          vmaDestroyBuffer(Buffers::getAllocator(), frameBuffer.buffer.buffer, frameBuffer.buffer.allocation);
+        }
+      }
+    }
+  });
+}
+void Graphics::createTimestampQueries() {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(DeviceControl::getPhysicalDevice(), &properties);
+  // Without timestamps on the graphics queue the GPU time just stays at zero.
+  if(!properties.limits.timestampComputeAndGraphics) {
+    return;
+  }
+  timestampPeriod = properties.limits.timestampPeriod;
+
+  VkQueryPoolCreateInfo queryPoolInfo = {
+    .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+    .queryType = VK_QUERY_TYPE_TIMESTAMP,
+    .queryCount = 2 * Buffers::getMaxFramesInFlight(),
+  };
+  VK_CHECK(vkCreateQueryPool(DeviceControl::getDevice(), &queryPoolInfo, nullptr, &timestampPool));
+  timestampsWritten.assign(Buffers::getMaxFramesInFlight(), false);
+
+  DeletionQueue::get().push_function([=](){vkDestroyQueryPool(DeviceControl::getDevice(), timestampPool, nullptr);});
+}
+
+// Grow a frame's buffer to hold at least size bytes and return where to write them.
+void *reserveFrameBuffer(FrameBuffer &frameBuffer, size_t size) {
+  if(frameBuffer.capacity >= size) {
+    return frameBuffer.buffer.info.pMappedData;
+  }
+  if(frameBuffer.capacity != 0) {
+    vmaDestroyBuffer(Buffers::getAllocator(), frameBuffer.buffer.buffer, frameBuffer.buffer.allocation);
+  }
+  // Double it so a scene that grows a little every frame doesn't reallocate every frame.
+  frameBuffer.capacity = std::max(size, frameBuffer.capacity * 2);
+  frameBuffer.buffer = Buffers::createBuffer(frameBuffer.capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, Buffers::INTENT_DYNAMIC);
+
+  VkBufferDeviceAddressInfo addressInfo = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+    .buffer = frameBuffer.buffer.buffer,
+  };
+  frameBuffer.address = vkGetBufferDeviceAddress(DeviceControl::getDevice(), &addressInfo);
+  return frameBuffer.buffer.info.pMappedData;
 }
 void Graphics::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, AssetCache& cache) {
+  Timer recordTimer;
+  const uint32_t frame = Render::getCurrentFrame();
+
   VkCommandBufferBeginInfo beginInfo{};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
   VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+  if(timestampPool != VK_NULL_HANDLE) {
+    // drawFrame waited on this frame's fence, so last time's queries are done.
+    if(timestampsWritten[frame]) {
+      uint64_t timestamps[2];
+      if(vkGetQueryPoolResults(DeviceControl::getDevice(), timestampPool, frame * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        sceneGpuTime = (timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0;
+      }
+    }
+    vkCmdResetQueryPool(commandBuffer, timestampPool, frame * 2, 2);
+  }
   
   const VkImageMemoryBarrier2 imageMemoryBarrier{
       .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
@@ -141,8 +241,6 @@ void Graphics::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
   vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsHistory.front().layout, 0, 1, &Buffers::getTextureDescriptorSets(), 0, nullptr);
   vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsHistory.front().layout, 1, 1, &Buffers::getSamplerDescriptorSet(), 0, nullptr);
 
-  int modelID = 0;
-
   Agnosia_T::SceneData sceneData;
   
   
@@ -162,51 +260,137 @@ void Graphics::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
   sceneData.lightColor = glm::vec3(lightColor[0], lightColor[1], lightColor[2]);
   sceneData.lightPower = lightPower;
   sceneData.camPos = glm::vec3(camPos[0], camPos[1], camPos[2]);
-  
-  const size_t sceneDataSize = sizeof(Agnosia_T::SceneData);
-  size_t sceneBufferSize = sceneDataSize * std::clamp((int) cache.getModels().size(), 1, INT_MAX);
-  
-  Agnosia_T::AllocatedBuffer sceneBuffer = Buffers::createBuffer(sceneBufferSize, VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_AUTO);
-  void *sceneBufferData = sceneBuffer.info.pMappedData;
 
-  VkBufferDeviceAddressInfo sceneBufferDeviceAddressInfo = {
-    .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-    .buffer = sceneBuffer.buffer,
+  // Pixels covered by one unit of model space at a distance of one unit, used to
+  // project each LOD level's error onto the screen.
+  const float pixelsPerUnit = DeviceControl::getSwapChainExtent().height / (2.0f * std::tan(glm::radians(depthField) * 0.5f));
+
+  // Test every model against the frustum at once, the draws below only look up the result.
+  const std::vector<Model *> models = cache.getModels();
+  modelBounds.clear();
+  for (Model *model : models) {
+    modelBounds.add(model->getMesh()->getBounds(), model->getPos());
+  }
+  modelVisible.resize(models.size());
+  if (frustumCulling) {
+    drawnCount = Culling::cull(modelBounds, Culling::extractFrustum(sceneData.proj * sceneData.view * sceneData.model), modelVisible.data());
+  } else {
+    std::fill(modelVisible.begin(), modelVisible.end(), 1);
+    drawnCount = models.size();
+  }
+  culledCount = models.size() - drawnCount;
+
+  drawOrder.clear();
+  for (uint32_t modelIndex = 0; modelIndex < models.size(); modelIndex++) {
+    if (!modelVisible[modelIndex]) {
+      continue;
+    }
+    Model *model = models[modelIndex];
+    Mesh *mesh = model->getMesh();
+    // Pick the coarsest LOD whose error stays under the threshold on screen,
+    // measured from the nearest point of the model's bounding sphere.
+    const Agnosia_T::Bounds &bounds = mesh->getBounds();
+    const glm::vec3 center = model->getPos() + (bounds.min + bounds.max) * 0.5f;
+    const float distance = std::max(glm::length(sceneData.camPos - center) - bounds.radius, distanceField[0]);
+    const std::vector<Agnosia_T::LodLevel> &lods = mesh->getLods();
+    uint32_t lod = 0;
+    while (lod + 1 < lods.size() && lods[lod + 1].error * pixelsPerUnit / distance <= lodThreshold) {
+      lod++;
+    }
+    model->setLod(lod);
+    drawOrder.push_back(modelIndex);
+  }
+
+  // Models with the same mesh at the same LOD become one instanced draw, so
+  // line them up next to each other. Meshes with 16 bit indices come first,
+  // the index pool is only bound again where the index type changes.
+  auto sameDraw = [&](uint32_t a, uint32_t b) {
+    return models[a]->getMesh() == models[b]->getMesh() && models[a]->getLod() == models[b]->getLod();
   };
-  
-  VkDeviceAddress sceneBufferAddress = vkGetBufferDeviceAddress(DeviceControl::getDevice(), &sceneBufferDeviceAddressInfo);
+  std::sort(drawOrder.begin(), drawOrder.end(), [&](uint32_t a, uint32_t b) {
+    if (models[a]->getMesh()->getBuffers().indexType != models[b]->getMesh()->getBuffers().indexType) {
+      return models[a]->getMesh()->getBuffers().indexType == VK_INDEX_TYPE_UINT16;
+    }
+    if (models[a]->getMesh() != models[b]->getMesh()) {
+      return std::less<Mesh *>()(models[a]->getMesh(), models[b]->getMesh());
+    }
+    return models[a]->getLod() < models[b]->getLod();
+  });
+  batchCount = 0;
+  for (size_t i = 0; i < drawOrder.size(); i++) {
+    if (i == 0 || !sameDraw(drawOrder[i - 1], drawOrder[i])) {
+      batchCount++;
+    }
+  }
+
+  // One SceneData per draw instead of per model, the instances carry the rest.
+  const size_t sceneDataSize = sizeof(Agnosia_T::SceneData);
+  FrameBuffer &sceneBuffer = sceneBuffers[frame];
+  FrameBuffer &instanceBuffer = instanceBuffers[frame];
+  char *sceneBufferData = (char *) reserveFrameBuffer(sceneBuffer, sceneDataSize * std::max(batchCount, 1u));
+  Agnosia_T::InstanceData *instanceData = (Agnosia_T::InstanceData *) reserveFrameBuffer(instanceBuffer, sizeof(Agnosia_T::InstanceData) * std::max(drawOrder.size(), (size_t) 1));
+  sceneData.instanceBuffer = instanceBuffer.address;
+
+  if(timestampPool != VK_NULL_HANDLE) {
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, timestampPool, frame * 2);
+  }
 
-  for (Model *model : cache.getModels()) {
-    // Per model push constants
-    sceneData.vertexBuffer = model->getBuffers().vertexBufferAddress;
-    sceneData.objPosition = model->getPos();
-    sceneData.diffuseID = ((modelID+1)*4);
-    sceneData.metallicID = ((modelID+1)*4)+1;
-    sceneData.aoID = ((modelID+1)*4)+2;
-    sceneData.roughnessID = ((modelID+1)*4)+3;
+  uint32_t batch = 0;
+  VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+  for (uint32_t first = 0; first < drawOrder.size();) {
+    uint32_t last = first;
+    while (last < drawOrder.size() && sameDraw(drawOrder[first], drawOrder[last])) {
+      Model *model = models[drawOrder[last]];
+      instanceData[last] = {
+        .position = model->getPos(),
+        .textureSlot = model->getMaterial().getShaderSlot(),
+      };
+      last++;
+    }
+    Mesh *mesh = models[drawOrder[first]]->getMesh();
+    const Agnosia_T::LodLevel &lod = mesh->getLods()[models[drawOrder[first]]->getLod()];
+    const Agnosia_T::GPUMeshBuffers buffers = mesh->getBuffers();
+
+    // Per draw push constants, the vertex pool of the mesh's format.
+    sceneData.vertexBuffer = buffers.vertexBufferAddress;
+    sceneData.boundsMin = mesh->getBounds().min;
+    sceneData.boundsExtent = mesh->getBounds().max - mesh->getBounds().min;
+    sceneData.vertexFormat = mesh->getVertexFormat();
 
     // Copy the gpu buffer
-    memcpy((char*) sceneBufferData + (sceneDataSize * modelID), &sceneData, sceneDataSize);
+    memcpy(sceneBufferData + (sceneDataSize * batch), &sceneData, sceneDataSize);
     
     Agnosia_T::GPUPushConstants pushConsts = {
-      .gpuBufferAddress = sceneBufferAddress + (sceneDataSize * modelID),
+      .gpuBufferAddress = sceneBuffer.address + (sceneDataSize * batch),
     };
 
     vkCmdPushConstants(commandBuffer, graphicsHistory.front().layout, VK_SHADER_STAGE_ALL, 0, sizeof(Agnosia_T::GPUPushConstants), &pushConsts);
 
-    vkCmdBindIndexBuffer(commandBuffer, model->getBuffers().indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+    // One pool per index type, so this binds at most twice a frame.
+    if (buffers.indexBuffer != boundIndexBuffer) {
+      vkCmdBindIndexBuffer(commandBuffer, buffers.indexBuffer, 0, buffers.indexType);
+      boundIndexBuffer = buffers.indexBuffer;
+    }
+
+    // The mesh's ranges of the pools are where its indices and vertices start,
+    // firstInstance offsets gl_InstanceIndex to this draw's run of instances.
+    vkCmdDrawIndexed(commandBuffer, lod.indexCount, last - first, buffers.firstIndex + lod.firstIndex, buffers.vertexOffset, first);
+    batch++;
+    first = last;
+  }
 
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(model->getIndices()), 1, 0, 0, 0);
-    modelID++;  
+  if(timestampPool != VK_NULL_HANDLE) {
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, timestampPool, frame * 2 + 1);
+    timestampsWritten[frame] = true;
   }
 
   vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, fullscreenHistory.front().pipeline);
   
   if(cache.getModels().empty()) {
-    memcpy((char*) sceneBufferData, &sceneData, sceneDataSize);
+    memcpy(sceneBufferData, &sceneData, sceneDataSize);
     
     Agnosia_T::GPUPushConstants pushConsts = {
-      .gpuBufferAddress = sceneBufferAddress,
+      .gpuBufferAddress = sceneBuffer.address,
     };
 
     vkCmdPushConstants(commandBuffer, fullscreenHistory.front().layout, VK_SHADER_STAGE_ALL, 0, sizeof(Agnosia_T::GPUPushConstants), &pushConsts);
@@ -250,9 +434,7 @@ void Graphics::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
   vkCmdPipelineBarrier2(Buffers::getCommandBuffers()[Render::getCurrentFrame()], &depInfo);
 
   VK_CHECK(vkEndCommandBuffer(commandBuffer));
-  
-  vmaDestroyBuffer(Buffers::getAllocator(), sceneBuffer.buffer, sceneBuffer.allocation);
-  
+  recordTime = recordTimer.elapsedMs();
 }
 
 float *Graphics::getCamPos() { return camPos; }
@@ -263,6 +445,13 @@ float *Graphics::getCenterPos() { return centerPos; }
 float *Graphics::getUpDir() { return upDir; }
 float &Graphics::getDepthField() { return depthField; }
 float *Graphics::getDistanceField() { return distanceField; }
+float &Graphics::getLodThreshold() { return lodThreshold; }
+bool &Graphics::getFrustumCulling() { return frustumCulling; }
+uint32_t Graphics::getDrawnCount() { return drawnCount; }
+uint32_t Graphics::getCulledCount() { return culledCount; }
+uint32_t Graphics::getBatchCount() { return batchCount; }
+double Graphics::getRecordTime() { return recordTime; }
+double Graphics::getSceneGpuTime() { return sceneGpuTime; }
 
 
 void Graphics::addGraphicsPipeline(Agnosia_T::Pipeline pipeline) {
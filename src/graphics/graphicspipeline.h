@@ -7,6 +7,7 @@ class Graphics {
 public:
   static void createCommandPool();
   static void createCommandBuffer();
+  static void createTimestampQueries();
   static void recordCommandBuffer(VkCommandBuffer cmndBuffer, uint32_t imageIndex, AssetCache& cache);
 
   static void addGraphicsPipeline(Agnosia_T::Pipeline pipeline);
@@ -20,5 +21,14 @@ public:
   static float *getUpDir();
   static float &getDepthField();
   static float *getDistanceField();
+  static float &getLodThreshold();
+  static bool &getFrustumCulling();
+  static uint32_t getDrawnCount();
+  static uint32_t getCulledCount();
+  // Instanced draws the visible models were merged into.
+  static uint32_t getBatchCount();
+  // CPU time spent in recordCommandBuffer last frame, and GPU time of its scene draws, both in ms.
+  static double getRecordTime();
+  static double getSceneGpuTime();
   
 };
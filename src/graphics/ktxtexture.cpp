@@ -0,0 +1,271 @@
+#include "ktxtexture.h"
+#include "mipgen.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// Size of a texel block for runs of VkFormat values, enough to check that each
+// level holds as many bytes as the image needs. Depth formats and the planar
+// YCbCr ones are left out, a texture file has no business holding those.
+struct TexelBlock {
+  uint32_t first;
+  uint32_t last;
+  uint32_t bytes;
+  uint32_t width;
+  uint32_t height;
+};
+constexpr TexelBlock TEXEL_BLOCKS[] = {
+  {1, 1, 1, 1, 1},       // R4G4
+  {2, 8, 2, 1, 1},       // 16 bit packed
+  {9, 15, 1, 1, 1},      // R8
+  {16, 22, 2, 1, 1},     // R8G8
+  {23, 36, 3, 1, 1},     // R8G8B8, B8G8R8
+  {37, 69, 4, 1, 1},     // R8G8B8A8, B8G8R8A8, A8B8G8R8, A2R10G10B10, A2B10G10R10
+  {70, 76, 2, 1, 1},     // R16
+  {77, 83, 4, 1, 1},     // R16G16
+  {84, 90, 6, 1, 1},     // R16G16B16
+  {91, 97, 8, 1, 1},     // R16G16B16A16
+  {98, 100, 4, 1, 1},    // R32
+  {101, 103, 8, 1, 1},   // R32G32
+  {104, 106, 12, 1, 1},  // R32G32B32
+  {107, 109, 16, 1, 1},  // R32G32B32A32
+  {110, 112, 8, 1, 1},   // R64
+  {113, 115, 16, 1, 1},  // R64G64
+  {116, 118, 24, 1, 1},  // R64G64B64
+  {119, 121, 32, 1, 1},  // R64G64B64A64
+  {122, 123, 4, 1, 1},   // B10G11R11, E5B9G9R9
+  {131, 134, 8, 4, 4},   // BC1
+  {135, 138, 16, 4, 4},  // BC2, BC3
+  {139, 140, 8, 4, 4},   // BC4
+  {141, 146, 16, 4, 4},  // BC5, BC6H, BC7
+  {147, 150, 8, 4, 4},   // ETC2 RGB, RGB A1
+  {151, 152, 16, 4, 4},  // ETC2 RGBA
+  {153, 154, 8, 4, 4},   // EAC R11
+  {155, 156, 16, 4, 4},  // EAC R11G11
+  {157, 158, 16, 4, 4},  // ASTC, 16 bytes whatever the footprint
+  {159, 160, 16, 5, 4},
+  {161, 162, 16, 5, 5},
+  {163, 164, 16, 6, 5},
+  {165, 166, 16, 6, 6},
+  {167, 168, 16, 8, 5},
+  {169, 170, 16, 8, 6},
+  {171, 172, 16, 8, 8},
+  {173, 174, 16, 10, 5},
+  {175, 176, 16, 10, 6},
+  {177, 178, 16, 10, 8},
+  {179, 180, 16, 10, 10},
+  {181, 182, 16, 12, 10},
+  {183, 184, 16, 12, 12},
+};
+
+const TexelBlock *findTexelBlock(VkFormat format) {
+  for (const TexelBlock &block : TEXEL_BLOCKS) {
+    if (static_cast<uint32_t>(format) >= block.first && static_cast<uint32_t>(format) <= block.last) {
+      return &block;
+    }
+  }
+  return nullptr;
+}
+
+KtxTexture::KtxTexture(const std::string &path) {
+  int file = open(path.c_str(), O_RDONLY);
+  if (file < 0) {
+    return;
+  }
+  struct stat fileInfo;
+  if (fstat(file, &fileInfo) != 0 || static_cast<size_t>(fileInfo.st_size) < sizeof(Header)) {
+    close(file);
+    return;
+  }
+  this->mappingSize = static_cast<size_t>(fileInfo.st_size);
+  this->mapping = mmap(nullptr, this->mappingSize, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (this->mapping == MAP_FAILED) {
+    this->mapping = nullptr;
+    return;
+  }
+  madvise(this->mapping, this->mappingSize, MADV_SEQUENTIAL);
+  madvise(this->mapping, this->mappingSize, MADV_WILLNEED);
+
+  const Header *ktx = static_cast<const Header *>(this->mapping);
+  const uint32_t levelCount = std::max(ktx->levelCount, 1u);
+  const TexelBlock *block = findTexelBlock(ktx->vkFormat);
+  bool valid = memcmp(ktx->identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0 &&
+               block != nullptr &&
+               ktx->pixelWidth > 0 && ktx->pixelHeight > 0 && ktx->pixelDepth == 0 &&
+               ktx->layerCount <= 1 && ktx->faceCount == 1 &&
+               ktx->supercompressionScheme == 0 &&
+               levelCount <= MipGenerator::getLevelCount(ktx->pixelWidth, ktx->pixelHeight) &&
+               sizeof(Header) + levelCount * sizeof(Level) <= this->mappingSize;
+
+  size_t dataStart = SIZE_MAX, dataEnd = 0;
+  const Level *levels = reinterpret_cast<const Level *>(ktx + 1);
+  for (uint32_t level = 0; valid && level < levelCount; level++) {
+    const uint32_t width = MipGenerator::getLevelSize(ktx->pixelWidth, level);
+    const uint32_t height = MipGenerator::getLevelSize(ktx->pixelHeight, level);
+    const uint64_t expectedLength = static_cast<uint64_t>((width + block->width - 1) / block->width) *
+                                    ((height + block->height - 1) / block->height) * block->bytes;
+    valid = levels[level].byteLength == expectedLength &&
+            levels[level].uncompressedByteLength == expectedLength &&
+            levels[level].byteOffset % std::lcm(block->bytes, 4u) == 0 &&
+            levels[level].byteOffset + levels[level].byteLength <= this->mappingSize;
+    dataStart = std::min<size_t>(dataStart, levels[level].byteOffset);
+    dataEnd = std::max<size_t>(dataEnd, levels[level].byteOffset + levels[level].byteLength);
+  }
+  if (!valid) {
+    munmap(this->mapping, this->mappingSize);
+    this->mapping = nullptr;
+    return;
+  }
+  this->header = ktx;
+  this->dataStart = dataStart;
+  this->dataEnd = dataEnd;
+}
+
+KtxTexture::~KtxTexture() {
+  if (this->mapping != nullptr) {
+    munmap(this->mapping, this->mappingSize);
+  }
+}
+
+bool KtxTexture::isKtxPath(const std::string &path) { return std::filesystem::path(path).extension() == ".ktx2"; }
+
+bool KtxTexture::isValid() const { return this->header != nullptr; }
+VkFormat KtxTexture::getFormat() const { return this->header->vkFormat; }
+uint32_t KtxTexture::getWidth() const { return this->header->pixelWidth; }
+uint32_t KtxTexture::getHeight() const { return this->header->pixelHeight; }
+uint32_t KtxTexture::getLevelCount() const { return std::max(this->header->levelCount, 1u); }
+const KtxTexture::Level &KtxTexture::getLevel(uint32_t level) const {
+  return reinterpret_cast<const Level *>(this->header + 1)[level];
+}
+const uint8_t *KtxTexture::getData() const { return static_cast<const uint8_t *>(this->mapping) + this->dataStart; }
+size_t KtxTexture::getDataSize() const { return this->dataEnd - this->dataStart; }
+size_t KtxTexture::getLevelOffset(uint32_t level) const { return getLevel(level).byteOffset - this->dataStart; }
+
+// What write needs to know about each of our formats for the data format
+// descriptor, see the Khronos Data Format spec. Every sample covers a whole
+// channel of the block, from bit offset for bitLength bits.
+struct KtxFormat {
+  VkFormat linearFormat;
+  // Undefined for the formats that only ever hold linear data.
+  VkFormat srgbFormat;
+  uint8_t colorModel;
+  uint8_t blockDimension;
+  uint8_t blockBytes;
+  uint32_t sampleCount;
+  struct {
+    uint8_t channel;
+    uint16_t bitOffset;
+    uint8_t bitLength;
+    uint32_t upper;
+  } samples[4];
+};
+// Models, 1 is RGBSDA and 128 on the BCn block models. Channel 15 is alpha.
+const KtxFormat KTX_FORMATS[] = {
+  {VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB, 1, 0, 4, 4, {{0, 0, 8, 255}, {1, 8, 8, 255}, {2, 16, 8, 255}, {15, 24, 8, 255}}},
+  {VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGB_SRGB_BLOCK, 128, 3, 8, 1, {{0, 0, 64, UINT32_MAX}}},
+  {VK_FORMAT_BC4_UNORM_BLOCK, VK_FORMAT_UNDEFINED, 131, 3, 8, 1, {{0, 0, 64, UINT32_MAX}}},
+  {VK_FORMAT_BC5_UNORM_BLOCK, VK_FORMAT_UNDEFINED, 132, 3, 16, 2, {{0, 0, 64, UINT32_MAX}, {1, 64, 64, UINT32_MAX}}},
+  {VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK, 134, 3, 16, 1, {{0, 0, 128, UINT32_MAX}}},
+  {VK_FORMAT_R8_UNORM, VK_FORMAT_UNDEFINED, 1, 0, 1, 1, {{0, 0, 8, 255}}},
+  {VK_FORMAT_R8G8_UNORM, VK_FORMAT_UNDEFINED, 1, 0, 2, 2, {{0, 0, 8, 255}, {1, 8, 8, 255}}},
+};
+
+// Transfer functions, 1 is linear and 2 sRGB. In an sRGB texture alpha stays
+// linear, which the 0x10 qualifier on its channel says.
+constexpr uint32_t KTX_TRANSFER_LINEAR = 1;
+constexpr uint32_t KTX_TRANSFER_SRGB = 2;
+constexpr uint8_t KTX_CHANNEL_ALPHA = 15;
+constexpr uint8_t KTX_QUALIFIER_LINEAR = 0x10;
+
+void KtxTexture::write(const std::string &path, const uint8_t *chain, uint32_t width, uint32_t height, BlockCompressor::Format format, bool srgb) {
+  const KtxFormat &info = KTX_FORMATS[format];
+  srgb = srgb && info.srgbFormat != VK_FORMAT_UNDEFINED;
+  const uint32_t levelCount = MipGenerator::getLevelCount(width, height);
+
+  std::vector<uint32_t> descriptor = {
+    0,
+    // Version 1.3 of the spec, then the size of the basic block.
+    2u | (24u + 16u * info.sampleCount) << 16,
+    info.colorModel | 1u << 8 | (srgb ? KTX_TRANSFER_SRGB : KTX_TRANSFER_LINEAR) << 16,
+    static_cast<uint32_t>(info.blockDimension) | static_cast<uint32_t>(info.blockDimension) << 8,
+    info.blockBytes,
+    0,
+  };
+  for (uint32_t i = 0; i < info.sampleCount; i++) {
+    uint8_t channel = info.samples[i].channel;
+    if (srgb && channel == KTX_CHANNEL_ALPHA) {
+      channel |= KTX_QUALIFIER_LINEAR;
+    }
+    descriptor.push_back(info.samples[i].bitOffset | static_cast<uint32_t>(info.samples[i].bitLength - 1) << 16 |
+                         static_cast<uint32_t>(channel) << 24);
+    descriptor.push_back(0);
+    descriptor.push_back(0);
+    descriptor.push_back(info.samples[i].upper);
+  }
+  descriptor.insert(descriptor.begin(), static_cast<uint32_t>((descriptor.size() + 1) * sizeof(uint32_t)));
+
+  Header header = {
+    .identifier = {},
+    .vkFormat = srgb ? info.srgbFormat : info.linearFormat,
+    .typeSize = 1,
+    .pixelWidth = width,
+    .pixelHeight = height,
+    .pixelDepth = 0,
+    .layerCount = 0,
+    .faceCount = 1,
+    .levelCount = levelCount,
+    .supercompressionScheme = 0,
+    .dfdByteOffset = static_cast<uint32_t>(sizeof(Header) + levelCount * sizeof(Level)),
+    .dfdByteLength = static_cast<uint32_t>(descriptor.size() * sizeof(uint32_t)),
+    .kvdByteOffset = 0,
+    .kvdByteLength = 0,
+    .sgdByteOffset = 0,
+    .sgdByteLength = 0,
+  };
+  memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+
+  // Levels go smallest first, each aligned to both the block size and 4.
+  std::vector<Level> levels(levelCount);
+  const size_t alignment = std::lcm<size_t>(info.blockBytes, 4);
+  size_t offset = header.dfdByteOffset + header.dfdByteLength;
+  for (uint32_t level = levelCount; level-- > 0;) {
+    offset = (offset + alignment - 1) / alignment * alignment;
+    const size_t length = BlockCompressor::getLevelSize(MipGenerator::getLevelSize(width, level), MipGenerator::getLevelSize(height, level), format);
+    levels[level] = {.byteOffset = offset, .byteLength = length, .uncompressedByteLength = length};
+    offset += length;
+  }
+
+  const std::string tempPath = path + ".tmp";
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char *>(levels.data()), levels.size() * sizeof(Level));
+    file.write(reinterpret_cast<const char *>(descriptor.data()), descriptor.size() * sizeof(uint32_t));
+    for (uint32_t level = levelCount; level-- > 0;) {
+      const std::vector<char> padding(levels[level].byteOffset - static_cast<size_t>(file.tellp()), 0);
+      file.write(padding.data(), padding.size());
+      file.write(reinterpret_cast<const char *>(chain + BlockCompressor::getLevelOffset(width, height, level, format)), levels[level].byteLength);
+    }
+    if (!file) {
+      file.close();
+      std::filesystem::remove(tempPath);
+      return;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(tempPath, path, error);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "volk.h"
+
+#include "blockcompressor.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A KTX2 file mapped into memory. KTX2 stores the Vulkan format and every mip
+// level ready to copy into an image, so a load is a memcpy into staging and
+// no decode or mip generation at all. Only plain 2D textures are taken: no
+// arrays, cube maps, 3D images or supercompression (Basis, zstd).
+class KtxTexture {
+public:
+  struct Header {
+    uint8_t identifier[12];
+    VkFormat vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+  };
+  // Follows the header, one per level with level 0 first, although the data is stored smallest level first.
+  struct Level {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+  };
+
+  // Maps the file, if it is missing, malformed or something we can't upload
+  // as is, isValid() returns false and nothing stays mapped.
+  explicit KtxTexture(const std::string &path);
+  KtxTexture(const KtxTexture &) = delete;
+  KtxTexture &operator=(const KtxTexture &) = delete;
+  ~KtxTexture();
+
+  static bool isKtxPath(const std::string &path);
+
+  bool isValid() const;
+  VkFormat getFormat() const;
+  uint32_t getWidth() const;
+  uint32_t getHeight() const;
+  // A file with levelCount 0 asks the loader to build the chain, we take its one level as is.
+  uint32_t getLevelCount() const;
+  const Level &getLevel(uint32_t level) const;
+  // Every level sits in one span of the file, smallest first. Copying the span
+  // whole keeps the alignment the file gave each level.
+  const uint8_t *getData() const;
+  size_t getDataSize() const;
+  // Where a level starts within getData().
+  size_t getLevelOffset(uint32_t level) const;
+
+  // Writes a mip chain in one of our block formats, laid out like
+  // BlockCompressor::getChainSize, with the data format descriptor KTX2 requires.
+  // srgb picks the sRGB variant of the format where there is one, leave it off
+  // for normal maps and other data textures.
+  static void write(const std::string &path, const uint8_t *chain, uint32_t width, uint32_t height, BlockCompressor::Format format,
+                    bool srgb);
+
+private:
+  void *mapping = nullptr;
+  size_t mappingSize = 0;
+  const Header *header = nullptr;
+  size_t dataStart = 0;
+  size_t dataEnd = 0;
+};
@@ -1,13 +1,29 @@
 #include "material.h"
 
 Material::Material(const std::string &matID, Texture* diffuseTexture, Texture* metallicTexture, Texture* roughnessTexture, Texture* ambientOcclusionTexture)
-    : ID(matID), diffuseTexture(diffuseTexture), metallicTexture(metallicTexture), roughnessTexture(roughnessTexture), ambientOcclusionTexture(ambientOcclusionTexture) {}
+    : ID(matID), mode(MODE_SEPARATE), diffuseTexture(diffuseTexture), metallicTexture(metallicTexture), roughnessTexture(roughnessTexture), ambientOcclusionTexture(ambientOcclusionTexture) {}
+Material::Material(const std::string &matID, Texture* diffuseTexture, Texture* packedTexture)
+    : ID(matID), mode(MODE_PACKED), diffuseTexture(diffuseTexture), packedTexture(packedTexture) {}
 
 std::string Material::getID() const { return ID; }
+Material::Mode Material::getMode() const { return this->mode; }
 
 Texture* Material::getDiffuseTexture() { return this->diffuseTexture; }
 Texture* Material::getMetallicTexture() { return this->metallicTexture; }
 Texture* Material::getRoughnessTexture() { return this->roughnessTexture; }
 Texture* Material::getAOTexture() { return this->ambientOcclusionTexture; }
+Texture* Material::getPackedTexture() { return this->packedTexture; }
+uint32_t Material::getTextureSlot() const { return this->textureSlot; }
+void Material::setTextureSlot(uint32_t slot) { this->textureSlot = slot; }
+void Material::replaceTexture(Texture* from, Texture* to) {
+  for (Texture** texture : {&this->diffuseTexture, &this->metallicTexture, &this->roughnessTexture, &this->ambientOcclusionTexture, &this->packedTexture}) {
+    if (*texture == from) {
+      *texture = to;
+    }
+  }
+}
+uint32_t Material::getShaderSlot() const {
+  return this->mode == MODE_PACKED ? this->textureSlot | PACKED_SLOT_BIT : this->textureSlot;
+}
 
 
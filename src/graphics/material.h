@@ -5,21 +5,46 @@
 #include <string>
 
 class Material {
+public:
+  enum Mode {
+    // Diffuse, metallic, AO and roughness each in their own texture, four fetches a pixel.
+    MODE_SEPARATE,
+    // Diffuse and one ORM texture from Texture::decodePacked, two fetches a pixel.
+    MODE_PACKED,
+  };
+  // Set on the slot the shader gets for a packed material, see base.frag.
+  static constexpr uint32_t PACKED_SLOT_BIT = 1u << 31;
+
 protected:
   std::string ID;
+  Mode mode;
   Texture* diffuseTexture;
-  Texture* metallicTexture;
-  Texture* roughnessTexture;
-  Texture* ambientOcclusionTexture;
+  Texture* metallicTexture = nullptr;
+  Texture* roughnessTexture = nullptr;
+  Texture* ambientOcclusionTexture = nullptr;
+  Texture* packedTexture = nullptr;
+  // Where Buffers::createDescriptorSet put the material's textures in the bindless array.
+  uint32_t textureSlot = 0;
 
 public:
   Material(const std::string &matID, Texture* diffuseTexture, Texture* metallicTexture, Texture* roughnessTexture, Texture* ambientOcclusionTexture);
+  Material(const std::string &matID, Texture* diffuseTexture, Texture* packedTexture);
   
   std::string getID() const;
+  Mode getMode() const;
   
   Texture* getDiffuseTexture();
+  // Null in MODE_PACKED.
   Texture* getMetallicTexture();
   Texture* getRoughnessTexture();
   Texture* getAOTexture();
+  // Null in MODE_SEPARATE.
+  Texture* getPackedTexture();
+  uint32_t getTextureSlot() const;
+  void setTextureSlot(uint32_t slot);
+  // Swaps every use of from for to, see AssetCache::pollTextures.
+  void replaceTexture(Texture* from, Texture* to);
+  // The texture slot with the mode folded in, what each instance hands the shader.
+  uint32_t getShaderSlot() const;
   
 };
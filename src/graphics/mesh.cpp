@@ -0,0 +1,362 @@
+#include "buffers.h"
+#include "mesh.h"
+#include <stdexcept>
+#include "../devicelibrary.h"
+#include "../utils/helpers.h"
+
+#define TINY_OBJ_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#define VMA_STATIC_VULKAN_FUNCTIONS 0
+#define VMA_DYNAMIC_VULKAN_FUNCTIONS 1
+#include "vk_mem_alloc.h"
+#include <cstring>
+#include "../utils/timer.h"
+#include "cookedmesh.h"
+#include "meshlets.h"
+#include "objparser.h"
+#include "simplifier.h"
+#include "uploadqueue.h"
+#include "vertexcache.h"
+#include "vertexpacking.h"
+#include "vertexremap.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+// Sorting triangle clusters front to back costs a few percent of vertex cache
+// efficiency, but saves fragment work on meshes that overlap themselves.
+constexpr bool OPTIMIZE_OVERDRAW = true;
+// Every LOD level has about half the triangles of the one before it, until
+// there are this many levels or the mesh is down to a handful of triangles.
+constexpr size_t MAX_LODS = 8;
+constexpr size_t MIN_LOD_TRIANGLES = 128;
+constexpr float LOD_REDUCTION = 0.5f;
+
+Agnosia_T::Bounds buildVertices(const tinyobj::attrib_t &attrib, const std::vector<tinyobj::shape_t> &shapes,
+                                std::vector<Agnosia_T::Vertex> &vertices, std::vector<uint32_t> &indices) {
+  // Most meshes end up with roughly one unique vertex per position, a fine first guess for the table size.
+  VertexRemap remap(attrib.vertices.size() / 3);
+  size_t cornerCount = 0;
+  for (const auto &shape : shapes) {
+    cornerCount += shape.mesh.indices.size();
+  }
+  indices.reserve(indices.size() + cornerCount);
+
+  for (const auto &shape : shapes) {
+    // Both loaders triangulate, so the corners always come in threes.
+    for (size_t face = 0; face + 2 < shape.mesh.indices.size(); face += 3) {
+      Agnosia_T::Vertex corners[3]{};
+      for (int corner = 0; corner < 3; corner++) {
+        const tinyobj::index_t &index = shape.mesh.indices[face + corner];
+        Agnosia_T::Vertex &vertex = corners[corner];
+
+        vertex.pos = {attrib.vertices[3 * index.vertex_index + 0],
+                      attrib.vertices[3 * index.vertex_index + 1],
+                      attrib.vertices[3 * index.vertex_index + 2]};
+        // Models exported without UV's get (0, 0) everywhere, which samples a
+        // single texel instead of crashing on the texcoord lookup.
+        if (index.texcoord_index >= 0) {
+          vertex.uv = {attrib.texcoords[2 * index.texcoord_index + 0],
+                       1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+        }
+        if (index.normal_index >= 0) {
+          vertex.normal = {attrib.normals[3 * index.normal_index + 0],
+                           attrib.normals[3 * index.normal_index + 1],
+                           attrib.normals[3 * index.normal_index + 2]};
+        }
+        vertex.color = {1.0f, 1.0f, 1.0f};
+      }
+      // Missing normals are replaced by the face normal, so those models come out flat shaded.
+      const glm::vec3 faceNormal = glm::cross(corners[1].pos - corners[0].pos, corners[2].pos - corners[0].pos);
+      const float faceNormalLength = glm::length(faceNormal);
+      for (int corner = 0; corner < 3; corner++) {
+        Agnosia_T::Vertex &vertex = corners[corner];
+        if (shape.mesh.indices[face + corner].normal_index < 0 && faceNormalLength > 0.0f) {
+          vertex.normal = faceNormal / faceNormalLength;
+        }
+        indices.push_back(remap.insert(vertex));
+      }
+    }
+  }
+  vertices = std::move(remap.getVertices());
+
+  Agnosia_T::Bounds bounds = {
+    .min = glm::vec3(std::numeric_limits<float>::max()),
+    .max = glm::vec3(std::numeric_limits<float>::lowest()),
+    .radius = 0.0f,
+  };
+  for (const Agnosia_T::Vertex &vertex : vertices) {
+    bounds.min = glm::min(bounds.min, vertex.pos);
+    bounds.max = glm::max(bounds.max, vertex.pos);
+  }
+  const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+  for (const Agnosia_T::Vertex &vertex : vertices) {
+    bounds.radius = std::max(bounds.radius, glm::length(vertex.pos - center));
+  }
+  return bounds;
+}
+
+Agnosia_T::Bounds Mesh::loadObj(const std::string &modelPath, std::vector<Agnosia_T::Vertex> &vertices, std::vector<uint32_t> &indices) {
+#ifdef AGNOSIA_TINYOBJ
+  tinyobj::ObjReaderConfig readerConfig;
+  tinyobj::ObjReader reader;
+
+  if (!reader.ParseFromFile(modelPath, readerConfig)) {
+    if (!reader.Error().empty()) {
+      throw std::runtime_error(reader.Error());
+    }
+    if (!reader.Warning().empty()) {
+      throw std::runtime_error(reader.Warning());
+    }
+  }
+  return buildVertices(reader.GetAttrib(), reader.GetShapes(), vertices, indices);
+#else
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  ObjParser::parse(modelPath, attrib, shapes);
+  return buildVertices(attrib, shapes, vertices, indices);
+#endif
+}
+
+Agnosia_T::CacheStats Mesh::optimizeMesh(std::vector<Agnosia_T::Vertex> &vertices, std::vector<uint32_t> &indices) {
+  VertexCache::optimizeTriangleOrder(indices, vertices.size());
+  if (OPTIMIZE_OVERDRAW) {
+    VertexCache::optimizeOverdraw(indices, vertices);
+  }
+  // Has to run last, the vertex order follows whatever order the triangles ended up in.
+  VertexCache::optimizeVertexFetch(vertices, indices);
+  return VertexCache::analyze(indices, vertices.size());
+}
+
+std::vector<Agnosia_T::LodLevel> Mesh::buildLods(const std::vector<Agnosia_T::Vertex> &vertices, std::vector<uint32_t> &indices) {
+  std::vector<Agnosia_T::LodLevel> lods = {{0, static_cast<uint32_t>(indices.size()), 0.0f}};
+  std::vector<uint32_t> previous = indices;
+  float error = 0.0f;
+  while (lods.size() < MAX_LODS && previous.size() / 3 > MIN_LOD_TRIANGLES) {
+    std::vector<uint32_t> level;
+    const float levelError = Simplifier::simplify(vertices, previous, static_cast<size_t>(previous.size() * LOD_REDUCTION), FLT_MAX, level);
+    // Seams and borders can pin most of a mesh in place, a level that barely shrank isn't worth the memory.
+    if (level.size() > previous.size() * 0.9) {
+      break;
+    }
+    VertexCache::optimizeTriangleOrder(level, vertices.size());
+    // Every level is simplified from the one before it, so the errors add up.
+    error += levelError;
+    lods.push_back({static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(level.size()), error});
+    indices.insert(indices.end(), level.begin(), level.end());
+    previous = std::move(level);
+  }
+  return lods;
+}
+
+Mesh::Mesh(const std::string &meshPath, Agnosia_T::VertexFormat vertexFormat)
+  : ID(getMeshID(meshPath, vertexFormat)), meshPath(meshPath), vertexFormat(vertexFormat) {
+  Timer loadTimer;
+
+  // Prefer the cooked binary next to the OBJ, it is only rebuilt when it's missing or the OBJ changed.
+  const std::string cookedPath = CookedMesh::getCookedPath(this->meshPath);
+  CookedMesh cookedMesh(cookedPath, this->meshPath);
+  this->cooked = cookedMesh.isValid();
+
+  if (this->cooked) {
+    this->bounds = cookedMesh.getBounds();
+    this->cacheBefore = cookedMesh.getCacheBefore();
+    this->cacheAfter = cookedMesh.getCacheAfter();
+    this->lods.assign(cookedMesh.getLods(), cookedMesh.getLods() + cookedMesh.getLodCount());
+    uploadBuffers({
+      .vertices = cookedMesh.getVertices(), .vertexCount = cookedMesh.getVertexCount(),
+      .indices = cookedMesh.getIndices(), .indexCount = cookedMesh.getIndexCount(),
+      .meshlets = cookedMesh.getMeshlets(), .meshletCount = cookedMesh.getMeshletCount(),
+      .meshletVertices = cookedMesh.getMeshletVertices(), .meshletVertexCount = cookedMesh.getMeshletVertexCount(),
+      .meshletTriangles = cookedMesh.getMeshletTriangles(), .meshletTriangleBytes = cookedMesh.getMeshletTriangleBytes(),
+    });
+  } else {
+    Agnosia_T::MeshData mesh;
+    mesh.bounds = loadObj(this->meshPath, mesh.vertices, mesh.indices);
+    mesh.cacheBefore = VertexCache::analyze(mesh.indices, mesh.vertices.size());
+    mesh.cacheAfter = optimizeMesh(mesh.vertices, mesh.indices);
+    mesh.lods = buildLods(mesh.vertices, mesh.indices);
+    // Only the full detail level gets clustered, the coarser ones are cheap enough to draw whole.
+    Meshlets::build(mesh.vertices, mesh.indices.data(), mesh.lods.front().indexCount, mesh.meshlets, mesh.meshletVertices, mesh.meshletTriangles);
+    CookedMesh::write(cookedPath, this->meshPath, mesh);
+
+    this->bounds = mesh.bounds;
+    this->cacheBefore = mesh.cacheBefore;
+    this->cacheAfter = mesh.cacheAfter;
+    this->lods = mesh.lods;
+    uploadBuffers({
+      .vertices = mesh.vertices.data(), .vertexCount = mesh.vertices.size(),
+      .indices = mesh.indices.data(), .indexCount = mesh.indices.size(),
+      .meshlets = mesh.meshlets.data(), .meshletCount = mesh.meshlets.size(),
+      .meshletVertices = mesh.meshletVertices.data(), .meshletVertexCount = mesh.meshletVertices.size(),
+      .meshletTriangles = mesh.meshletTriangles.data(), .meshletTriangleBytes = mesh.meshletTriangles.size(),
+    });
+  }
+  this->loadTime = loadTimer.elapsedMs();
+}
+
+void Mesh::uploadBuffers(const Agnosia_T::MeshView &mesh) {
+  struct Upload {
+    size_t count;
+    size_t stride;
+    GeometryPool::Kind pool;
+    GeometryPool::Range *range;
+    // Fills count elements of staging memory, starting at element first.
+    std::function<void(void *destination, size_t first, size_t count)> write;
+  };
+  using Write = std::function<void(void *, size_t, size_t)>;
+  auto copyFrom = [](const void *source, size_t stride) {
+    return [=](void *destination, size_t first, size_t count) {
+      memcpy(destination, static_cast<const char *>(source) + first * stride, count * stride);
+    };
+  };
+
+  // The cooked file always keeps full vertices, packing is cheap enough to do
+  // per load and lets a mesh switch formats without recooking. Packed vertices
+  // are written straight into the staging buffer.
+  size_t vertexStride = sizeof(Agnosia_T::Vertex);
+  Write writeVertices = copyFrom(mesh.vertices, vertexStride);
+  this->vertexPool = GeometryPool::POOL_VERTICES_FULL;
+  if (this->vertexFormat == Agnosia_T::VERTEX_PACKED) {
+    vertexStride = sizeof(Agnosia_T::PackedVertex);
+    this->vertexPool = GeometryPool::POOL_VERTICES_PACKED;
+    writeVertices = [&](void *destination, size_t first, size_t count) {
+      VertexPacking::packAll(mesh.vertices + first, count, this->bounds, static_cast<Agnosia_T::PackedVertex *>(destination));
+    };
+    this->packingError = VertexPacking::measureError(mesh.vertices, mesh.vertexCount, this->bounds);
+  }
+
+  // Every LOD level indexes the same vertex buffer, so one width fits the whole
+  // index buffer. Small meshes get 16 bit indices at half the memory and bandwidth,
+  // 0xFFFF stays unused since it restarts the strip on pipelines with primitive restart.
+  size_t indexStride = sizeof(uint32_t);
+  Write writeIndices = copyFrom(mesh.indices, indexStride);
+  this->indexType = VK_INDEX_TYPE_UINT32;
+  this->indexPool = GeometryPool::POOL_INDICES_32;
+  if (mesh.vertexCount <= std::numeric_limits<uint16_t>::max()) {
+    this->indexType = VK_INDEX_TYPE_UINT16;
+    this->indexPool = GeometryPool::POOL_INDICES_16;
+    indexStride = sizeof(uint16_t);
+    writeIndices = [&](void *destination, size_t first, size_t count) {
+      std::copy(mesh.indices + first, mesh.indices + first + count, static_cast<uint16_t *>(destination));
+    };
+  }
+  this->indexBytesSaved = mesh.indexCount * (sizeof(uint32_t) - indexStride);
+
+  const Upload uploads[] = {
+    {mesh.vertexCount, vertexStride, this->vertexPool, &this->vertexRange, writeVertices},
+    {mesh.indexCount, indexStride, this->indexPool, &this->indexRange, writeIndices},
+    {mesh.meshletCount, sizeof(Agnosia_T::Meshlet), GeometryPool::POOL_MESHLETS,
+     &this->meshletRange, copyFrom(mesh.meshlets, sizeof(Agnosia_T::Meshlet))},
+    {mesh.meshletVertexCount, sizeof(uint32_t), GeometryPool::POOL_MESHLETS,
+     &this->meshletVertexRange, copyFrom(mesh.meshletVertices, sizeof(uint32_t))},
+    {mesh.meshletTriangleBytes, 1, GeometryPool::POOL_MESHLETS,
+     &this->meshletTriangleRange, copyFrom(mesh.meshletTriangles, 1)},
+  };
+
+  // Every range first, growing a pool moves what's already in it. A mesh
+  // without meshlets just has no ranges for them.
+  for (const Upload &upload : uploads) {
+    if (upload.count != 0) {
+      GeometryPool &pool = GeometryPool::get(upload.pool);
+      pool.allocate(*upload.range, (upload.count * upload.stride + pool.getStride() - 1) / pool.getStride());
+    }
+  }
+  // Each range streams through the staging ring a chunk at a time into the
+  // upload batches, a big mesh never holds more than a few chunks of staging
+  // memory and never the whole mesh twice over. Pools that came back mapped
+  // are written in place instead.
+  for (const Upload &upload : uploads) {
+    if (upload.count == 0) {
+      continue;
+    }
+    GeometryPool &pool = GeometryPool::get(upload.pool);
+    const VkDeviceSize start = upload.range->offset * pool.getStride();
+    if (pool.getMapped() != nullptr) {
+      upload.write(static_cast<char *>(pool.getMapped()) + start, 0, upload.count);
+      pool.flush(*upload.range);
+      continue;
+    }
+    const VkBuffer buffer = pool.getBuffer();
+    UploadQueue::stageChunked(upload.count, upload.stride, upload.write,
+                              [&](VkCommandBuffer cmd, VkBuffer staging, VkDeviceSize offset, size_t first, size_t count) {
+      const VkBufferCopy copy = {.srcOffset = offset, .dstOffset = start + first * upload.stride, .size = count * upload.stride};
+      vkCmdCopyBuffer(cmd, staging, buffer, 1, &copy);
+    });
+  }
+
+  this->verticeCount = mesh.vertexCount;
+  // The buffer holds every LOD level, the polycount is the one of the full mesh.
+  this->indiceCount = this->lods.front().indexCount;
+  this->meshletCount = mesh.meshletCount;
+  this->uvDensity = measureUvDensity(mesh.vertices, mesh.indices, this->indiceCount);
+}
+
+float Mesh::measureUvDensity(const Agnosia_T::Vertex *vertices, const uint32_t *indices, size_t indexCount) {
+  // The ratio of the areas is squared, a mesh scaled up twice covers four times
+  // the surface with the same UVs.
+  double uvArea = 0.0, surfaceArea = 0.0;
+  for (size_t i = 0; i + 2 < indexCount; i += 3) {
+    const Agnosia_T::Vertex &a = vertices[indices[i]];
+    const Agnosia_T::Vertex &b = vertices[indices[i + 1]];
+    const Agnosia_T::Vertex &c = vertices[indices[i + 2]];
+    const glm::vec2 uvEdge0 = b.uv - a.uv, uvEdge1 = c.uv - a.uv;
+    uvArea += std::abs(uvEdge0.x * uvEdge1.y - uvEdge0.y * uvEdge1.x) * 0.5;
+    surfaceArea += glm::length(glm::cross(b.pos - a.pos, c.pos - a.pos)) * 0.5;
+  }
+  return surfaceArea > 0.0 ? static_cast<float>(std::sqrt(uvArea / surfaceArea)) : 0.0f;
+}
+
+Mesh::~Mesh() {
+  // Only the last instance going away gets here, see AssetCache::releaseMesh.
+  // The pools hold on to the ranges until the frames in flight are done.
+  GeometryPool::get(this->vertexPool).free(this->vertexRange);
+  GeometryPool::get(this->indexPool).free(this->indexRange);
+  for (GeometryPool::Range *range : {&this->meshletRange, &this->meshletVertexRange, &this->meshletTriangleRange}) {
+    GeometryPool::get(GeometryPool::POOL_MESHLETS).free(*range);
+  }
+}
+
+std::string Mesh::getMeshID(const std::string &meshPath, Agnosia_T::VertexFormat vertexFormat) {
+  // The same file in both formats is two meshes, in two different vertex pools.
+  return vertexFormat == Agnosia_T::VERTEX_PACKED ? meshPath + "#packed" : meshPath;
+}
+
+std::string Mesh::getID() { return this->ID; }
+std::string Mesh::getMeshPath() { return this->meshPath; }
+Agnosia_T::GPUMeshBuffers Mesh::getBuffers() {
+  GeometryPool &vertexPool = GeometryPool::get(this->vertexPool);
+  GeometryPool &indexPool = GeometryPool::get(this->indexPool);
+  GeometryPool &meshletPool = GeometryPool::get(GeometryPool::POOL_MESHLETS);
+  auto meshletAddress = [&](const GeometryPool::Range &range) -> VkDeviceAddress {
+    return range.allocation != VK_NULL_HANDLE ? meshletPool.getAddress() + range.offset * meshletPool.getStride() : 0;
+  };
+  return {
+    .indexBuffer = indexPool.getBuffer(),
+    .indexType = this->indexType,
+    .firstIndex = static_cast<uint32_t>(this->indexRange.offset),
+    .vertexBufferAddress = vertexPool.getAddress(),
+    .vertexOffset = static_cast<int32_t>(this->vertexRange.offset),
+    .meshletBufferAddress = meshletAddress(this->meshletRange),
+    .meshletVertexBufferAddress = meshletAddress(this->meshletVertexRange),
+    .meshletTriangleBufferAddress = meshletAddress(this->meshletTriangleRange),
+  };
+}
+uint32_t Mesh::getIndices() { return this->indiceCount; }
+uint32_t Mesh::getVertices() { return this->verticeCount; }
+Agnosia_T::Bounds &Mesh::getBounds() { return this->bounds; }
+double Mesh::getLoadTime() { return this->loadTime; }
+bool Mesh::isCooked() { return this->cooked; }
+Agnosia_T::CacheStats Mesh::getCacheBefore() { return this->cacheBefore; }
+Agnosia_T::CacheStats Mesh::getCacheAfter() { return this->cacheAfter; }
+const std::vector<Agnosia_T::LodLevel> &Mesh::getLods() { return this->lods; }
+uint32_t Mesh::getMeshletCount() { return this->meshletCount; }
+Agnosia_T::VertexFormat Mesh::getVertexFormat() { return this->vertexFormat; }
+Agnosia_T::PackingError Mesh::getPackingError() { return this->packingError; }
+size_t Mesh::getIndexBytesSaved() { return this->indexBytesSaved; }
+float Mesh::getUvDensity() { return this->uvDensity; }
+uint32_t Mesh::getReferences() { return this->references; }
+VkMemoryPropertyFlags Mesh::getMemoryFlags() { return GeometryPool::get(this->vertexPool).getMemoryFlags(); }
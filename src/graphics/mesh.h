@@ -0,0 +1,90 @@
+#pragma once
+
+#include "volk.h"
+
+#include "../utils/types.h"
+#include "geometrypool.h"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// The geometry of one OBJ on the GPU, shared by every Model placed with it.
+// Loaded and reference counted through AssetCache::fetchLoadMesh, its ranges
+// of the geometry pools are freed when the last Model using it is removed.
+class Mesh {
+  friend class AssetCache;
+
+protected:
+  std::string ID;
+  std::string meshPath;
+  // Its pieces of the geometry pools, see getBuffers.
+  GeometryPool::Kind vertexPool;
+  GeometryPool::Kind indexPool;
+  VkIndexType indexType;
+  GeometryPool::Range vertexRange;
+  GeometryPool::Range indexRange;
+  GeometryPool::Range meshletRange;
+  GeometryPool::Range meshletVertexRange;
+  GeometryPool::Range meshletTriangleRange;
+  uint32_t verticeCount;
+  uint32_t indiceCount;
+  Agnosia_T::Bounds bounds;
+  double loadTime;
+  bool cooked;
+  Agnosia_T::CacheStats cacheBefore;
+  Agnosia_T::CacheStats cacheAfter;
+  std::vector<Agnosia_T::LodLevel> lods;
+  uint32_t meshletCount = 0;
+  Agnosia_T::VertexFormat vertexFormat;
+  Agnosia_T::PackingError packingError{};
+  size_t indexBytesSaved = 0;
+  float uvDensity = 0.0f;
+  // Models using this mesh, only AssetCache touches it.
+  uint32_t references = 0;
+
+  void uploadBuffers(const Agnosia_T::MeshView &mesh);
+
+public:
+  // vertexFormat picks the GPU vertex layout, VERTEX_PACKED trades a little
+  // precision (see getPackingError) for vertices almost three times smaller.
+  Mesh(const std::string &meshPath, Agnosia_T::VertexFormat vertexFormat = Agnosia_T::VERTEX_FULL);
+  Mesh(const Mesh &) = delete;
+  Mesh &operator=(const Mesh &) = delete;
+  ~Mesh();
+
+  // The key AssetCache stores a mesh under, the path plus the vertex format.
+  static std::string getMeshID(const std::string &meshPath, Agnosia_T::VertexFormat vertexFormat);
+
+  // Parse an OBJ into a deduplicated vertex and index list, no GPU work involved.
+  static Agnosia_T::Bounds loadObj(const std::string &meshPath, std::vector<Agnosia_T::Vertex> &vertices, std::vector<uint32_t> &indices);
+  // Reorder the triangles and vertices of a loaded mesh for the GPU caches, returns the cache stats of the new order.
+  static Agnosia_T::CacheStats optimizeMesh(std::vector<Agnosia_T::Vertex> &vertices, std::vector<uint32_t> &indices);
+  // Simplify the mesh into coarser and coarser levels, appending their indices after the full detail ones.
+  static std::vector<Agnosia_T::LodLevel> buildLods(const std::vector<Agnosia_T::Vertex> &vertices, std::vector<uint32_t> &indices);
+
+  std::string getID();
+  std::string getMeshPath();
+  // Where the geometry is this frame, a compaction may move it by the next.
+  Agnosia_T::GPUMeshBuffers getBuffers();
+  uint32_t getIndices();
+  uint32_t getVertices();
+  Agnosia_T::Bounds &getBounds();
+  double getLoadTime();
+  bool isCooked();
+  Agnosia_T::CacheStats getCacheBefore();
+  Agnosia_T::CacheStats getCacheAfter();
+  const std::vector<Agnosia_T::LodLevel> &getLods();
+  uint32_t getMeshletCount();
+  Agnosia_T::VertexFormat getVertexFormat();
+  // Worst case precision lost by packing, all zero for VERTEX_FULL meshes.
+  Agnosia_T::PackingError getPackingError();
+  // Bytes 16 bit indices saved over 32 bit ones, 0 for meshes too big for them.
+  size_t getIndexBytesSaved();
+  // UV units per unit of model space, averaged over the surface. Times a
+  // texture's size it gives the texels a unit of the mesh is covered with.
+  static float measureUvDensity(const Agnosia_T::Vertex *vertices, const uint32_t *indices, size_t indexCount);
+  float getUvDensity();
+  uint32_t getReferences();
+  // Where the geometry ended up, see Buffers::getMemoryName.
+  VkMemoryPropertyFlags getMemoryFlags();
+};
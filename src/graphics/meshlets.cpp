@@ -0,0 +1,222 @@
+#include "meshlets.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// How much the next triangle's facing counts against the new vertices it
+// needs. Keeping a meshlet's normals together keeps its cone narrow enough to
+// ever cull, at the cost of a few more, smaller meshlets.
+constexpr float CONE_WEIGHT = 0.5f;
+constexpr uint8_t NOT_IN_MESHLET = 0xFF;
+// How far ahead in index order, and how closely aligned, a disconnected
+// triangle may be to still join a meshlet.
+constexpr size_t FALLBACK_WINDOW = 64;
+constexpr float FALLBACK_FACING = 0.5f;
+
+void emitMeshlet(const std::vector<Agnosia_T::Vertex> &vertices, const uint32_t *indices,
+                 const std::vector<glm::vec3> &normals, const std::vector<uint32_t> &clusterVertices,
+                 const std::vector<uint32_t> &clusterTriangles, const std::vector<uint8_t> &local,
+                 std::vector<Agnosia_T::Meshlet> &meshlets, std::vector<uint32_t> &meshletVertices,
+                 std::vector<uint8_t> &meshletTriangles) {
+  Agnosia_T::Meshlet &meshlet = meshlets.emplace_back();
+  meshlet.vertexOffset = static_cast<uint32_t>(meshletVertices.size());
+  meshlet.vertexCount = static_cast<uint32_t>(clusterVertices.size());
+  meshlet.triangleOffset = static_cast<uint32_t>(meshletTriangles.size());
+  meshlet.triangleCount = static_cast<uint32_t>(clusterTriangles.size());
+  meshletVertices.insert(meshletVertices.end(), clusterVertices.begin(), clusterVertices.end());
+  for (uint32_t triangle : clusterTriangles) {
+    for (int corner = 0; corner < 3; corner++) {
+      meshletTriangles.push_back(local[indices[triangle * 3 + corner]]);
+    }
+  }
+  // Shaders read the local indices as packed uints, each meshlet starts on one.
+  meshletTriangles.resize((meshletTriangles.size() + 3) & ~size_t(3), 0);
+
+  glm::vec3 boxMin(std::numeric_limits<float>::max());
+  glm::vec3 boxMax(std::numeric_limits<float>::lowest());
+  for (uint32_t vertex : clusterVertices) {
+    boxMin = glm::min(boxMin, vertices[vertex].pos);
+    boxMax = glm::max(boxMax, vertices[vertex].pos);
+  }
+  meshlet.center = (boxMin + boxMax) * 0.5f;
+  for (uint32_t vertex : clusterVertices) {
+    meshlet.radius = std::max(meshlet.radius, glm::length(vertices[vertex].pos - meshlet.center));
+  }
+
+  // The cone axis is the average facing. If any triangle is 90 degrees or more
+  // off it, there is no camera position that sees all of them from behind.
+  glm::vec3 normalSum(0.0f);
+  for (uint32_t triangle : clusterTriangles) {
+    normalSum += normals[triangle];
+  }
+  meshlet.coneApex = meshlet.center;
+  meshlet.coneCutoff = 1.0f;
+  const float sumLength = glm::length(normalSum);
+  if (sumLength < 1e-6f) {
+    return;
+  }
+  meshlet.coneAxis = normalSum / sumLength;
+  float minDot = 1.0f;
+  for (uint32_t triangle : clusterTriangles) {
+    if (normals[triangle] != glm::vec3(0.0f)) {
+      minDot = std::min(minDot, glm::dot(normals[triangle], meshlet.coneAxis));
+    }
+  }
+  if (minDot <= 0.0f) {
+    return;
+  }
+  // Slide the apex back along the axis until it's behind every triangle's
+  // plane, the cone test is only conservative from there.
+  float apexDistance = 0.0f;
+  for (uint32_t triangle : clusterTriangles) {
+    const glm::vec3 &normal = normals[triangle];
+    if (normal == glm::vec3(0.0f)) {
+      continue;
+    }
+    const glm::vec3 &corner = vertices[indices[triangle * 3]].pos;
+    apexDistance = std::max(apexDistance, glm::dot(meshlet.center - corner, normal) / glm::dot(meshlet.coneAxis, normal));
+  }
+  meshlet.coneApex = meshlet.center - meshlet.coneAxis * apexDistance;
+  meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+void Meshlets::build(const std::vector<Agnosia_T::Vertex> &vertices, const uint32_t *indices, size_t indexCount,
+                     std::vector<Agnosia_T::Meshlet> &meshlets, std::vector<uint32_t> &meshletVertices,
+                     std::vector<uint8_t> &meshletTriangles) {
+  const size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // Vertex -> triangle adjacency, packed into one array with per vertex offsets.
+  std::vector<uint32_t> adjacencyOffsets(vertices.size() + 1, 0);
+  for (size_t i = 0; i < triangleCount * 3; i++) {
+    adjacencyOffsets[indices[i] + 1]++;
+  }
+  for (size_t vertex = 0; vertex < vertices.size(); vertex++) {
+    adjacencyOffsets[vertex + 1] += adjacencyOffsets[vertex];
+  }
+  std::vector<uint32_t> adjacency(triangleCount * 3);
+  {
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+      adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+  }
+
+  std::vector<glm::vec3> normals(triangleCount);
+  for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+    const glm::vec3 &a = vertices[indices[triangle * 3 + 0]].pos;
+    const glm::vec3 &b = vertices[indices[triangle * 3 + 1]].pos;
+    const glm::vec3 &c = vertices[indices[triangle * 3 + 2]].pos;
+    const glm::vec3 normal = glm::cross(b - a, c - a);
+    const float length = glm::length(normal);
+    normals[triangle] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+  }
+
+  std::vector<bool> used(triangleCount, false);
+  std::vector<uint8_t> local(vertices.size(), NOT_IN_MESHLET);
+  std::vector<uint32_t> clusterVertices;
+  std::vector<uint32_t> clusterTriangles;
+  std::vector<uint32_t> candidates;
+  glm::vec3 normalSum(0.0f);
+  size_t cursor = 0;
+
+  auto addTriangle = [&](uint32_t triangle) {
+    used[triangle] = true;
+    clusterTriangles.push_back(triangle);
+    normalSum += normals[triangle];
+    for (int corner = 0; corner < 3; corner++) {
+      const uint32_t vertex = indices[triangle * 3 + corner];
+      if (local[vertex] != NOT_IN_MESHLET) {
+        continue;
+      }
+      local[vertex] = static_cast<uint8_t>(clusterVertices.size());
+      clusterVertices.push_back(vertex);
+      for (uint32_t i = adjacencyOffsets[vertex]; i < adjacencyOffsets[vertex + 1]; i++) {
+        if (!used[adjacency[i]]) {
+          candidates.push_back(adjacency[i]);
+        }
+      }
+    }
+  };
+  auto finish = [&]() {
+    emitMeshlet(vertices, indices, normals, clusterVertices, clusterTriangles, local, meshlets, meshletVertices, meshletTriangles);
+    for (uint32_t vertex : clusterVertices) {
+      local[vertex] = NOT_IN_MESHLET;
+    }
+    clusterVertices.clear();
+    clusterTriangles.clear();
+    candidates.clear();
+    normalSum = glm::vec3(0.0f);
+  };
+
+  while (true) {
+    if (clusterTriangles.empty()) {
+      // Seed with the next unused triangle in index order, after the vertex
+      // cache pass that is close to where the last meshlet ended.
+      while (cursor < triangleCount && used[cursor]) {
+        cursor++;
+      }
+      if (cursor == triangleCount) {
+        break;
+      }
+      addTriangle(static_cast<uint32_t>(cursor));
+      continue;
+    }
+    if (clusterTriangles.size() == MAX_TRIANGLES) {
+      finish();
+      continue;
+    }
+
+    // Grow through the triangles touching the meshlet, preferring the ones that
+    // bring the fewest new vertices, then the ones facing the same way.
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](uint32_t triangle) { return used[triangle]; }), candidates.end());
+    const float sumLength = glm::length(normalSum);
+    const glm::vec3 facing = sumLength > 0.0f ? normalSum / sumLength : glm::vec3(0.0f);
+    uint32_t best = UINT32_MAX;
+    float bestScore = std::numeric_limits<float>::max();
+    for (uint32_t triangle : candidates) {
+      uint32_t newVertices = 0;
+      for (int corner = 0; corner < 3; corner++) {
+        newVertices += local[indices[triangle * 3 + corner]] == NOT_IN_MESHLET ? 1 : 0;
+      }
+      if (clusterVertices.size() + newVertices > MAX_VERTICES) {
+        continue;
+      }
+      const float score = newVertices + CONE_WEIGHT * (1.0f - glm::dot(normals[triangle], facing));
+      if (score < bestScore) {
+        bestScore = score;
+        best = triangle;
+      }
+    }
+    if (best == UINT32_MAX) {
+      // Nothing connected fits, which on flat shaded meshes (no shared
+      // vertices) is right away. Fall back to the next unused triangles in
+      // index order, the vertex cache pass keeps those nearby, as long as they
+      // roughly face the same way.
+      for (size_t triangle = cursor; triangle < triangleCount && triangle < cursor + FALLBACK_WINDOW; triangle++) {
+        if (used[triangle] || clusterVertices.size() + 3 > MAX_VERTICES ||
+            glm::dot(normals[triangle], facing) < FALLBACK_FACING) {
+          continue;
+        }
+        best = static_cast<uint32_t>(triangle);
+        break;
+      }
+    }
+    if (best == UINT32_MAX) {
+      finish();
+      continue;
+    }
+    addTriangle(best);
+  }
+  if (!clusterTriangles.empty()) {
+    finish();
+  }
+}
+
+bool Meshlets::isBackfacing(const Agnosia_T::Meshlet &meshlet, const glm::vec3 &cameraPos) {
+  const glm::vec3 toApex = meshlet.coneApex - cameraPos;
+  const float distance = glm::length(toApex);
+  return meshlet.coneCutoff < 1.0f && distance > 0.0f && glm::dot(toApex, meshlet.coneAxis) >= meshlet.coneCutoff * distance;
+}
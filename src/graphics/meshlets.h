@@ -0,0 +1,27 @@
+#pragma once
+
+#include "../utils/types.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Splits a triangle list into small clusters (meshlets) of neighboring
+// triangles, each with its own bounding sphere and normal cone so whole
+// clusters can be culled against the frustum or as backfacing at once.
+class Meshlets {
+public:
+  // Budgets that fit a mesh shader workgroup and keep the local indices in a byte.
+  static constexpr uint32_t MAX_VERTICES = 64;
+  static constexpr uint32_t MAX_TRIANGLES = 124;
+
+  // Appends the clusters for indices to the meshlet arrays of mesh. Meshlet
+  // vertices index into vertices, triangles are three local vertex indices
+  // each, and every meshlet's triangles start on a 4 byte boundary.
+  static void build(const std::vector<Agnosia_T::Vertex> &vertices, const uint32_t *indices, size_t indexCount,
+                    std::vector<Agnosia_T::Meshlet> &meshlets, std::vector<uint32_t> &meshletVertices,
+                    std::vector<uint8_t> &meshletTriangles);
+
+  // The cone test a culling pass would run, true if every triangle of the
+  // meshlet faces away from a camera at cameraPos (in the mesh's space).
+  static bool isBackfacing(const Agnosia_T::Meshlet &meshlet, const glm::vec3 &cameraPos);
+};
@@ -0,0 +1,232 @@
+#include "mipdownsampler.h"
+#include "../devicelibrary.h"
+#include "../utils/deletion.h"
+#include "../utils/helpers.h"
+#include "buffers.h"
+#include "mipgen.h"
+#include "shader.h"
+#include "uploadqueue.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <vector>
+
+Agnosia_T::Pipeline downsamplePipeline = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+bool downsamplerEnabled = true;
+// Images share the storage slots round robin, each slot remembers the last
+// upload batch reading it.
+std::vector<UploadQueue::Ticket> slotTickets;
+uint32_t nextSlot = 0;
+
+// Matches the push constant block of downsample.comp.
+struct DownsampleConstants {
+  uint32_t sourceLevel;
+  uint32_t levelCount;
+  uint32_t srgb;
+  uint32_t firstSlot;
+};
+
+// Workgroups are 16x16, one thread per texel of the first level a dispatch writes.
+constexpr uint32_t DOWNSAMPLE_GROUP_SIZE = 16;
+
+void MipDownsampler::createPipeline() {
+  VkPhysicalDeviceFeatures features;
+  vkGetPhysicalDeviceFeatures(DeviceControl::getPhysicalDevice(), &features);
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(DeviceControl::getPhysicalDevice(), VK_FORMAT_R8G8B8A8_UNORM, &properties);
+  if (!features.shaderStorageImageArrayDynamicIndexing ||
+      !(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+    return;
+  }
+
+  Shader shader(VK_SHADER_STAGE_COMPUTE_BIT, std::filesystem::path("src/shaders/downsample.comp"));
+
+  VkPushConstantRange pushConstant = {
+    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    .offset = 0,
+    .size = sizeof(DownsampleConstants),
+  };
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .setLayoutCount = 1,
+    .pSetLayouts = &Buffers::getTextureDescriptorSetLayouts(),
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &pushConstant,
+  };
+  VK_CHECK(vkCreatePipelineLayout(DeviceControl::getDevice(), &pipelineLayoutInfo, nullptr, &downsamplePipeline.layout));
+
+  VkComputePipelineCreateInfo pipelineInfo = {
+    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .stage = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+      .module = shader.GetShaderModule(),
+      .pName = "main",
+    },
+    .layout = downsamplePipeline.layout,
+  };
+  VK_CHECK(vkCreateComputePipelines(DeviceControl::getDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &downsamplePipeline.pipeline));
+
+  const Agnosia_T::Pipeline pipeline = downsamplePipeline;
+  DeletionQueue::get().push_function([=](){vkDestroyPipeline(DeviceControl::getDevice(), pipeline.pipeline, nullptr);});
+  DeletionQueue::get().push_function([=](){vkDestroyPipelineLayout(DeviceControl::getDevice(), pipeline.layout, nullptr);});
+}
+
+bool MipDownsampler::supports(VkFormat format) {
+  // The levels are written through the texture set, it has to exist already.
+  return downsamplerEnabled && downsamplePipeline.pipeline != VK_NULL_HANDLE &&
+         Buffers::getTextureDescriptorSets() != VK_NULL_HANDLE &&
+         (format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB);
+}
+VkImageCreateFlags MipDownsampler::getImageFlags() {
+  return VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+}
+VkImageUsageFlags MipDownsampler::getImageUsage() { return VK_IMAGE_USAGE_STORAGE_BIT; }
+
+void MipDownsampler::generate(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels) {
+  // Slots are read when the batch runs, not when it's recorded, so every image
+  // in a batch needs its own. Wrap to the start when the chain doesn't fit.
+  slotTickets.resize(Buffers::getStorageImageCount());
+  uint32_t firstSlot = nextSlot;
+  if (firstSlot + mipLevels > slotTickets.size()) {
+    firstSlot = 0;
+  }
+  UploadQueue::Ticket busy = 0;
+  for (uint32_t slot = firstSlot; slot < firstSlot + mipLevels; slot++) {
+    busy = std::max(busy, slotTickets[slot]);
+  }
+  UploadQueue::wait(busy);
+
+  // A UNORM storage view per level, slot firstSlot + n is level n.
+  std::vector<VkImageView> views(mipLevels);
+  for (uint32_t level = 0; level < mipLevels; level++) {
+    VkImageViewUsageCreateInfo usageInfo = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO,
+      .usage = VK_IMAGE_USAGE_STORAGE_BIT,
+    };
+    VkImageViewCreateInfo viewInfo = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .pNext = &usageInfo,
+      .image = image,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .format = VK_FORMAT_R8G8B8A8_UNORM,
+      .subresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = level,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+      },
+    };
+    VK_CHECK(vkCreateImageView(DeviceControl::getDevice(), &viewInfo, nullptr, &views[level]));
+  }
+  Buffers::writeStorageImages(firstSlot, views);
+
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = image,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .baseMipLevel = 0,
+      .levelCount = mipLevels,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    },
+  };
+  VkCommandBuffer cmd = UploadQueue::getCommandBuffer();
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, downsamplePipeline.pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, downsamplePipeline.layout, 0, 1, &Buffers::getTextureDescriptorSets(), 0, nullptr);
+
+  for (uint32_t sourceLevel = 0; sourceLevel + 1 < mipLevels; sourceLevel += LEVELS_PER_DISPATCH) {
+    if (sourceLevel > 0) {
+      // The last level of the previous dispatch is this one's source.
+      VkMemoryBarrier levelBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+      };
+      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+    }
+    DownsampleConstants constants = {
+      .sourceLevel = sourceLevel,
+      .levelCount = std::min(LEVELS_PER_DISPATCH, mipLevels - 1 - sourceLevel),
+      .srgb = format == VK_FORMAT_R8G8B8A8_SRGB,
+      .firstSlot = firstSlot,
+    };
+    vkCmdPushConstants(cmd, downsamplePipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    const uint32_t levelWidth = MipGenerator::getLevelSize(width, sourceLevel + 1);
+    const uint32_t levelHeight = MipGenerator::getLevelSize(height, sourceLevel + 1);
+    vkCmdDispatch(cmd, (levelWidth + DOWNSAMPLE_GROUP_SIZE - 1) / DOWNSAMPLE_GROUP_SIZE,
+                  (levelHeight + DOWNSAMPLE_GROUP_SIZE - 1) / DOWNSAMPLE_GROUP_SIZE, 1);
+  }
+
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  const UploadQueue::Ticket ticket = UploadQueue::getTicket();
+  for (uint32_t slot = firstSlot; slot < firstSlot + mipLevels; slot++) {
+    slotTickets[slot] = ticket;
+  }
+  nextSlot = firstSlot + mipLevels;
+  // The slots can keep pointing at the destroyed views, nothing reads them until they're rewritten.
+  UploadQueue::release([=]() {
+    for (VkImageView view : views) {
+      vkDestroyImageView(DeviceControl::getDevice(), view, nullptr);
+    }
+  });
+}
+
+void MipDownsampler::generateReference(uint8_t *chain, uint32_t width, uint32_t height, bool srgb) {
+  // The same float curves as the shader, not MipGenerator's tables.
+  auto decode = [&](uint8_t value, uint32_t channel) {
+    const float stored = value / 255.0f;
+    if (!srgb || channel == 3) {
+      return stored;
+    }
+    return stored > 0.04045f ? std::pow((stored + 0.055f) / 1.055f, 2.4f) : stored / 12.92f;
+  };
+  auto encode = [&](float color, uint32_t channel) {
+    if (srgb && channel != 3) {
+      color = color > 0.0031308f ? 1.055f * std::pow(color, 1.0f / 2.4f) - 0.055f : color * 12.92f;
+    }
+    return static_cast<uint8_t>(std::round(std::clamp(color, 0.0f, 1.0f) * 255.0f));
+  };
+
+  const uint32_t levelCount = MipGenerator::getLevelCount(width, height);
+  for (uint32_t level = 1; level < levelCount; level++) {
+    const uint32_t parentWidth = MipGenerator::getLevelSize(width, level - 1);
+    const uint32_t parentHeight = MipGenerator::getLevelSize(height, level - 1);
+    const uint32_t levelWidth = MipGenerator::getLevelSize(width, level);
+    const uint32_t levelHeight = MipGenerator::getLevelSize(height, level);
+    const uint8_t *parent = chain + MipGenerator::getLevelOffset(width, height, level - 1);
+    uint8_t *target = chain + MipGenerator::getLevelOffset(width, height, level);
+    for (uint32_t y = 0; y < levelHeight; y++) {
+      const uint32_t rows[2] = {std::min(2 * y, parentHeight - 1), std::min(2 * y + 1, parentHeight - 1)};
+      for (uint32_t x = 0; x < levelWidth; x++) {
+        const uint32_t columns[2] = {std::min(2 * x, parentWidth - 1), std::min(2 * x + 1, parentWidth - 1)};
+        for (uint32_t channel = 0; channel < 4; channel++) {
+          float sum = 0.0f;
+          for (uint32_t row : rows) {
+            for (uint32_t column : columns) {
+              sum += decode(parent[(static_cast<size_t>(row) * parentWidth + column) * 4 + channel], channel);
+            }
+          }
+          target[(static_cast<size_t>(y) * levelWidth + x) * 4 + channel] = encode(sum * 0.25f, channel);
+        }
+      }
+    }
+  }
+}
+
+bool &MipDownsampler::getEnabled() { return downsamplerEnabled; }
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "volk.h"
+#include <cstdint>
+
+// Fills the mip chain of an RGBA8 image on the GPU, for textures whose levels
+// weren't built on the CPU (see Texture::MIPS_BLIT). A compute shader,
+// src/shaders/downsample.comp, makes up to five levels a dispatch through
+// workgroup shared memory where blitting takes a barrier per level, and the
+// format doesn't have to support linear blits. Every level is reached through
+// a storage image slot of the bindless texture set, see Buffers::writeStorageImages,
+// handed out round robin so one batch can fill several images.
+class MipDownsampler {
+public:
+  // Levels one dispatch writes, each workgroup starts from a 32x32 tile.
+  static constexpr uint32_t LEVELS_PER_DISPATCH = 5;
+
+  // Builds the pipeline, after the texture descriptor set layout. Without
+  // storage RGBA8 images or dynamically indexed storage arrays it stays off.
+  static void createPipeline();
+  // Whether generate can fill an image of this format right now, blit it otherwise.
+  static bool supports(VkFormat format);
+  // What the image has to be created with for generate, on top of its own usage.
+  // sRGB images can't be stored to, the shader writes through UNORM views.
+  static VkImageCreateFlags getImageFlags();
+  static VkImageUsageFlags getImageUsage();
+  // Every level must be in TRANSFER_DST_OPTIMAL with level 0 filled, they all
+  // end up in SHADER_READ_ONLY_OPTIMAL. Recorded into the open UploadQueue
+  // batch like every upload, the level 0 copy before it included.
+  static void generate(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels);
+  // What generate writes, on the CPU. chain holds level 0, laid out like
+  // MipGenerator's. Each level is a 2x2 box of the rounded level above it in
+  // linear space, the GPU stays within one step of it.
+  static void generateReference(uint8_t *chain, uint32_t width, uint32_t height, bool srgb);
+
+  // Off, every image takes the blit path.
+  static bool &getEnabled();
+};
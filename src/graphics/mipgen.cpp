@@ -0,0 +1,262 @@
+#include "mipgen.h"
+#include "../utils/threadpool.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AGNOSIA_MIPGEN_SSE
+#endif
+
+// How sharp the Kaiser window is, 4 is the usual tradeoff between ringing and blur.
+constexpr float KAISER_ALPHA = 4.0f;
+// Half width of the Kaiser filter in destination pixels, 8 taps for a 2:1 reduction.
+constexpr float KAISER_RADIUS = 2.0f;
+// Destination rows per job, small levels end up as a single tile.
+constexpr uint32_t TILE_ROWS = 32;
+// Entries in the linear to sRGB table, fine enough to stay under a fifth of a step near black.
+constexpr int ENCODE_TABLE_SIZE = 16384;
+
+float srgbToLinear(float value) {
+  return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+float linearToSrgb(float value) {
+  return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+struct ColorTables {
+  float decode[256];
+  uint8_t encode[ENCODE_TABLE_SIZE];
+};
+const ColorTables &getColorTables() {
+  static const ColorTables tables = []() {
+    ColorTables tables;
+    for (int i = 0; i < 256; i++) {
+      tables.decode[i] = srgbToLinear(i / 255.0f);
+    }
+    for (int i = 0; i < ENCODE_TABLE_SIZE; i++) {
+      tables.encode[i] = static_cast<uint8_t>(std::lround(linearToSrgb(i / float(ENCODE_TABLE_SIZE - 1)) * 255.0f));
+    }
+    return tables;
+  }();
+  return tables;
+}
+
+// Zeroth order modified Bessel function, the series converges in a handful of terms for our alpha.
+float besselI0(float x) {
+  float sum = 1.0f;
+  float term = 1.0f;
+  for (int k = 1; k < 32 && term > sum * 1e-8f; k++) {
+    term *= (x * x * 0.25f) / float(k * k);
+    sum += term;
+  }
+  return sum;
+}
+
+// The source pixels and weights that make up each destination pixel along one axis.
+// Every destination pixel gets the same tap count, unused ones have zero weight.
+struct FilterTaps {
+  uint32_t tapCount;
+  std::vector<uint32_t> indices;
+  std::vector<float> weights;
+};
+
+FilterTaps buildTaps(uint32_t sourceSize, uint32_t destinationSize, MipGenerator::Filter filter) {
+  const float scale = float(sourceSize) / float(destinationSize);
+  // Reach of the filter around a destination pixel's center, in source pixels.
+  const float support = filter == MipGenerator::FILTER_BOX ? scale * 0.5f : KAISER_RADIUS * scale;
+  FilterTaps taps;
+  taps.tapCount = static_cast<uint32_t>(std::ceil(support * 2.0f)) + 1;
+  taps.indices.resize(destinationSize * taps.tapCount);
+  taps.weights.resize(destinationSize * taps.tapCount);
+  const float windowScale = 1.0f / besselI0(KAISER_ALPHA);
+
+  for (uint32_t i = 0; i < destinationSize; i++) {
+    const float center = (i + 0.5f) * scale;
+    const int first = static_cast<int>(std::floor(center - support));
+    float sum = 0.0f;
+    for (uint32_t k = 0; k < taps.tapCount; k++) {
+      const int source = first + static_cast<int>(k);
+      float weight;
+      if (filter == MipGenerator::FILTER_BOX) {
+        // How much of the source pixel falls under the destination pixel.
+        weight = std::max(0.0f, std::min(source + 1.0f, center + support) - std::max(float(source), center - support));
+      } else {
+        const float x = (source + 0.5f - center) / scale;
+        if (std::abs(x) >= KAISER_RADIUS) {
+          weight = 0.0f;
+        } else {
+          const float sinc = x == 0.0f ? 1.0f : std::sin(float(M_PI) * x) / (float(M_PI) * x);
+          const float ratio = x / KAISER_RADIUS;
+          weight = sinc * besselI0(KAISER_ALPHA * std::sqrt(1.0f - ratio * ratio)) * windowScale;
+        }
+      }
+      // Clamp to edge, what the sampler does too.
+      taps.indices[i * taps.tapCount + k] = static_cast<uint32_t>(std::clamp(source, 0, int(sourceSize) - 1));
+      taps.weights[i * taps.tapCount + k] = weight;
+      sum += weight;
+    }
+    for (uint32_t k = 0; k < taps.tapCount; k++) {
+      taps.weights[i * taps.tapCount + k] /= sum;
+    }
+  }
+  return taps;
+}
+
+// One linear RGBA pixel, four lanes of one register when we have SSE.
+#ifdef AGNOSIA_MIPGEN_SSE
+struct Pixel {
+  __m128 lanes;
+};
+inline Pixel pixelZero() { return {_mm_setzero_ps()}; }
+inline Pixel pixelSet(float r, float g, float b, float a) { return {_mm_setr_ps(r, g, b, a)}; }
+inline Pixel pixelMulAdd(Pixel sum, Pixel pixel, float weight) { return {_mm_add_ps(sum.lanes, _mm_mul_ps(pixel.lanes, _mm_set1_ps(weight)))}; }
+inline Pixel pixelClamp(Pixel pixel) { return {_mm_min_ps(_mm_max_ps(pixel.lanes, _mm_setzero_ps()), _mm_set1_ps(1.0f))}; }
+inline void pixelStore(float *out, Pixel pixel) { _mm_storeu_ps(out, pixel.lanes); }
+#else
+struct Pixel {
+  float lanes[4];
+};
+inline Pixel pixelZero() { return {}; }
+inline Pixel pixelSet(float r, float g, float b, float a) { return {{r, g, b, a}}; }
+inline Pixel pixelMulAdd(Pixel sum, Pixel pixel, float weight) {
+  for (int lane = 0; lane < 4; lane++) sum.lanes[lane] += pixel.lanes[lane] * weight;
+  return sum;
+}
+inline Pixel pixelClamp(Pixel pixel) {
+  for (int lane = 0; lane < 4; lane++) pixel.lanes[lane] = std::clamp(pixel.lanes[lane], 0.0f, 1.0f);
+  return pixel;
+}
+inline void pixelStore(float *out, Pixel pixel) { std::copy(pixel.lanes, pixel.lanes + 4, out); }
+#endif
+
+// Filter destination rows [firstRow, lastRow) of one level from the level above it.
+void downsampleTile(const uint8_t *source, uint32_t sourceWidth, uint8_t *destination, uint32_t destinationWidth,
+                    const FilterTaps &horizontal, const FilterTaps &vertical, uint32_t firstRow, uint32_t lastRow, bool srgb) {
+  const ColorTables &tables = getColorTables();
+  const float *decodeColor = srgb ? tables.decode : nullptr;
+
+  // Source rows the tile's vertical taps touch, filtered horizontally once each.
+  uint32_t rowMin = UINT32_MAX, rowMax = 0;
+  for (uint32_t i = firstRow * vertical.tapCount; i < lastRow * vertical.tapCount; i++) {
+    rowMin = std::min(rowMin, vertical.indices[i]);
+    rowMax = std::max(rowMax, vertical.indices[i]);
+  }
+  std::vector<Pixel> linearRow(sourceWidth);
+  std::vector<Pixel> filteredRows(static_cast<size_t>(rowMax - rowMin + 1) * destinationWidth);
+  for (uint32_t row = rowMin; row <= rowMax; row++) {
+    const uint8_t *in = source + static_cast<size_t>(row) * sourceWidth * 4;
+    for (uint32_t x = 0; x < sourceWidth; x++, in += 4) {
+      linearRow[x] = decodeColor ? pixelSet(decodeColor[in[0]], decodeColor[in[1]], decodeColor[in[2]], in[3] / 255.0f)
+                                 : pixelSet(in[0] / 255.0f, in[1] / 255.0f, in[2] / 255.0f, in[3] / 255.0f);
+    }
+    Pixel *out = &filteredRows[static_cast<size_t>(row - rowMin) * destinationWidth];
+    for (uint32_t x = 0; x < destinationWidth; x++) {
+      const uint32_t *indices = &horizontal.indices[x * horizontal.tapCount];
+      const float *weights = &horizontal.weights[x * horizontal.tapCount];
+      Pixel sum = pixelZero();
+      for (uint32_t k = 0; k < horizontal.tapCount; k++) {
+        sum = pixelMulAdd(sum, linearRow[indices[k]], weights[k]);
+      }
+      out[x] = sum;
+    }
+  }
+
+  std::vector<Pixel> sumRow(destinationWidth);
+  for (uint32_t row = firstRow; row < lastRow; row++) {
+    std::fill(sumRow.begin(), sumRow.end(), pixelZero());
+    for (uint32_t k = 0; k < vertical.tapCount; k++) {
+      const float weight = vertical.weights[row * vertical.tapCount + k];
+      if (weight == 0.0f) {
+        continue;
+      }
+      const Pixel *in = &filteredRows[static_cast<size_t>(vertical.indices[row * vertical.tapCount + k] - rowMin) * destinationWidth];
+      for (uint32_t x = 0; x < destinationWidth; x++) {
+        sumRow[x] = pixelMulAdd(sumRow[x], in[x], weight);
+      }
+    }
+    uint8_t *out = destination + static_cast<size_t>(row) * destinationWidth * 4;
+    for (uint32_t x = 0; x < destinationWidth; x++, out += 4) {
+      // Kaiser lobes can overshoot, clamp before encoding.
+      float pixel[4];
+      pixelStore(pixel, pixelClamp(sumRow[x]));
+      for (int channel = 0; channel < 3; channel++) {
+        out[channel] = srgb ? tables.encode[static_cast<int>(pixel[channel] * (ENCODE_TABLE_SIZE - 1) + 0.5f)]
+                            : static_cast<uint8_t>(pixel[channel] * 255.0f + 0.5f);
+      }
+      out[3] = static_cast<uint8_t>(pixel[3] * 255.0f + 0.5f);
+    }
+  }
+}
+
+uint32_t MipGenerator::getLevelCount(uint32_t width, uint32_t height) {
+  return static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+}
+uint32_t MipGenerator::getLevelSize(uint32_t size, uint32_t level) {
+  return std::max(1u, size >> level);
+}
+size_t MipGenerator::getLevelOffset(uint32_t width, uint32_t height, uint32_t level) {
+  size_t offset = 0;
+  for (uint32_t i = 0; i < level; i++) {
+    offset += static_cast<size_t>(getLevelSize(width, i)) * getLevelSize(height, i) * 4;
+  }
+  return offset;
+}
+size_t MipGenerator::getChainSize(uint32_t width, uint32_t height) {
+  return getLevelOffset(width, height, getLevelCount(width, height));
+}
+
+void MipGenerator::generate(uint8_t *chain, uint32_t width, uint32_t height, Filter filter, bool srgb) {
+  const uint32_t levelCount = getLevelCount(width, height);
+  for (uint32_t level = 1; level < levelCount; level++) {
+    const uint32_t sourceWidth = getLevelSize(width, level - 1), sourceHeight = getLevelSize(height, level - 1);
+    const uint32_t destinationWidth = getLevelSize(width, level), destinationHeight = getLevelSize(height, level);
+    const uint8_t *source = chain + getLevelOffset(width, height, level - 1);
+    uint8_t *destination = chain + getLevelOffset(width, height, level);
+    const FilterTaps horizontal = buildTaps(sourceWidth, destinationWidth, filter);
+    const FilterTaps vertical = buildTaps(sourceHeight, destinationHeight, filter);
+
+    // Each level reads the one before it, so the levels go in order and only the tiles run in parallel.
+    const uint32_t tileCount = (destinationHeight + TILE_ROWS - 1) / TILE_ROWS;
+    ThreadPool::get().parallelFor(tileCount, [&](size_t tile) {
+      const uint32_t firstRow = static_cast<uint32_t>(tile) * TILE_ROWS;
+      downsampleTile(source, sourceWidth, destination, destinationWidth, horizontal, vertical,
+                     firstRow, std::min(firstRow + TILE_ROWS, destinationHeight), srgb);
+    });
+  }
+}
+
+void MipGenerator::generateScalar(uint8_t *chain, uint32_t width, uint32_t height, Filter filter, bool srgb) {
+  const uint32_t levelCount = getLevelCount(width, height);
+  for (uint32_t level = 1; level < levelCount; level++) {
+    const uint32_t sourceWidth = getLevelSize(width, level - 1), sourceHeight = getLevelSize(height, level - 1);
+    const uint32_t destinationWidth = getLevelSize(width, level), destinationHeight = getLevelSize(height, level);
+    const uint8_t *source = chain + getLevelOffset(width, height, level - 1);
+    uint8_t *destination = chain + getLevelOffset(width, height, level);
+    const FilterTaps horizontal = buildTaps(sourceWidth, destinationWidth, filter);
+    const FilterTaps vertical = buildTaps(sourceHeight, destinationHeight, filter);
+
+    for (uint32_t y = 0; y < destinationHeight; y++) {
+      for (uint32_t x = 0; x < destinationWidth; x++) {
+        float sum[4] = {};
+        for (uint32_t ky = 0; ky < vertical.tapCount; ky++) {
+          for (uint32_t kx = 0; kx < horizontal.tapCount; kx++) {
+            const float weight = vertical.weights[y * vertical.tapCount + ky] * horizontal.weights[x * horizontal.tapCount + kx];
+            const uint8_t *in = source + (static_cast<size_t>(vertical.indices[y * vertical.tapCount + ky]) * sourceWidth +
+                                          horizontal.indices[x * horizontal.tapCount + kx]) * 4;
+            for (int channel = 0; channel < 4; channel++) {
+              const float value = in[channel] / 255.0f;
+              sum[channel] += weight * (srgb && channel < 3 ? srgbToLinear(value) : value);
+            }
+          }
+        }
+        uint8_t *out = destination + (static_cast<size_t>(y) * destinationWidth + x) * 4;
+        for (int channel = 0; channel < 4; channel++) {
+          const float value = std::clamp(sum[channel], 0.0f, 1.0f);
+          out[channel] = static_cast<uint8_t>(std::lround((srgb && channel < 3 ? linearToSrgb(value) : value) * 255.0f));
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Builds the mip chain of an RGBA8 texture on the CPU. Colors are filtered in
+// linear space, a blit on sRGB storage averages the encoded values instead and
+// darkens every level a little more. Meant to run once when a texture is cooked,
+// see CookedTexture, so a runtime load uploads every level in one go.
+class MipGenerator {
+public:
+  enum Filter : uint32_t {
+    // Plain average of the source pixels under each destination pixel.
+    FILTER_BOX,
+    // Kaiser windowed sinc, keeps detail the box filter blurs away for a little ringing.
+    FILTER_KAISER,
+  };
+
+  static uint32_t getLevelCount(uint32_t width, uint32_t height);
+  // Width or height of a level, the way Vulkan sizes them.
+  static uint32_t getLevelSize(uint32_t size, uint32_t level);
+  // The chain is every level tightly packed as RGBA8, level 0 first.
+  static size_t getLevelOffset(uint32_t width, uint32_t height, uint32_t level);
+  static size_t getChainSize(uint32_t width, uint32_t height);
+
+  // chain holds level 0, every smaller level gets written after it. Each level
+  // is filtered from the one above it with SIMD, in tiles of rows spread over
+  // the thread pool. srgb decides whether RGB is sRGB encoded, alpha never is.
+  static void generate(uint8_t *chain, uint32_t width, uint32_t height, Filter filter, bool srgb);
+  // Reference version, one pixel at a time on the calling thread with the exact
+  // sRGB curves instead of tables. generate stays within one step of it per level,
+  // a couple at most further down the chain since each level reads its own parent.
+  static void generateScalar(uint8_t *chain, uint32_t width, uint32_t height, Filter filter, bool srgb);
+};
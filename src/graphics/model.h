@@ -1,31 +1,32 @@
 #pragma once
 
-#include "volk.h"
-
 #include "../utils/types.h"
 #include "material.h"
+#include "mesh.h"
 #include <glm/glm.hpp>
 #include <string>
 
+// One placement of a mesh in the scene. The geometry lives in the shared
+// Mesh, a Model only adds where it is, what it looks like and which LOD it
+// was last drawn at, so thousands of copies of a prop cost one upload.
 class Model {
 protected:
   std::string ID;
-  Agnosia_T::GPUMeshBuffers buffers;
   Material material;
+  Mesh *mesh;
   glm::vec3 objPosition;
-  uint32_t verticeCount;
-  uint32_t indiceCount;
-  std::string modelPath;
+  uint32_t lod = 0;
 
 public:
-  Model(const std::string &modelID, const Material &material,
-        const std::string &modelPath, const glm::vec3 &opjPos);
+  // mesh comes from AssetCache::fetchLoadMesh, the Model holds that reference
+  // until AssetCache::remove drops it.
+  Model(const std::string &modelID, const Material &material, Mesh *mesh, const glm::vec3 &objPos);
 
-  Agnosia_T::GPUMeshBuffers getBuffers();
   std::string getID();
   glm::vec3 &getPos();
   Material &getMaterial();
-  std::string getModelPath();
-  uint32_t getIndices();
-  uint32_t getVertices();
+  Mesh *getMesh();
+  // The LOD level the renderer picked for this model, for the UI.
+  uint32_t getLod();
+  void setLod(uint32_t level);
 };
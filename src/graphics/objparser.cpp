@@ -0,0 +1,288 @@
+#include "objparser.h"
+#include "../utils/threadpool.h"
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Chunks smaller than this cost more to schedule than they take to parse.
+constexpr size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+struct ObjChunk {
+  std::vector<float> vertices;
+  std::vector<float> normals;
+  std::vector<float> texcoords;
+  std::vector<tinyobj::index_t> indices;
+  // Set for every corner index that was written relative to the end of the
+  // list (negative in the file). Those can only be resolved once we know how
+  // many elements the chunks before this one hold.
+  std::vector<uint8_t> relative;
+  // Where each quad's two triangles start in indices. They go in as (0, 1, 2)
+  // and (0, 2, 3) and are split again once every position is known.
+  std::vector<uint32_t> quads;
+};
+
+constexpr uint8_t RELATIVE_VERTEX = 1 << 0;
+constexpr uint8_t RELATIVE_TEXCOORD = 1 << 1;
+constexpr uint8_t RELATIVE_NORMAL = 1 << 2;
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t'; }
+inline bool isLineEnd(char c) { return c == '\n' || c == '\r'; }
+
+inline const char *skipBlanks(const char *cursor, const char *end) {
+  while (cursor < end && isBlank(*cursor)) cursor++;
+  return cursor;
+}
+
+inline const char *parseFloat(const char *cursor, const char *end, float &value) {
+  // std::from_chars is the Eisel-Lemire/fast_float parser in libstdc++, and it
+  // skips the locale and errno work strtof does. It rejects a leading '+' though.
+  cursor = skipBlanks(cursor, end);
+  if (cursor < end && *cursor == '+') cursor++;
+  auto result = std::from_chars(cursor, end, value);
+  if (result.ec != std::errc()) {
+    value = 0.0f;
+  }
+  return result.ptr;
+}
+
+inline const char *parseInt(const char *cursor, const char *end, int &value) {
+  if (cursor < end && *cursor == '+') cursor++;
+  auto result = std::from_chars(cursor, end, value);
+  if (result.ec != std::errc()) {
+    value = 0;
+  }
+  return result.ptr;
+}
+
+// Turns a 1 based (or negative, end relative) OBJ index into a 0 based one. Relative
+// indices are resolved against this chunk only, the merge adds the chunk offset.
+inline int resolveIndex(int index, size_t localCount, uint8_t flag, uint8_t &relative) {
+  if (index > 0) {
+    return index - 1;
+  }
+  if (index < 0) {
+    relative |= flag;
+    return static_cast<int>(localCount) + index;
+  }
+  return -1;
+}
+
+void parseFace(const char *cursor, const char *end, ObjChunk &chunk) {
+  tinyobj::index_t first;
+  tinyobj::index_t previous;
+  uint8_t firstRelative = 0;
+  uint8_t previousRelative = 0;
+  int corner = 0;
+
+  while (true) {
+    cursor = skipBlanks(cursor, end);
+    if (cursor >= end || isLineEnd(*cursor)) {
+      break;
+    }
+    int vertex = 0, texcoord = 0, normal = 0;
+    cursor = parseInt(cursor, end, vertex);
+    if (cursor < end && *cursor == '/') {
+      cursor++;
+      if (cursor < end && *cursor != '/') {
+        cursor = parseInt(cursor, end, texcoord);
+      }
+      if (cursor < end && *cursor == '/') {
+        cursor++;
+        cursor = parseInt(cursor, end, normal);
+      }
+    }
+    // Skip anything we did not understand up to the next token.
+    while (cursor < end && !isBlank(*cursor) && !isLineEnd(*cursor)) cursor++;
+
+    uint8_t relative = 0;
+    tinyobj::index_t index;
+    index.vertex_index = resolveIndex(vertex, chunk.vertices.size() / 3, RELATIVE_VERTEX, relative);
+    index.texcoord_index = resolveIndex(texcoord, chunk.texcoords.size() / 2, RELATIVE_TEXCOORD, relative);
+    index.normal_index = resolveIndex(normal, chunk.normals.size() / 3, RELATIVE_NORMAL, relative);
+
+    // Remember quads for the split after the merge, a fifth corner makes it not one.
+    if (corner == 3) {
+      chunk.quads.push_back(static_cast<uint32_t>(chunk.indices.size() - 3));
+    } else if (corner == 4) {
+      chunk.quads.pop_back();
+    }
+    // Fan triangulation, (0, n-1, n) for every corner past the second.
+    if (corner == 0) {
+      first = index;
+      firstRelative = relative;
+    } else if (corner >= 2) {
+      chunk.indices.push_back(first);
+      chunk.indices.push_back(previous);
+      chunk.indices.push_back(index);
+      chunk.relative.push_back(firstRelative);
+      chunk.relative.push_back(previousRelative);
+      chunk.relative.push_back(relative);
+    }
+    previous = index;
+    previousRelative = relative;
+    corner++;
+  }
+}
+
+void parseChunk(const char *cursor, const char *end, ObjChunk &chunk) {
+  while (cursor < end) {
+    cursor = skipBlanks(cursor, end);
+    const char *lineEnd = static_cast<const char *>(memchr(cursor, '\n', end - cursor));
+    if (lineEnd == nullptr) {
+      lineEnd = end;
+    }
+
+    if (lineEnd - cursor >= 2) {
+      if (cursor[0] == 'v' && isBlank(cursor[1])) {
+        float x, y, z;
+        const char *next = parseFloat(cursor + 2, lineEnd, x);
+        next = parseFloat(next, lineEnd, y);
+        parseFloat(next, lineEnd, z);
+        chunk.vertices.insert(chunk.vertices.end(), {x, y, z});
+      } else if (cursor[0] == 'v' && cursor[1] == 'n' && lineEnd - cursor >= 3 && isBlank(cursor[2])) {
+        float x, y, z;
+        const char *next = parseFloat(cursor + 3, lineEnd, x);
+        next = parseFloat(next, lineEnd, y);
+        parseFloat(next, lineEnd, z);
+        chunk.normals.insert(chunk.normals.end(), {x, y, z});
+      } else if (cursor[0] == 'v' && cursor[1] == 't' && lineEnd - cursor >= 3 && isBlank(cursor[2])) {
+        float u, v;
+        const char *next = parseFloat(cursor + 3, lineEnd, u);
+        parseFloat(next, lineEnd, v);
+        chunk.texcoords.insert(chunk.texcoords.end(), {u, v});
+      } else if (cursor[0] == 'f' && isBlank(cursor[1])) {
+        parseFace(cursor + 2, lineEnd, chunk);
+      }
+    }
+    cursor = lineEnd + 1;
+  }
+}
+
+void ObjParser::parse(const std::string &path, tinyobj::attrib_t &attrib, std::vector<tinyobj::shape_t> &shapes) {
+  int file = open(path.c_str(), O_RDONLY);
+  if (file < 0) {
+    throw std::runtime_error("Failed to open OBJ: " + path);
+  }
+  struct stat fileInfo;
+  if (fstat(file, &fileInfo) != 0) {
+    close(file);
+    throw std::runtime_error("Failed to stat OBJ: " + path);
+  }
+  const size_t size = static_cast<size_t>(fileInfo.st_size);
+  attrib = tinyobj::attrib_t();
+  shapes.assign(1, tinyobj::shape_t());
+  if (size == 0) {
+    close(file);
+    return;
+  }
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (mapping == MAP_FAILED) {
+    throw std::runtime_error("Failed to map OBJ: " + path);
+  }
+  madvise(mapping, size, MADV_WILLNEED);
+  const char *data = static_cast<const char *>(mapping);
+
+  // Cut the file into roughly even pieces, then push every cut forward to the
+  // start of the next line so no record is split between two chunks.
+  ThreadPool &pool = ThreadPool::get();
+  const size_t chunkCount = std::max<size_t>(1, std::min(pool.getThreadCount() * 4, size / MIN_CHUNK_SIZE));
+  std::vector<size_t> cuts(chunkCount + 1, size);
+  cuts[0] = 0;
+  for (size_t i = 1; i < chunkCount; i++) {
+    size_t cut = std::max(size * i / chunkCount, cuts[i - 1]);
+    const void *newline = memchr(data + cut, '\n', size - cut);
+    cuts[i] = newline ? static_cast<const char *>(newline) - data + 1 : size;
+  }
+
+  std::vector<ObjChunk> chunks(chunkCount);
+  pool.parallelFor(chunkCount, [&](size_t i) {
+    parseChunk(data + cuts[i], data + cuts[i + 1], chunks[i]);
+  });
+  munmap(mapping, size);
+
+  // Exclusive prefix sums over the chunk sizes give every chunk its offset in
+  // the merged arrays, and the base that its relative indices resolve against.
+  struct Offsets {
+    size_t vertices = 0, normals = 0, texcoords = 0, indices = 0;
+  };
+  std::vector<Offsets> offsets(chunkCount + 1);
+  for (size_t i = 0; i < chunkCount; i++) {
+    offsets[i + 1].vertices = offsets[i].vertices + chunks[i].vertices.size();
+    offsets[i + 1].normals = offsets[i].normals + chunks[i].normals.size();
+    offsets[i + 1].texcoords = offsets[i].texcoords + chunks[i].texcoords.size();
+    offsets[i + 1].indices = offsets[i].indices + chunks[i].indices.size();
+  }
+  attrib.vertices.resize(offsets[chunkCount].vertices);
+  attrib.normals.resize(offsets[chunkCount].normals);
+  attrib.texcoords.resize(offsets[chunkCount].texcoords);
+  tinyobj::mesh_t &mesh = shapes[0].mesh;
+  mesh.indices.resize(offsets[chunkCount].indices);
+
+  const int vertexCount = static_cast<int>(attrib.vertices.size() / 3);
+  const int texcoordCount = static_cast<int>(attrib.texcoords.size() / 2);
+  const int normalCount = static_cast<int>(attrib.normals.size() / 3);
+  std::atomic<bool> badIndex = false;
+  pool.parallelFor(chunkCount, [&](size_t i) {
+    const ObjChunk &chunk = chunks[i];
+    const Offsets &offset = offsets[i];
+    std::copy(chunk.vertices.begin(), chunk.vertices.end(), attrib.vertices.begin() + offset.vertices);
+    std::copy(chunk.normals.begin(), chunk.normals.end(), attrib.normals.begin() + offset.normals);
+    std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib.texcoords.begin() + offset.texcoords);
+
+    const int vertexBase = static_cast<int>(offset.vertices / 3);
+    const int texcoordBase = static_cast<int>(offset.texcoords / 2);
+    const int normalBase = static_cast<int>(offset.normals / 3);
+    for (size_t corner = 0; corner < chunk.indices.size(); corner++) {
+      tinyobj::index_t index = chunk.indices[corner];
+      const uint8_t relative = chunk.relative[corner];
+      if (relative & RELATIVE_VERTEX) index.vertex_index += vertexBase;
+      if (relative & RELATIVE_TEXCOORD) index.texcoord_index += texcoordBase;
+      if (relative & RELATIVE_NORMAL) index.normal_index += normalBase;
+      // Only resolvable now that the totals are known. A missing uv or normal
+      // is harmless, a corner without a position can't be drawn.
+      if (index.vertex_index < 0 || index.vertex_index >= vertexCount) badIndex = true;
+      if (index.texcoord_index >= texcoordCount) index.texcoord_index = -1;
+      if (index.normal_index >= normalCount) index.normal_index = -1;
+      mesh.indices[offset.indices + corner] = index;
+    }
+  });
+  if (badIndex) {
+    throw std::runtime_error("OBJ face references a missing vertex: " + path);
+  }
+
+  // tinyobj splits a quad along its shorter diagonal rather than from corner 0,
+  // same comparison in the same float math so both give the same triangles.
+  pool.parallelFor(chunkCount, [&](size_t i) {
+    for (uint32_t quad : chunks[i].quads) {
+      tinyobj::index_t *triangles = mesh.indices.data() + offsets[i].indices + quad;
+      const tinyobj::index_t corners[4] = {triangles[0], triangles[1], triangles[2], triangles[5]};
+      const float *v0 = &attrib.vertices[3 * corners[0].vertex_index];
+      const float *v1 = &attrib.vertices[3 * corners[1].vertex_index];
+      const float *v2 = &attrib.vertices[3 * corners[2].vertex_index];
+      const float *v3 = &attrib.vertices[3 * corners[3].vertex_index];
+      const float e02x = v2[0] - v0[0], e02y = v2[1] - v0[1], e02z = v2[2] - v0[2];
+      const float e13x = v3[0] - v1[0], e13y = v3[1] - v1[1], e13z = v3[2] - v1[2];
+      const float sqr02 = e02x * e02x + e02y * e02y + e02z * e02z;
+      const float sqr13 = e13x * e13x + e13y * e13y + e13z * e13z;
+      if (!(sqr02 < sqr13)) {
+        // (0, 1, 3) and (1, 2, 3).
+        triangles[2] = corners[3];
+        triangles[3] = corners[1];
+        triangles[4] = corners[2];
+        triangles[5] = corners[3];
+      }
+    }
+  });
+
+  mesh.num_face_vertices.assign(mesh.indices.size() / 3, 3);
+  mesh.material_ids.assign(mesh.indices.size() / 3, -1);
+  mesh.smoothing_group_ids.assign(mesh.indices.size() / 3, 0);
+}
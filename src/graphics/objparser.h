@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <tiny_obj_loader.h>
+
+// In-tree Wavefront OBJ reader. The file is mmap'd and cut into line aligned
+// chunks that are parsed on every core, then stitched back together. It fills
+// the same structures tinyobj::ObjReader does, so Model can use either one.
+class ObjParser {
+public:
+  // Only v, vn, vt and f records are read, everything in the file ends up in
+  // a single shape. Triangles and quads come out as tinyobj triangulates them,
+  // quads split along the shorter diagonal. Larger polygons are fan
+  // triangulated where tinyobj clips ears, so only their triangles differ.
+  static void parse(const std::string &path, tinyobj::attrib_t &attrib, std::vector<tinyobj::shape_t> &shapes);
+};
@@ -36,6 +36,13 @@ void recreateSwapChain() {
 // submit the recorded command buffer and present the image!
 void Render::drawFrame(AssetCache& cache) {
   VK_CHECK(vkWaitForFences(DeviceControl::getDevice(), 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX));
+  if (Buffers::getMaterialDescriptorsDirty()) {
+    // Every frame shares the texture set, the one still in flight may be sampling
+    // a slot about to change. Only on frames where a texture landed.
+    VK_CHECK(vkWaitForFences(DeviceControl::getDevice(), static_cast<uint32_t>(inFlightFences.size()), inFlightFences.data(), VK_TRUE, UINT64_MAX));
+    Buffers::writeMaterialDescriptors(cache.getModels());
+    Buffers::getMaterialDescriptorsDirty() = false;
+  }
   uint32_t imageIndex;
 
   VkResult result = vkAcquireNextImageKHR(DeviceControl::getDevice(), DeviceControl::getSwapChain(), UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
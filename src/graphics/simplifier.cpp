@@ -0,0 +1,435 @@
+#include "simplifier.h"
+#include <algorithm>
+#include <cmath>
+
+// Border and seam edges get an extra plane through the edge, perpendicular to
+// the surface, so collapsing across them is expensive. Weighted relative to
+// the area weight of the face planes.
+constexpr double BORDER_WEIGHT = 10.0;
+// A collapse is skipped if it turns any remaining triangle by more than about
+// 75 degrees (the cosine), which catches flips and most slivers.
+constexpr float FLIP_THRESHOLD = 0.25f;
+
+enum VertexKind : uint8_t {
+  INTERIOR,
+  // On a border or a UV seam, may only slide along it.
+  CONSTRAINED,
+  // Where more than two triangles share an edge, never moves.
+  LOCKED,
+};
+
+// Symmetric 4x4 matrix summing the squared distance to a set of planes, plus
+// the total weight of the planes so the error can be normalized back into a
+// distance.
+struct Quadric {
+  double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+  double b2 = 0.0, bc = 0.0, bd = 0.0;
+  double c2 = 0.0, cd = 0.0;
+  double d2 = 0.0;
+  double weight = 0.0;
+
+  void addPlane(const glm::vec3 &normal, float distance, double planeWeight) {
+    const double a = normal.x, b = normal.y, c = normal.z, d = distance;
+    a2 += planeWeight * a * a; ab += planeWeight * a * b; ac += planeWeight * a * c; ad += planeWeight * a * d;
+    b2 += planeWeight * b * b; bc += planeWeight * b * c; bd += planeWeight * b * d;
+    c2 += planeWeight * c * c; cd += planeWeight * c * d;
+    d2 += planeWeight * d * d;
+    weight += planeWeight;
+  }
+  void add(const Quadric &other) {
+    a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+    b2 += other.b2; bc += other.bc; bd += other.bd;
+    c2 += other.c2; cd += other.cd;
+    d2 += other.d2;
+    weight += other.weight;
+  }
+  // Weighted mean squared distance from point to the planes.
+  double error(const glm::vec3 &point) const {
+    const double x = point.x, y = point.y, z = point.z;
+    const double sum = a2 * x * x + b2 * y * y + c2 * z * z + d2 +
+                       2.0 * (ab * x * y + ac * x * z + ad * x + bc * y * z + bd * y + cd * z);
+    return weight > 0.0 ? std::max(sum, 0.0) / weight : 0.0;
+  }
+};
+
+struct Collapse {
+  uint32_t from;
+  uint32_t to;
+  double cost;
+};
+
+// Normals may differ across an edge (a crease), that is geometry the quadrics
+// already take care of. Anything else differing is a texture or color seam.
+inline bool sameAttributes(const Agnosia_T::Vertex &a, const Agnosia_T::Vertex &b) {
+  return a.uv == b.uv && a.color == b.color;
+}
+
+float Simplifier::simplify(const std::vector<Agnosia_T::Vertex> &vertices, const std::vector<uint32_t> &indices,
+                           size_t targetIndexCount, float targetError, std::vector<uint32_t> &destination) {
+  const size_t vertexCount = vertices.size();
+  const size_t triangleCount = indices.size() / 3;
+
+  // Weld the vertices sharing a position. Quadrics, adjacency and collapses all
+  // work on positions, named after the first vertex found there. The vertices
+  // (wedges) at one position differ in normal, UV or color. Coarse LOD levels
+  // only reference a fraction of the vertex buffer, so only those get sorted.
+  std::vector<uint32_t> order;
+  {
+    std::vector<bool> referenced(vertexCount, false);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+      if (!referenced[indices[i]]) {
+        referenced[indices[i]] = true;
+        order.push_back(indices[i]);
+      }
+    }
+  }
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    const glm::vec3 &pa = vertices[a].pos;
+    const glm::vec3 &pb = vertices[b].pos;
+    if (pa.x != pb.x) return pa.x < pb.x;
+    if (pa.y != pb.y) return pa.y < pb.y;
+    return pa.z < pb.z;
+  });
+  std::vector<uint32_t> position(vertexCount);
+  for (size_t first = 0; first < order.size();) {
+    size_t last = first;
+    while (last < order.size() && vertices[order[last]].pos == vertices[order[first]].pos) {
+      position[order[last++]] = order[first];
+    }
+    first = last;
+  }
+
+  std::vector<uint32_t> corners(indices.begin(), indices.begin() + triangleCount * 3);
+  std::vector<bool> triangleAlive(triangleCount, true);
+  std::vector<std::vector<uint32_t>> positionTriangles(vertexCount);
+  std::vector<Quadric> quadrics(vertexCount);
+  size_t liveTriangles = 0;
+
+  auto triangleNormal = [&](uint32_t a, uint32_t b, uint32_t c) {
+    return glm::cross(vertices[b].pos - vertices[a].pos, vertices[c].pos - vertices[a].pos);
+  };
+
+  for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+    const uint32_t p0 = position[corners[triangle * 3 + 0]];
+    const uint32_t p1 = position[corners[triangle * 3 + 1]];
+    const uint32_t p2 = position[corners[triangle * 3 + 2]];
+    if (p0 == p1 || p1 == p2 || p0 == p2) {
+      triangleAlive[triangle] = false;
+      continue;
+    }
+    liveTriangles++;
+    for (uint32_t p : {p0, p1, p2}) {
+      positionTriangles[p].push_back(static_cast<uint32_t>(triangle));
+    }
+    const glm::vec3 normal = triangleNormal(p0, p1, p2);
+    const float length = glm::length(normal);
+    if (length > 0.0f) {
+      const glm::vec3 unit = normal / length;
+      for (uint32_t p : {p0, p1, p2}) {
+        quadrics[p].addPlane(unit, -glm::dot(unit, vertices[p].pos), length * 0.5);
+      }
+    }
+  }
+
+  // Sort the corners of every edge together. One triangle on an edge is a
+  // border, two that disagree on the attributes at its ends is a seam, more
+  // than two is non-manifold.
+  struct EdgeCorner {
+    uint32_t low;
+    uint32_t high;
+    uint32_t lowWedge;
+    uint32_t highWedge;
+    uint32_t triangle;
+  };
+  std::vector<VertexKind> kind(vertexCount, INTERIOR);
+  {
+    std::vector<EdgeCorner> edgeCorners;
+    edgeCorners.reserve(liveTriangles * 3);
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+      if (!triangleAlive[triangle]) {
+        continue;
+      }
+      for (int corner = 0; corner < 3; corner++) {
+        uint32_t a = corners[triangle * 3 + corner];
+        uint32_t b = corners[triangle * 3 + (corner + 1) % 3];
+        if (position[a] > position[b]) {
+          std::swap(a, b);
+        }
+        edgeCorners.push_back({position[a], position[b], a, b, static_cast<uint32_t>(triangle)});
+      }
+    }
+    std::sort(edgeCorners.begin(), edgeCorners.end(), [](const EdgeCorner &a, const EdgeCorner &b) {
+      return a.low != b.low ? a.low < b.low : a.high < b.high;
+    });
+
+    for (size_t first = 0; first < edgeCorners.size();) {
+      size_t last = first + 1;
+      while (last < edgeCorners.size() && edgeCorners[last].low == edgeCorners[first].low &&
+             edgeCorners[last].high == edgeCorners[first].high) {
+        last++;
+      }
+      const EdgeCorner &edge = edgeCorners[first];
+      const size_t count = last - first;
+      const bool seam = count == 2 && (!sameAttributes(vertices[edgeCorners[first + 1].lowWedge], vertices[edge.lowWedge]) ||
+                                       !sameAttributes(vertices[edgeCorners[first + 1].highWedge], vertices[edge.highWedge]));
+      if (count > 2) {
+        kind[edge.low] = LOCKED;
+        kind[edge.high] = LOCKED;
+      } else if (count == 1 || seam) {
+        kind[edge.low] = std::max(kind[edge.low], CONSTRAINED);
+        kind[edge.high] = std::max(kind[edge.high], CONSTRAINED);
+        for (size_t i = first; i < last; i++) {
+          const uint32_t triangle = edgeCorners[i].triangle;
+          const glm::vec3 faceNormal = triangleNormal(position[corners[triangle * 3 + 0]],
+                                                      position[corners[triangle * 3 + 1]],
+                                                      position[corners[triangle * 3 + 2]]);
+          const glm::vec3 direction = vertices[edge.high].pos - vertices[edge.low].pos;
+          const glm::vec3 planeNormal = glm::cross(direction, faceNormal);
+          const float length = glm::length(planeNormal);
+          if (length > 0.0f) {
+            const glm::vec3 unit = planeNormal / length;
+            const double planeWeight = BORDER_WEIGHT * glm::dot(direction, direction);
+            quadrics[edge.low].addPlane(unit, -glm::dot(unit, vertices[edge.low].pos), planeWeight);
+            quadrics[edge.high].addPlane(unit, -glm::dot(unit, vertices[edge.high].pos), planeWeight);
+          }
+        }
+      }
+      first = last;
+    }
+  }
+
+  auto cornerAt = [&](uint32_t triangle, uint32_t p) {
+    for (int corner = 0; corner < 3; corner++) {
+      if (position[corners[triangle * 3 + corner]] == p) {
+        return corners[triangle * 3 + corner];
+      }
+    }
+    return UINT32_MAX;
+  };
+
+  std::vector<uint32_t> edgeTriangles;
+  std::vector<std::pair<uint32_t, uint32_t>> wedgeMap;
+  std::vector<uint32_t> fromNeighbors;
+  std::vector<uint32_t> toNeighbors;
+  auto gatherNeighbors = [&](uint32_t p, std::vector<uint32_t> &neighbors) {
+    neighbors.clear();
+    for (uint32_t triangle : positionTriangles[p]) {
+      if (!triangleAlive[triangle]) {
+        continue;
+      }
+      for (int corner = 0; corner < 3; corner++) {
+        const uint32_t other = position[corners[triangle * 3 + corner]];
+        if (other != p) {
+          neighbors.push_back(other);
+        }
+      }
+    }
+    std::sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+  };
+
+  // Checks the collapse against the current topology and fills wedgeMap with
+  // the wedge at to that every wedge at from turns into.
+  auto canCollapse = [&](uint32_t from, uint32_t to) {
+    edgeTriangles.clear();
+    for (uint32_t triangle : positionTriangles[from]) {
+      if (triangleAlive[triangle] && cornerAt(triangle, to) != UINT32_MAX) {
+        edgeTriangles.push_back(triangle);
+      }
+    }
+    if (edgeTriangles.empty() || edgeTriangles.size() > 2) {
+      return false;
+    }
+    const bool border = edgeTriangles.size() == 1;
+    const bool seam = edgeTriangles.size() == 2 &&
+                      (!sameAttributes(vertices[cornerAt(edgeTriangles[0], from)], vertices[cornerAt(edgeTriangles[1], from)]) ||
+                       !sameAttributes(vertices[cornerAt(edgeTriangles[0], to)], vertices[cornerAt(edgeTriangles[1], to)]));
+    if (kind[from] == CONSTRAINED && !border && !seam) {
+      return false;
+    }
+
+    // Wedges on the edge's own triangles go to the wedge across the edge. The
+    // rest only differ from one of those in their normal (a crease), they go
+    // to whichever wedge at to matches that one's target and has the closest
+    // normal. Anything else would lose its UVs.
+    wedgeMap.clear();
+    for (uint32_t triangle : edgeTriangles) {
+      wedgeMap.push_back({cornerAt(triangle, from), cornerAt(triangle, to)});
+    }
+    const size_t edgeWedges = wedgeMap.size();
+    for (uint32_t triangle : positionTriangles[from]) {
+      if (!triangleAlive[triangle]) {
+        continue;
+      }
+      const uint32_t wedge = cornerAt(triangle, from);
+      if (std::any_of(wedgeMap.begin(), wedgeMap.end(), [&](const auto &entry) { return entry.first == wedge; })) {
+        continue;
+      }
+      const auto sibling = std::find_if(wedgeMap.begin(), wedgeMap.begin() + edgeWedges, [&](const auto &entry) {
+        return sameAttributes(vertices[entry.first], vertices[wedge]);
+      });
+      if (sibling == wedgeMap.begin() + edgeWedges) {
+        return false;
+      }
+      uint32_t target = sibling->second;
+      float closest = glm::dot(vertices[wedge].normal, vertices[target].normal);
+      for (uint32_t other : positionTriangles[to]) {
+        if (!triangleAlive[other]) {
+          continue;
+        }
+        const uint32_t candidate = cornerAt(other, to);
+        const float similarity = glm::dot(vertices[wedge].normal, vertices[candidate].normal);
+        if (similarity > closest && sameAttributes(vertices[candidate], vertices[sibling->second])) {
+          closest = similarity;
+          target = candidate;
+        }
+      }
+      wedgeMap.push_back({wedge, target});
+    }
+
+    // Link condition, the two ends may only share the neighbors on the edge's
+    // own triangles or the collapse pinches the surface.
+    gatherNeighbors(from, fromNeighbors);
+    gatherNeighbors(to, toNeighbors);
+    size_t shared = 0;
+    for (size_t i = 0, j = 0; i < fromNeighbors.size() && j < toNeighbors.size();) {
+      if (fromNeighbors[i] < toNeighbors[j]) {
+        i++;
+      } else if (toNeighbors[j] < fromNeighbors[i]) {
+        j++;
+      } else {
+        shared++;
+        i++;
+        j++;
+      }
+    }
+    if (shared > edgeTriangles.size()) {
+      return false;
+    }
+
+    for (uint32_t triangle : positionTriangles[from]) {
+      if (!triangleAlive[triangle] || cornerAt(triangle, to) != UINT32_MAX) {
+        continue;
+      }
+      uint32_t before[3];
+      uint32_t after[3];
+      for (int corner = 0; corner < 3; corner++) {
+        before[corner] = position[corners[triangle * 3 + corner]];
+        after[corner] = before[corner] == from ? to : before[corner];
+      }
+      const glm::vec3 normalBefore = triangleNormal(before[0], before[1], before[2]);
+      const glm::vec3 normalAfter = triangleNormal(after[0], after[1], after[2]);
+      const float lengthBefore = glm::length(normalBefore);
+      if (lengthBefore > 0.0f &&
+          glm::dot(normalBefore, normalAfter) <= FLIP_THRESHOLD * lengthBefore * glm::length(normalAfter)) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  // A global priority queue over every edge thrashes the cache on big meshes.
+  // Instead work in passes: cost every edge, then walk the cheapest ones in
+  // order and collapse each one whose ends nothing else touched this pass, as
+  // their quadrics and therefore the cost are still accurate.
+  const double errorLimit = static_cast<double>(targetError) * targetError;
+  double worstError = 0.0;
+  std::vector<Collapse> candidates;
+  std::vector<uint32_t> touchedPass(vertexCount, 0);
+  bool unrestricted = false;
+  for (uint32_t pass = 1; liveTriangles * 3 > targetIndexCount; pass++) {
+    candidates.clear();
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+      if (!triangleAlive[triangle]) {
+        continue;
+      }
+      for (int corner = 0; corner < 3; corner++) {
+        const uint32_t a = position[corners[triangle * 3 + corner]];
+        const uint32_t b = position[corners[triangle * 3 + (corner + 1) % 3]];
+        // Interior edges show up once from each side, keep one. Borders only
+        // have the one side, so they are always kept.
+        if (a > b && kind[a] == INTERIOR && kind[b] == INTERIOR) {
+          continue;
+        }
+        auto allowed = [&](uint32_t from, uint32_t to) {
+          return kind[from] == INTERIOR || (kind[from] == CONSTRAINED && kind[to] != INTERIOR);
+        };
+        Quadric merged = quadrics[a];
+        merged.add(quadrics[b]);
+        const bool towardsB = allowed(a, b);
+        const bool towardsA = allowed(b, a);
+        const double costB = towardsB ? merged.error(vertices[b].pos) : 0.0;
+        const double costA = towardsA ? merged.error(vertices[a].pos) : 0.0;
+        if (towardsB && (!towardsA || costB <= costA)) {
+          if (costB <= errorLimit) candidates.push_back({a, b, costB});
+        } else if (towardsA) {
+          if (costA <= errorLimit) candidates.push_back({b, a, costA});
+        }
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+    if (candidates.empty()) {
+      break;
+    }
+    // Every collapse removes about two triangles. Taking much more expensive
+    // collapses than the ones we would need in an ideal pass just because
+    // their ends are free lowers the quality, so the pass stops there and the
+    // next one re-costs what is left.
+    const size_t needed = std::min(candidates.size() - 1, (liveTriangles - targetIndexCount / 3) / 2);
+    const double passLimit = unrestricted ? errorLimit : candidates[needed].cost * 1.5;
+
+    size_t collapsed = 0;
+    for (size_t i = 0; i < candidates.size() && liveTriangles * 3 > targetIndexCount; i++) {
+      const uint32_t from = candidates[i].from;
+      const uint32_t to = candidates[i].to;
+      if (candidates[i].cost > passLimit) {
+        break;
+      }
+      if (touchedPass[from] == pass || touchedPass[to] == pass || !canCollapse(from, to)) {
+        continue;
+      }
+
+      for (uint32_t triangle : positionTriangles[from]) {
+        if (!triangleAlive[triangle]) {
+          continue;
+        }
+        if (cornerAt(triangle, to) != UINT32_MAX) {
+          triangleAlive[triangle] = false;
+          liveTriangles--;
+          continue;
+        }
+        for (int corner = 0; corner < 3; corner++) {
+          uint32_t &wedge = corners[triangle * 3 + corner];
+          if (position[wedge] == from) {
+            wedge = std::find_if(wedgeMap.begin(), wedgeMap.end(), [&](const auto &entry) { return entry.first == wedge; })->second;
+          }
+        }
+        positionTriangles[to].push_back(triangle);
+      }
+      positionTriangles[from] = std::vector<uint32_t>();
+      std::vector<uint32_t> &around = positionTriangles[to];
+      around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t triangle) { return !triangleAlive[triangle]; }), around.end());
+
+      quadrics[to].add(quadrics[from]);
+      touchedPass[from] = pass;
+      touchedPass[to] = pass;
+      worstError = std::max(worstError, candidates[i].cost);
+      collapsed++;
+    }
+    if (collapsed == 0 && unrestricted) {
+      break;
+    }
+    // A pass that barely got anywhere was held back by cheap collapses that
+    // keep getting rejected, let the next one go through the whole list.
+    unrestricted = collapsed == 0 || collapsed * 8 < needed;
+  }
+
+  destination.clear();
+  destination.reserve(liveTriangles * 3);
+  for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+    if (triangleAlive[triangle]) {
+      destination.insert(destination.end(), corners.begin() + triangle * 3, corners.begin() + triangle * 3 + 3);
+    }
+  }
+  return static_cast<float>(std::sqrt(worstError));
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "../utils/types.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Quadric error mesh simplification (Garland & Heckbert 1997). Only whole
+// edges collapse onto one of their existing endpoints, so the result is a new
+// index buffer over the same vertex buffer, ready to be used as an LOD level.
+class Simplifier {
+public:
+  // Collapses edges, cheapest first, until destination holds at most
+  // targetIndexCount indices or the next collapse would move the surface more
+  // than targetError. Returns the largest error it had to accept, the RMS
+  // distance to the collapsed area's planes in model space. Borders and UV
+  // seams only slide along themselves, and collapses that would flip a
+  // triangle are skipped.
+  static float simplify(const std::vector<Agnosia_T::Vertex> &vertices, const std::vector<uint32_t> &indices,
+                        size_t targetIndexCount, float targetError, std::vector<uint32_t> &destination);
+};
@@ -1,11 +1,64 @@
 #include "../devicelibrary.h"
 #include "buffers.h"
+#include "cookedtexture.h"
+#include "ktxtexture.h"
+#include "mipdownsampler.h"
+#include "mipgen.h"
 #include "texture.h"
+#include "uploadqueue.h"
 #include "../utils/deletion.h"
+#include "../utils/sourcestamp.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
+
+// stb_image always allocates the image it hands back. While decode() has a sink
+// set, the allocation of exactly the decoded size gets the mapped staging buffer
+// instead, so the pixels are written where the GPU copies them from. Everything
+// else stb needs still comes from the heap.
+struct DecodeSink {
+  unsigned char *target = nullptr;
+  size_t size = 0;
+  bool taken = false;
+};
+thread_local DecodeSink decodeSink;
+
+void *sinkMalloc(size_t size) {
+  if (decodeSink.target != nullptr && !decodeSink.taken && size == decodeSink.size) {
+    decodeSink.taken = true;
+    return decodeSink.target;
+  }
+  return malloc(size);
+}
+void sinkFree(void *pointer) {
+  if (pointer != nullptr && pointer == decodeSink.target) {
+    decodeSink.taken = false;
+    return;
+  }
+  free(pointer);
+}
+void *sinkRealloc(void *pointer, size_t size) {
+  if (pointer != nullptr && pointer == decodeSink.target) {
+    // The staging buffer can't grow, move it out to the heap.
+    void *moved = malloc(size);
+    if (moved != nullptr) {
+      memcpy(moved, pointer, std::min(size, decodeSink.size));
+    }
+    decodeSink.taken = false;
+    return moved;
+  }
+  return realloc(pointer, size);
+}
+#define STBI_MALLOC(size) sinkMalloc(size)
+#define STBI_REALLOC(pointer, size) sinkRealloc(pointer, size)
+#define STBI_FREE(pointer) sinkFree(pointer)
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
@@ -15,50 +68,19 @@ VkPipelineStageFlags destinationStage;
 
 Texture::Image colorImage;
 Texture::Image depthImage;
+Texture::Image placeholderImage;
+std::atomic<Texture::MipMode> mipMode = Texture::MIPS_KAISER;
+std::atomic<bool> streaming = true;
 
-VkCommandBuffer beginSingleTimeCommands() {
-  // This is a neat function! This sets up a command buffer using our previously
-  // set command pool to return a command buffer to execute commands!
-  VkCommandBufferAllocateInfo allocInfo = {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-    .commandPool = Buffers::getCommandPool(),
-    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-    .commandBufferCount = 1,
-  };
-  
-  VkCommandBuffer commandBuffer;
-  vkAllocateCommandBuffers(DeviceControl::getDevice(), &allocInfo, &commandBuffer);
-
-  VkCommandBufferBeginInfo beginInfo = {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-  };
-  vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-  return commandBuffer;
-}
-void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-  // This function takes a command buffer with the data we wish to execute and
-  // submits it to the graphics queue. Afterwards, it purges the command buffer.
-  vkEndCommandBuffer(commandBuffer);
-
-  VkSubmitInfo submitInfo = {
-  .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-  .commandBufferCount = 1,
-  .pCommandBuffers = &commandBuffer,
-  };
-  vkQueueSubmit(DeviceControl::getGraphicsQueue(), 1, &submitInfo,
-                VK_NULL_HANDLE);
-  vkQueueWaitIdle(DeviceControl::getGraphicsQueue());
-
-  vkFreeCommandBuffers(DeviceControl::getDevice(), Buffers::getCommandPool(), 1, &commandBuffer);
-}
+// When streaming, levels this wide and under go up with the texture, 128x128 is
+// under 100 KB even as RGBA8 and looks fine until the bigger levels arrive.
+constexpr uint32_t STREAM_TAIL_EXTENT = 128;
 
 void transitionImageLayout(VkImage image, VkFormat format,
                            VkImageLayout oldLayout, VkImageLayout newLayout,
                            uint32_t mipLevels) {
   // This function handles transitioning image layout data from one layout to another.
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+  VkCommandBuffer commandBuffer = UploadQueue::getCommandBuffer();
 
   VkImageMemoryBarrier barrier{};
   barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -94,14 +116,12 @@ void transitionImageLayout(VkImage image, VkFormat format,
 
   vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0,
                        nullptr, 0, nullptr, 1, &barrier);
-
-  endSingleTimeCommands(commandBuffer);
 }
 void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
                        uint32_t height) {
   // This handles copying from the buffer to the image, specifically what
   // *parts* to copy to the image.
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+  VkCommandBuffer commandBuffer = UploadQueue::getCommandBuffer();
 
   VkBufferImageCopy region{};
   region.bufferOffset = 0;
@@ -118,8 +138,52 @@ void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
 
   vkCmdCopyBufferToImage(commandBuffer, buffer, image,
                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
 
-  endSingleTimeCommands(commandBuffer);
+void copyChainToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, const VkDeviceSize *levelOffsets, uint32_t mipLevels) {
+  // Every level is already in the buffer, one copy with a region per level then
+  // a single barrier for the whole image, instead of a barrier and blit per level.
+  // width and height are those of the first offset's level, the image's level 0.
+  VkCommandBuffer commandBuffer = UploadQueue::getCommandBuffer();
+
+  std::vector<VkBufferImageCopy> regions(mipLevels);
+  for (uint32_t level = 0; level < mipLevels; level++) {
+    regions[level] = {
+      .bufferOffset = levelOffsets[level],
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .mipLevel = level,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+      },
+      .imageOffset = {0, 0, 0},
+      .imageExtent = {MipGenerator::getLevelSize(width, level), MipGenerator::getLevelSize(height, level), 1},
+    };
+  }
+  vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         static_cast<uint32_t>(regions.size()), regions.data());
+
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+    .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = image,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .baseMipLevel = 0,
+      .levelCount = mipLevels,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    },
+  };
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                       nullptr, 0, nullptr, 1, &barrier);
 }
 
 bool hasStencilComponent(VkFormat format) {
@@ -136,7 +200,7 @@ void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t textureWidth,
     throw std::runtime_error("texture image format does not support linear blitting!");
   }
 
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+  VkCommandBuffer commandBuffer = UploadQueue::getCommandBuffer();
 
   // Specify the parameters of an image memory barrier
   VkImageMemoryBarrier barrier{};
@@ -205,33 +269,346 @@ void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t textureWidth,
   vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0,
                        nullptr, 1, &barrier);
+}
+
+Texture::Pixels::Pixels(Pixels &&other)
+  : staging(std::exchange(other.staging, {})), heap(std::move(other.heap)), data(std::exchange(other.data, nullptr)), width(other.width), height(other.height),
+    size(other.size), imageFormat(other.imageFormat), levelOffsets(std::move(other.levelOffsets)), levelSizes(std::move(other.levelSizes)) {}
+Texture::Pixels &Texture::Pixels::operator=(Pixels &&other) {
+  std::swap(this->staging, other.staging);
+  std::swap(this->heap, other.heap);
+  std::swap(this->data, other.data);
+  std::swap(this->width, other.width);
+  std::swap(this->height, other.height);
+  std::swap(this->size, other.size);
+  std::swap(this->imageFormat, other.imageFormat);
+  std::swap(this->levelOffsets, other.levelOffsets);
+  std::swap(this->levelSizes, other.levelSizes);
+  return *this;
+}
+Texture::Pixels::~Pixels() {
+  if (this->staging.buffer != VK_NULL_HANDLE) {
+    vmaDestroyBuffer(Buffers::getAllocator(), this->staging.buffer, this->staging.allocation);
+  }
+}
 
-  endSingleTimeCommands(commandBuffer);
+// A mapped staging buffer for width x height RGBA8 pixels, size bytes big so the
+// mip chain can follow level 0. Random access rather than sequential write, the
+// decoders and MipGenerator read back what they wrote (PNG unfiltering reads the
+// row above), which would crawl on uncached write combined memory. Past a chunk
+// the pixels go to the heap, a huge scan shouldn't hold all of itself in host
+// visible memory on top of the ring it's uploaded through.
+Texture::Pixels stagePixels(int width, int height, size_t size) {
+  Texture::Pixels pixels;
+  if (size > UploadQueue::getChunkSize()) {
+    pixels.heap = std::make_unique<unsigned char[]>(size);
+    pixels.data = pixels.heap.get();
+  } else {
+    pixels.staging = Buffers::createBuffer(size,
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VMA_MEMORY_USAGE_AUTO);
+    pixels.data = static_cast<unsigned char *>(pixels.staging.info.pMappedData);
+  }
+  pixels.width = width;
+  pixels.height = height;
+  pixels.size = size;
+  return pixels;
+}
+// Makes what was written to the staging buffer visible to the GPU, heap pixels
+// are flushed chunk by chunk as they are uploaded.
+void flushPixels(const Texture::Pixels &pixels) {
+  if (pixels.staging.buffer != VK_NULL_HANDLE) {
+    vmaFlushAllocation(Buffers::getAllocator(), pixels.staging.allocation, 0, VK_WHOLE_SIZE);
+  }
+}
+// The copies out of it are only recorded, the staging buffer goes once they're done.
+void releaseStaging(Texture::Pixels &pixels) {
+  if (pixels.staging.buffer != VK_NULL_HANDLE) {
+    UploadQueue::release(std::exchange(pixels.staging, {}));
+  }
 }
 
-Texture::Texture(const std::string& ID, const std::string& texturePath) {
-  int textureWidth, textureHeight, textureChannels;
-  stbi_uc *pixels = stbi_load(texturePath.c_str(), &textureWidth, &textureHeight, &textureChannels, STBI_rgb_alpha);
+// Only the four channel formats have sRGB variants, the rest only hold data.
+VkFormat getBlockImageFormat(BlockCompressor::Format format, bool srgb) {
+  switch (format) {
+  case BlockCompressor::FORMAT_BC1:
+    return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+  case BlockCompressor::FORMAT_BC4:
+    return VK_FORMAT_BC4_UNORM_BLOCK;
+  case BlockCompressor::FORMAT_BC5:
+    return VK_FORMAT_BC5_UNORM_BLOCK;
+  case BlockCompressor::FORMAT_BC7:
+    return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+  case BlockCompressor::FORMAT_R8:
+    return VK_FORMAT_R8_UNORM;
+  case BlockCompressor::FORMAT_RG8:
+    return VK_FORMAT_R8G8_UNORM;
+  default:
+    return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+  }
+}
 
-  this->mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(textureWidth, textureHeight)))) + 1;
+// Fills in the image format, level offsets and sizes of a chain we built ourselves.
+void describeChain(Texture::Pixels &pixels, BlockCompressor::Format format, bool srgb) {
+  pixels.imageFormat = getBlockImageFormat(format, srgb);
+  const uint32_t levelCount = MipGenerator::getLevelCount(pixels.width, pixels.height);
+  pixels.levelOffsets.resize(levelCount);
+  pixels.levelSizes.resize(levelCount);
+  for (uint32_t level = 0; level < levelCount; level++) {
+    pixels.levelOffsets[level] = BlockCompressor::getLevelOffset(pixels.width, pixels.height, level, format);
+    pixels.levelSizes[level] = BlockCompressor::getLevelSize(MipGenerator::getLevelSize(pixels.width, level),
+                                                             MipGenerator::getLevelSize(pixels.height, level), format);
+  }
+}
 
-  VkDeviceSize imageSize = textureWidth * textureHeight * 4;
+// Stages a KTX2 file's levels as they are laid out in the file, no decoding.
+Texture::Pixels loadKtx(const std::string &texturePath) {
+  KtxTexture ktx(texturePath);
+  if (!ktx.isValid()) {
+    return {};
+  }
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(DeviceControl::getPhysicalDevice(), ktx.getFormat(), &properties);
+  if (!(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+    return {};
+  }
+  Texture::Pixels pixels = stagePixels(ktx.getWidth(), ktx.getHeight(), ktx.getDataSize());
+  memcpy(pixels.data, ktx.getData(), ktx.getDataSize());
+  flushPixels(pixels);
+  pixels.imageFormat = ktx.getFormat();
+  pixels.levelOffsets.resize(ktx.getLevelCount());
+  pixels.levelSizes.resize(ktx.getLevelCount());
+  for (uint32_t level = 0; level < ktx.getLevelCount(); level++) {
+    pixels.levelOffsets[level] = ktx.getLevelOffset(level);
+    pixels.levelSizes[level] = ktx.getLevel(level).byteLength;
+  }
+  return pixels;
+}
 
-  if (!pixels) {
-    throw std::runtime_error("Failed to load texture!");
+BlockCompressor::Format Texture::getStorageFormat(Usage usage, bool compress) {
+  switch (usage) {
+  case USAGE_MASK:
+    return compress ? BlockCompressor::FORMAT_BC4 : BlockCompressor::FORMAT_R8;
+  case USAGE_VECTOR:
+    return compress ? BlockCompressor::FORMAT_BC5 : BlockCompressor::FORMAT_RG8;
+  default:
+    return compress ? BlockCompressor::FORMAT_BC7 : BlockCompressor::FORMAT_RGBA8;
   }
-  Agnosia_T::AllocatedBuffer stagingBuffer = Buffers::createBuffer(imageSize,
-    VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-    VMA_MEMORY_USAGE_AUTO);
-  
-  void *data;
-    
-  vmaMapMemory(Buffers::getAllocator(), stagingBuffer.allocation, &data);
-  memcpy(data, pixels, static_cast<size_t>(imageSize));
-  vmaUnmapMemory(Buffers::getAllocator(), stagingBuffer.allocation);
-    
-  stbi_image_free(pixels);
+}
+
+// Everything decode and decodePacked share: the cooked chain if it is still
+// good, otherwise staging, mips, compression and cooking. probe gives the size
+// without reading any pixels, load writes the RGBA8 level 0 to its target.
+template <typename Probe, typename Load>
+Texture::Pixels buildPixels(const std::vector<std::string> &sources, const std::string &cookedPath, Texture::Usage usage,
+                            BlockCompressor::Format format, Probe probe, Load load) {
+  SourceStamp stamp;
+  if (!stampSources(sources, stamp)) {
+    return {};
+  }
+  // Read once, the staging size and what goes into it have to agree.
+  const Texture::MipMode mode = mipMode;
+  const bool cpuMips = mode != Texture::MIPS_BLIT || format != BlockCompressor::FORMAT_RGBA8;
+  const MipGenerator::Filter filter = mode == Texture::MIPS_BOX ? MipGenerator::FILTER_BOX : MipGenerator::FILTER_KAISER;
+  const bool srgb = usage == Texture::USAGE_COLOR;
+  if (cpuMips) {
+    CookedTexture cooked(cookedPath, stamp, filter, format, srgb);
+    if (cooked.isValid()) {
+      Texture::Pixels pixels = stagePixels(cooked.getWidth(), cooked.getHeight(), cooked.getChainSize());
+      memcpy(pixels.data, cooked.getChain(), cooked.getChainSize());
+      flushPixels(pixels);
+      describeChain(pixels, format, srgb);
+      return pixels;
+    }
+  }
+
+  // The headers alone are enough to size the staging buffer before decoding.
+  int textureWidth, textureHeight;
+  if (!probe(textureWidth, textureHeight)) {
+    return {};
+  }
+  const size_t imageSize = static_cast<size_t>(textureWidth) * textureHeight * 4;
+  const size_t chainSize = cpuMips ? MipGenerator::getChainSize(textureWidth, textureHeight) : imageSize;
+  // RGBA8 goes straight into staging. Everything else builds the RGBA8 chain on
+  // the heap and only the blocks or channels kept from it are staged.
+  Texture::Pixels pixels;
+  std::vector<unsigned char> chain;
+  unsigned char *target;
+  if (format == BlockCompressor::FORMAT_RGBA8) {
+    pixels = stagePixels(textureWidth, textureHeight, chainSize);
+    pixels.imageFormat = getBlockImageFormat(format, srgb);
+    target = pixels.data;
+  } else {
+    chain.resize(chainSize);
+    target = chain.data();
+  }
+  if (!load(target, imageSize)) {
+    return {};
+  }
+  if (cpuMips) {
+    MipGenerator::generate(target, textureWidth, textureHeight, filter, srgb);
+    if (format != BlockCompressor::FORMAT_RGBA8) {
+      pixels = stagePixels(textureWidth, textureHeight, BlockCompressor::getChainSize(textureWidth, textureHeight, format));
+      BlockCompressor::compressChain(target, textureWidth, textureHeight, format, pixels.data);
+    }
+    describeChain(pixels, format, srgb);
+    CookedTexture::write(cookedPath, stamp, pixels.data, textureWidth, textureHeight, filter, srgb, format);
+  }
+  flushPixels(pixels);
+  return pixels;
+}
+
+Texture::Pixels Texture::decode(const std::string& texturePath, Usage usage, bool compress) {
+  if (KtxTexture::isKtxPath(texturePath)) {
+    return loadKtx(texturePath);
+  }
+  const BlockCompressor::Format format = getStorageFormat(usage, compress && DeviceControl::supportsTextureCompressionBC());
+  auto probe = [&](int &width, int &height) {
+    int channels;
+    return stbi_info(texturePath.c_str(), &width, &height, &channels) != 0;
+  };
+  auto load = [&](unsigned char *target, size_t imageSize) {
+    int width, height, channels;
+    decodeSink = {.target = target, .size = imageSize};
+    stbi_uc *decoded = stbi_load(texturePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    decodeSink = {};
+    if (!decoded) {
+      return false;
+    }
+    if (decoded != target) {
+      // Some other buffer of the same size got the sink first, the result went to the heap.
+      memcpy(target, decoded, imageSize);
+      stbi_image_free(decoded);
+    }
+    return true;
+  };
+  return buildPixels({texturePath}, CookedTexture::getCookedPath(texturePath, format), usage, format, probe, load);
+}
+
+// Where the packed chain is cooked, named after all three maps since one can be
+// packed with different partners by different materials. getCookedPath swaps
+// the extension.
+std::string getPackedPath(const std::string &occlusionPath, const std::string &roughnessPath, const std::string &metallicPath) {
+  std::filesystem::path packed(occlusionPath);
+  packed.replace_filename(packed.stem().string() + "_" + std::filesystem::path(roughnessPath).stem().string() + "_" +
+                          std::filesystem::path(metallicPath).stem().string() + ".orm");
+  return packed.string();
+}
+
+Texture::Pixels Texture::decodePacked(const std::string &occlusionPath, const std::string &roughnessPath, const std::string &metallicPath, bool compress) {
+  const std::vector<std::string> sources = {occlusionPath, roughnessPath, metallicPath};
+  const BlockCompressor::Format format = getStorageFormat(USAGE_DATA, compress && DeviceControl::supportsTextureCompressionBC());
+  auto probe = [&](int &width, int &height) {
+    for (size_t i = 0; i < sources.size(); i++) {
+      int sourceWidth, sourceHeight, channels;
+      if (!stbi_info(sources[i].c_str(), &sourceWidth, &sourceHeight, &channels) ||
+          (i > 0 && (sourceWidth != width || sourceHeight != height))) {
+        return false;
+      }
+      width = sourceWidth;
+      height = sourceHeight;
+    }
+    return true;
+  };
+  // Red of each map in turn, alpha stays opaque so BC7 spends nothing on it.
+  auto load = [&](unsigned char *target, size_t imageSize) {
+    for (size_t pixel = 3; pixel < imageSize; pixel += 4) {
+      target[pixel] = 255;
+    }
+    for (size_t i = 0; i < sources.size(); i++) {
+      int width, height, channels;
+      stbi_uc *decoded = stbi_load(sources[i].c_str(), &width, &height, &channels, STBI_rgb_alpha);
+      if (!decoded) {
+        return false;
+      }
+      for (size_t pixel = 0; pixel < imageSize; pixel += 4) {
+        target[pixel + i] = decoded[pixel];
+      }
+      stbi_image_free(decoded);
+    }
+    return true;
+  };
+  return buildPixels(sources, CookedTexture::getCookedPath(getPackedPath(occlusionPath, roughnessPath, metallicPath), format),
+                     USAGE_DATA, format, probe, load);
+}
+
+// Texels a block covers along each side and its bytes, 0 and 0 for formats the
+// engine doesn't build itself, a KTX2 file can hold anything.
+struct BlockInfo {
+  uint32_t extent;
+  uint32_t bytes;
+};
+BlockInfo getBlockInfo(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+    return {4, 8};
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+    return {4, 16};
+  case VK_FORMAT_R8_UNORM:
+    return {1, 1};
+  case VK_FORMAT_R8G8_UNORM:
+    return {1, 2};
+  case VK_FORMAT_R8G8B8A8_SRGB:
+  case VK_FORMAT_R8G8B8A8_UNORM:
+    return {1, 4};
+  default:
+    return {0, 0};
+  }
+}
+
+// Copies levels of pixels held on the heap into the image through the staging
+// ring, each in bands of whole block rows no bigger than an upload chunk. A
+// level of an unknown format goes as one piece. Without level offsets only
+// level 0 is there, as RGBA8.
+void streamLevelsToImage(const Texture::Pixels &pixels, VkImage image, uint32_t firstLevel, uint32_t mipLevels) {
+  const BlockInfo block = getBlockInfo(pixels.imageFormat);
+  for (uint32_t level = firstLevel; level < firstLevel + mipLevels; level++) {
+    const uint32_t levelWidth = MipGenerator::getLevelSize(pixels.width, level);
+    const uint32_t levelHeight = MipGenerator::getLevelSize(pixels.height, level);
+    const unsigned char *levelData = pixels.data + (pixels.levelOffsets.empty() ? 0 : pixels.levelOffsets[level]);
+    const size_t levelSize = pixels.levelSizes.empty() ? static_cast<size_t>(levelWidth) * levelHeight * 4 : pixels.levelSizes[level];
+    const uint32_t rowExtent = block.extent != 0 ? block.extent : levelHeight;
+    const size_t rowBytes = block.extent != 0 ? static_cast<size_t>((levelWidth + block.extent - 1) / block.extent) * block.bytes : levelSize;
+    const size_t rows = (levelHeight + rowExtent - 1) / rowExtent;
+    UploadQueue::stageChunked(rows, rowBytes,
+                              [&](void *destination, size_t first, size_t count) {
+      memcpy(destination, levelData + first * rowBytes, count * rowBytes);
+    },
+                              [&](VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, size_t first, size_t count) {
+      const uint32_t top = static_cast<uint32_t>(first) * rowExtent;
+      const VkBufferImageCopy region = {
+        .bufferOffset = offset,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+          .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+          .mipLevel = level - firstLevel,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+        .imageOffset = {0, static_cast<int32_t>(top), 0},
+        .imageExtent = {levelWidth, std::min(static_cast<uint32_t>(count) * rowExtent, levelHeight - top), 1},
+      };
+      vkCmdCopyBufferToImage(cmd, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    });
+  }
+}
+
+// Copy staged pixels into a new sampled image holding mipLevels levels, starting
+// at firstLevel of the staged chain. Only a chain staged whole can start past 0.
+Texture::Image createTextureImage(const Texture::Pixels &pixels, uint32_t firstLevel, uint32_t mipLevels) {
+  const int textureWidth = static_cast<int>(MipGenerator::getLevelSize(pixels.width, firstLevel));
+  const int textureHeight = static_cast<int>(MipGenerator::getLevelSize(pixels.height, firstLevel));
+  const VkFormat imageFormat = pixels.imageFormat;
+  // Without the whole chain staged the levels are made on the GPU, by compute
+  // when it can, blitting otherwise.
+  const bool stagedChain = pixels.levelOffsets.size() == firstLevel + mipLevels;
+  const bool computeMips = !stagedChain && mipLevels > 1 && MipDownsampler::supports(imageFormat);
   
   VkImageCreateInfo imageInfo{};
   imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -241,37 +618,159 @@ Texture::Texture(const std::string& ID, const std::string& texturePath) {
   imageInfo.extent.depth = 1;
   imageInfo.mipLevels = 1;
   imageInfo.arrayLayers = 1;
-  imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+  imageInfo.format = imageFormat;
   imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
   imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
   imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
   imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   imageInfo.mipLevels = mipLevels;
+  if (computeMips) {
+    imageInfo.flags |= MipDownsampler::getImageFlags();
+    imageInfo.usage |= MipDownsampler::getImageUsage();
+  }
 
   VmaAllocationCreateInfo vmaCreateInfo = {
     .usage = VMA_MEMORY_USAGE_GPU_ONLY,
   };
-  VmaAllocation alloc;
+  Texture::Image texture;
   VmaAllocationInfo allocInfo;
   
-  vmaCreateImage(Buffers::getAllocator(), &imageInfo, &vmaCreateInfo, &this->image, &alloc, &allocInfo);
+  vmaCreateImage(Buffers::getAllocator(), &imageInfo, &vmaCreateInfo, &texture.image, &texture.alloc, &allocInfo);
+
+  transitionImageLayout(texture.image, imageFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+  // Heap pixels stream through the staging ring, the copies may be spread
+  // over several upload batches.
+  const bool heapPixels = pixels.staging.buffer == VK_NULL_HANDLE;
+  if (stagedChain && heapPixels) {
+    streamLevelsToImage(pixels, texture.image, firstLevel, mipLevels);
+    transitionImageLayout(texture.image, imageFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
+  } else if (stagedChain) {
+    copyChainToImage(pixels.staging.buffer, texture.image, static_cast<uint32_t>(textureWidth), static_cast<uint32_t>(textureHeight),
+                     pixels.levelOffsets.data() + firstLevel, mipLevels);
+  } else {
+    if (heapPixels) {
+      streamLevelsToImage(pixels, texture.image, 0, 1);
+    } else {
+      copyBufferToImage(pixels.staging.buffer, texture.image, static_cast<uint32_t>(textureWidth), static_cast<uint32_t>(textureHeight));
+    }
+    if (computeMips) {
+      MipDownsampler::generate(texture.image, imageFormat, static_cast<uint32_t>(textureWidth), static_cast<uint32_t>(textureHeight), mipLevels);
+    } else {
+      generateMipmaps(texture.image, imageFormat, textureWidth, textureHeight, mipLevels);
+    }
+  }
+  // Create a texture image view, which is a struct of information about the image.
+  // Sampled only, an sRGB format can't back the storage usage compute mips add.
+  texture.imageView = DeviceControl::createImageView(texture.image, imageFormat, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, VK_IMAGE_USAGE_SAMPLED_BIT);
 
-  transitionImageLayout(this->image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, this->mipLevels);
-  copyBufferToImage(stagingBuffer.buffer, this->image, static_cast<uint32_t>(textureWidth), static_cast<uint32_t>(textureHeight));
+  return texture;
+}
 
-  vmaDestroyBuffer(Buffers::getAllocator(), stagingBuffer.buffer, stagingBuffer.allocation);
+Texture::Texture(const std::string& ID, const std::string& texturePath, Usage usage, bool compress) {
+  upload(decode(texturePath, usage, compress));
+}
+Texture::Texture(const std::string& ID)
+  : mipLevels(1), image(placeholderImage.image), imageView(placeholderImage.imageView) {}
+
+// Frees an image once the upload batch open now is done, and with it every frame already submitted.
+void releaseImage(VkImage image, VkImageView imageView, VmaAllocation allocation) {
+  UploadQueue::release([=]() {
+    vkDestroyImageView(DeviceControl::getDevice(), imageView, nullptr);
+    vmaDestroyImage(Buffers::getAllocator(), image, allocation);
+  });
+}
 
-  generateMipmaps(this->image, VK_FORMAT_R8G8B8A8_SRGB, textureWidth, textureHeight, this->mipLevels);
-  // Create a texture image view, which is a struct of information about the image.
-  this->imageView = DeviceControl::createImageView(this->image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+// Bytes of the staged levels from firstLevel down to the smallest.
+size_t getLevelsSize(const Texture::Pixels &pixels, uint32_t firstLevel) {
+  size_t size = 0;
+  for (uint32_t level = firstLevel; level < pixels.levelSizes.size(); level++) {
+    size += pixels.levelSizes[level];
+  }
+  return size;
+}
 
-  VkImage image = this->image;
-  VkImageView imageView = this->imageView;
-  
-  DeletionQueue::get().push_function([=](){vmaDestroyImage(Buffers::getAllocator(), image, alloc);});
-  DeletionQueue::get().push_function([=](){vkDestroyImageView(DeviceControl::getDevice(), imageView, nullptr);});
-  
+void Texture::upload(Pixels &&pixels) {
+  if (!pixels.data) {
+    throw std::runtime_error("Failed to load texture!");
+  }
+  // Whatever levels came staged, a KTX2 file may hold fewer than the full chain.
+  this->mipLevels = pixels.levelOffsets.empty() ? MipGenerator::getLevelCount(pixels.width, pixels.height)
+                                                : static_cast<uint32_t>(pixels.levelOffsets.size());
+  // Blitted mips only ever exist on the GPU, there is nothing to stream them from.
+  this->residentLevel = 0;
+  if (streaming && !pixels.levelOffsets.empty()) {
+    while (this->residentLevel + 1 < this->mipLevels &&
+           std::max(MipGenerator::getLevelSize(pixels.width, this->residentLevel),
+                    MipGenerator::getLevelSize(pixels.height, this->residentLevel)) > STREAM_TAIL_EXTENT) {
+      this->residentLevel++;
+    }
+  }
+
+  Texture::Image texture = createTextureImage(pixels, this->residentLevel, this->mipLevels - this->residentLevel);
+  this->image = texture.image;
+  this->imageView = texture.imageView;
+  this->allocation = texture.alloc;
+  this->loaded = true;
+  this->imageFormat = pixels.imageFormat;
+  this->width = static_cast<uint32_t>(pixels.width);
+  this->height = static_cast<uint32_t>(pixels.height);
+  this->memorySize = pixels.levelOffsets.empty() ? BlockCompressor::getChainSize(pixels.width, pixels.height, BlockCompressor::FORMAT_RGBA8)
+                                                 : getLevelsSize(pixels, this->residentLevel);
+  if (this->residentLevel > 0) {
+    this->source = std::move(pixels);
+  } else {
+    releaseStaging(pixels);
+  }
+}
+size_t Texture::getStreamSize(uint32_t level) {
+  if (level >= this->residentLevel) {
+    return 0;
+  }
+  return getLevelsSize(this->source, level);
+}
+size_t Texture::streamIn(uint32_t level) {
+  if (level >= this->residentLevel) {
+    return 0;
+  }
+  // A new image rather than sparse residency, the levels already up are copied
+  // again from staging. They're a third of the new level at most.
+  Texture::Image texture = createTextureImage(this->source, level, this->mipLevels - level);
+  // Frames in flight may still sample the old image.
+  releaseImage(this->image, this->imageView, this->allocation);
+  this->image = texture.image;
+  this->imageView = texture.imageView;
+  this->allocation = texture.alloc;
+  this->residentLevel = level;
+  this->memorySize = getLevelsSize(this->source, level);
+  if (level == 0) {
+    // Everything is up, the staged chain isn't needed anymore.
+    releaseStaging(this->source);
+    this->source = Pixels();
+  }
+  return this->memorySize;
+}
+Texture::~Texture() {
+  // The placeholder belongs to everyone, only an uploaded image is ours. Its
+  // copies or a streamed in level may not have been submitted yet.
+  if (this->loaded) {
+    releaseImage(this->image, this->imageView, this->allocation);
+  }
+  releaseStaging(this->source);
+}
+
+void Texture::createPlaceholderImage() {
+  const unsigned char color[4] = {128, 128, 128, 255};
+  Texture::Pixels grey = stagePixels(1, 1, sizeof(color));
+  memcpy(grey.data, color, sizeof(color));
+  flushPixels(grey);
+  grey.levelOffsets = {0};
+  grey.levelSizes = {sizeof(color)};
+  placeholderImage = createTextureImage(grey, 0, 1);
+  releaseStaging(grey);
+
+  DeletionQueue::get().push_function([=](){vmaDestroyImage(Buffers::getAllocator(), placeholderImage.image, placeholderImage.alloc);});
+  DeletionQueue::get().push_function([=](){vkDestroyImageView(DeviceControl::getDevice(), placeholderImage.imageView, nullptr);});
 }
 
 void Texture::createColorImage() {
@@ -332,9 +831,20 @@ void Texture::createDepthImage() {
 
 // ---------------------------- Getters & Setters ---------------------------------//
 uint32_t Texture::getMipLevels() { return this->mipLevels; }
+bool Texture::isLoaded() { return this->loaded; }
+uint32_t Texture::getWidth() { return this->width; }
+uint32_t Texture::getHeight() { return this->height; }
+VkFormat Texture::getImageFormat() { return this->imageFormat; }
+size_t Texture::getMemorySize() { return this->memorySize; }
+uint32_t Texture::getReferences() { return this->references; }
+uint32_t Texture::getResidentLevel() { return this->residentLevel; }
+bool Texture::isStreaming() { return this->residentLevel > 0; }
 
 Texture::Image &Texture::getColorImage() { return colorImage; }
 Texture::Image &Texture::getDepthImage() { return depthImage; }
+Texture::Image &Texture::getPlaceholderImage() { return placeholderImage; }
+std::atomic<Texture::MipMode> &Texture::getMipMode() { return mipMode; }
+std::atomic<bool> &Texture::getStreaming() { return streaming; }
 
 VkImage &Texture::getImage() { return this->image; }
 VkImageView &Texture::getImageView() { return this->imageView; }
@@ -1,25 +1,148 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 #include "volk.h"
 #include <cstdint>
 #include "vk_mem_alloc.h"
+#include "../utils/types.h"
+#include "blockcompressor.h"
 
 class Texture {
+  friend class AssetCache;
+
+public:
+  // Pixels decoded straight into a mapped staging buffer, ready to be copied
+  // into an image. Anything bigger than an upload chunk goes to the heap
+  // instead and streams through the staging ring when uploaded, see
+  // UploadQueue::getChunkSize. data is null if decoding failed.
+  struct Pixels {
+    Agnosia_T::AllocatedBuffer staging{};
+    std::unique_ptr<unsigned char[]> heap;
+    unsigned char *data = nullptr;
+    int width = 0;
+    int height = 0;
+    // Bytes staged.
+    size_t size = 0;
+    VkFormat imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+    // Where each level starts in data when they are all there
+    // already, the upload then copies them as is. Empty when only level 0 is
+    // staged, the rest get blitted from it, see MipMode.
+    std::vector<VkDeviceSize> levelOffsets;
+    // Bytes of each of those levels, what streaming one in costs.
+    std::vector<VkDeviceSize> levelSizes;
+
+    Pixels() = default;
+    Pixels(Pixels &&other);
+    Pixels &operator=(Pixels &&other);
+    ~Pixels();
+  };
+
+  // What the texels hold, which decides the channels kept and whether they are
+  // sRGB encoded. Only color is, gamma on anything else skews its mips and the
+  // values the shader reads.
+  enum Usage {
+    // sRGB RGBA, albedo and other colors.
+    USAGE_COLOR,
+    // Linear RGBA, maps packing several values.
+    USAGE_DATA,
+    // Linear red only, metallic, roughness, occlusion. A quarter of RGBA.
+    USAGE_MASK,
+    // Linear red and green, tangent space normals.
+    USAGE_VECTOR,
+  };
+
+  // Where the smaller mip levels come from.
+  enum MipMode {
+    // Blit each level from the one above on the GPU, every load.
+    MIPS_BLIT,
+    // Filter on the CPU in linear space and cache the chain next to the source, see CookedTexture.
+    MIPS_BOX,
+    MIPS_KAISER,
+  };
+
 protected:
   uint32_t mipLevels;
   VkImage image;
   VkImageView imageView;
+  VmaAllocation allocation = VK_NULL_HANDLE;
+  bool loaded = false;
+  VkFormat imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+  uint32_t width = 1;
+  uint32_t height = 1;
+  size_t memorySize = 0;
+  // AssetCache's key for the source bytes, its files until an async load has
+  // hashed them, and the IDs aliasing this texture.
+  uint64_t contentKey = 0;
+  uint32_t references = 0;
+  // Levels below this one are not in the image yet, its level 0 is this level
+  // of the texture. Until they all are, the staged chain is kept to stream them
+  // in from, see streamIn.
+  uint32_t residentLevel = 0;
+  Pixels source;
+
+  // Create the image from decoded pixels, replacing the placeholder. With
+  // streaming on only the smallest levels of a staged chain are uploaded.
+  void upload(Pixels &&pixels);
 
 public:
-  Texture(const std::string& ID, const std::string& texturePath);
+  // Decodes and records the upload right away, see UploadQueue. Compressed textures are encoded on the CPU
+  // once and cooked, see getStorageFormat, and stay uncompressed on devices
+  // without BCn. A .ktx2 path is uploaded in whatever format and levels the
+  // file holds, usage and compress are ignored then.
+  Texture(const std::string& ID, const std::string& texturePath, Usage usage = USAGE_COLOR, bool compress = false);
+  // Shows the placeholder image until AssetCache uploads the real one, see AssetCache::fetchLoadTextureAsync.
+  explicit Texture(const std::string& ID);
+  Texture(const Texture &) = delete;
+  Texture &operator=(const Texture &) = delete;
+  // Frees the image once the uploads recorded so far and the frames already
+  // submitted are done with it, see UploadQueue::release.
+  ~Texture();
+
+  // No GPU work, safe to call from any thread. Unless the mip mode is MIPS_BLIT
+  // the whole chain comes back, read from the cooked file or built and cooked.
+  // Anything stored other than as RGBA8 always takes the CPU mips, the GPU
+  // can't blit blocks and the channels are dropped after filtering.
+  static Pixels decode(const std::string& texturePath, Usage usage = USAGE_COLOR, bool compress = false);
+  // Occlusion, roughness and metallic in the red, green and blue of one linear
+  // texture, glTF's ORM layout, so a material samples it once instead of three
+  // times. Each map gives its red channel, they must all be the same size or
+  // this fails like any other decode. The packed chain is cooked like any other.
+  static Pixels decodePacked(const std::string& occlusionPath, const std::string& roughnessPath, const std::string& metallicPath, bool compress = false);
+  // BC7 for four channels, BC4 and BC5 for one and two, or their uncompressed
+  // counterparts.
+  static BlockCompressor::Format getStorageFormat(Usage usage, bool compress);
 
   VkImage& getImage();
   VkImageView& getImageView();
   uint32_t getMipLevels();
+  // False while the texture is still showing the placeholder.
+  bool isLoaded();
+  uint32_t getWidth();
+  uint32_t getHeight();
+  VkFormat getImageFormat();
+  // Bytes of every mip level in the image, 0 for the placeholder.
+  size_t getMemorySize();
+  // IDs sharing this texture in AssetCache.
+  uint32_t getReferences();
+  // Finest level in the image, 0 once the texture is fully resident.
+  uint32_t getResidentLevel();
+  // True while levels are still waiting to be streamed in.
+  bool isStreaming();
+  // Bytes streamIn(level) would copy, 0 if the level is already resident.
+  size_t getStreamSize(uint32_t level);
+  // Replaces the image with one holding every level from level down, copied
+  // from the kept chain, and frees the old one once no frame samples it. The
+  // descriptors still point at the old view, rewrite them before the next
+  // frame. Returns the bytes copied.
+  size_t streamIn(uint32_t level);
   
   static void createDepthImage();
   static void createColorImage();
+  // A 1x1 grey texture that async loads stand in with, needs the command pool.
+  static void createPlaceholderImage();
   
   // ------------ Getters & Setters ------------ //
   struct Image {
@@ -29,4 +152,10 @@ public:
   };
   static Image &getColorImage();
   static Image &getDepthImage();
+  static Image &getPlaceholderImage();
+  // Both read by decode jobs on the pool while the UI or benchmark flips them.
+  static std::atomic<MipMode> &getMipMode();
+  // Textures uploaded while this is on start with their smallest levels only
+  // and leave the rest to TextureStreamer.
+  static std::atomic<bool> &getStreaming();
 };
@@ -0,0 +1,101 @@
+#include "texturestreamer.h"
+#include "../devicelibrary.h"
+#include "buffers.h"
+#include "graphicspipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+size_t frameBudget = 16 << 20;
+size_t streamedBytes = 0;
+uint32_t streamingCount = 0;
+
+struct StreamRequest {
+  Texture *texture;
+  // Finest level any model using the texture wants.
+  uint32_t level;
+  // Largest projected area of those models in pixels, the most visible go first.
+  float coverage;
+};
+
+void TextureStreamer::update(AssetCache &cache) {
+  streamedBytes = 0;
+  const float *camPos = Graphics::getCamPos();
+  const glm::vec3 eye(camPos[0], camPos[1], camPos[2]);
+  // Same projection as the LOD selection in recordCommandBuffer.
+  const float pixelsPerUnit = DeviceControl::getSwapChainExtent().height / (2.0f * std::tan(glm::radians(Graphics::getDepthField()) * 0.5f));
+  const float nearPlane = Graphics::getDistanceField()[0];
+
+  std::unordered_map<Texture *, size_t> requestIndex;
+  std::vector<StreamRequest> requests;
+  for (Model *model : cache.getModels()) {
+    Mesh *mesh = model->getMesh();
+    const Agnosia_T::Bounds &bounds = mesh->getBounds();
+    const glm::vec3 center = model->getPos() + (bounds.min + bounds.max) * 0.5f;
+    const float distance = std::max(glm::length(eye - center) - bounds.radius, nearPlane);
+    const float projectedRadius = bounds.radius * pixelsPerUnit / distance;
+    const float coverage = projectedRadius * projectedRadius;
+
+    Material &material = model->getMaterial();
+    Texture *textures[] = {material.getDiffuseTexture(), material.getMetallicTexture(), material.getRoughnessTexture(),
+                           material.getAOTexture(), material.getPackedTexture()};
+    for (Texture *texture : textures) {
+      if (texture == nullptr || !texture->isStreaming()) {
+        continue;
+      }
+      // Texels under one pixel at the nearest point, every doubling of that is
+      // one level down. Without UVs worth measuring any level looks the same.
+      uint32_t level = texture->getMipLevels() - 1;
+      const float density = mesh->getUvDensity();
+      if (!Texture::getStreaming()) {
+        level = 0;
+      } else if (density > 0.0f) {
+        const float texelsPerPixel = density * std::max(texture->getWidth(), texture->getHeight()) * distance / pixelsPerUnit;
+        level = std::min(static_cast<uint32_t>(std::max(std::floor(std::log2(texelsPerPixel)), 0.0f)), level);
+      }
+      auto [it, inserted] = requestIndex.emplace(texture, requests.size());
+      if (inserted) {
+        requests.push_back({texture, level, coverage});
+      } else {
+        requests[it->second].level = std::min(requests[it->second].level, level);
+        requests[it->second].coverage = std::max(requests[it->second].coverage, coverage);
+      }
+    }
+  }
+  std::sort(requests.begin(), requests.end(), [](const StreamRequest &a, const StreamRequest &b) { return a.coverage > b.coverage; });
+
+  for (const StreamRequest &request : requests) {
+    Texture *texture = request.texture;
+    const uint32_t resident = texture->getResidentLevel();
+    if (request.level >= resident) {
+      continue;
+    }
+    // As fine as the budget left allows, a level at a time. The first step of
+    // a frame always goes, or a level bigger than the budget would never come.
+    uint32_t target = resident;
+    while (target > request.level && streamedBytes + texture->getStreamSize(target - 1) <= frameBudget) {
+      target--;
+    }
+    if (target == resident && streamedBytes == 0) {
+      target = resident - 1;
+    }
+    if (target < resident) {
+      streamedBytes += texture->streamIn(target);
+    }
+  }
+
+  streamingCount = 0;
+  for (Texture *texture : cache.getTextures()) {
+    streamingCount += texture->isStreaming();
+  }
+  if (streamedBytes > 0) {
+    Buffers::getMaterialDescriptorsDirty() = true;
+  }
+}
+
+size_t &TextureStreamer::getFrameBudget() { return frameBudget; }
+size_t TextureStreamer::getStreamedBytes() { return streamedBytes; }
+uint32_t TextureStreamer::getStreamingCount() { return streamingCount; }
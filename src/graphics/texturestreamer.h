@@ -0,0 +1,26 @@
+#pragma once
+
+#include "../assetcache.h"
+#include <cstddef>
+#include <cstdint>
+
+// Brings the levels a streaming texture left out (see Texture::getStreaming)
+// up as the models using it get close enough to need them. How close is
+// estimated on the CPU: the nearest point of each model's bounding sphere, its
+// mesh's UV density and the texture size give the texels one pixel covers,
+// which picks the mip level the sampler would use.
+class TextureStreamer {
+public:
+  // Once a frame before drawing. Streams the textures wanting finer levels,
+  // the ones covering the most of the screen first, until the frame's byte
+  // budget is spent, then marks the descriptors for the next frame to point at
+  // the new views.
+  static void update(AssetCache &cache);
+
+  // Bytes copied a frame at most, one step is always taken even if it alone is bigger.
+  static size_t &getFrameBudget();
+  // Bytes streamed in last update.
+  static size_t getStreamedBytes();
+  // Textures with levels still missing after the last update.
+  static uint32_t getStreamingCount();
+};
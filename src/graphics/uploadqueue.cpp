@@ -0,0 +1,295 @@
+#include "uploadqueue.h"
+#include "../devicelibrary.h"
+#include "../utils/deletion.h"
+#include "../utils/helpers.h"
+#include "buffers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// The dragon's buffers fit in one chunk, bigger meshes and textures stream through.
+std::atomic<VkDeviceSize> stagingBudget = 64ull << 20;
+
+// Bytes of the ring handed out, free again once ticket is done.
+struct StagingSpan {
+  VkDeviceSize begin;
+  VkDeviceSize end;
+  UploadQueue::Ticket ticket;
+};
+struct SubmittedBatch {
+  VkCommandBuffer commandBuffer;
+  UploadQueue::Ticket ticket;
+};
+struct PendingRelease {
+  UploadQueue::Ticket ticket;
+  std::function<void()> function;
+};
+
+VkCommandPool uploadCommandPool;
+VkSemaphore uploadTimeline;
+Agnosia_T::AllocatedBuffer stagingRing;
+VkDeviceSize ringHead = 0;
+
+// All three in ticket order, the oldest at the front.
+std::deque<StagingSpan> stagingSpans;
+std::deque<SubmittedBatch> submittedBatches;
+std::deque<PendingRelease> pendingReleases;
+std::vector<VkCommandBuffer> freeCommandBuffers;
+// Staged outside the ring for the open batch, flushed when it goes.
+std::vector<VmaAllocation> dedicatedStaging;
+
+VkCommandBuffer openCommandBuffer = VK_NULL_HANDLE;
+UploadQueue::Ticket openTicket = 1;
+// Whether anything was recorded, staged or released against the open ticket.
+bool openUsed = false;
+UploadQueue::Ticket completedTicket = 0;
+uint64_t submitCount = 0;
+VkDeviceSize stagingInFlight = 0;
+VkDeviceSize stagingPeak = 0;
+
+// Hands back what the finished batches were holding on to.
+void collect() {
+  VK_CHECK(vkGetSemaphoreCounterValue(DeviceControl::getDevice(), uploadTimeline, &completedTicket));
+  while (!submittedBatches.empty() && submittedBatches.front().ticket <= completedTicket) {
+    if (submittedBatches.front().commandBuffer != VK_NULL_HANDLE) {
+      freeCommandBuffers.push_back(submittedBatches.front().commandBuffer);
+    }
+    submittedBatches.pop_front();
+  }
+  while (!stagingSpans.empty() && stagingSpans.front().ticket <= completedTicket) {
+    stagingInFlight -= stagingSpans.front().end - stagingSpans.front().begin;
+    stagingSpans.pop_front();
+  }
+  while (!pendingReleases.empty() && pendingReleases.front().ticket <= completedTicket) {
+    // Out of the queue before it runs, it may release something itself.
+    std::function<void()> function = std::move(pendingReleases.front().function);
+    pendingReleases.pop_front();
+    function();
+  }
+}
+
+// Written front to back and only read by the GPU, write combined memory is fine.
+void createRing() {
+  stagingRing = Buffers::createBuffer(stagingBudget, 0, Buffers::INTENT_STAGING);
+  ringHead = 0;
+}
+
+void UploadQueue::create() {
+  DeviceControl::QueueFamilyIndices queueFamilyIndices = DeviceControl::findQueueFamilies(DeviceControl::getPhysicalDevice());
+  VkCommandPoolCreateInfo poolInfo = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+    .queueFamilyIndex = queueFamilyIndices.graphicsFamily.value(),
+  };
+  VK_CHECK(vkCreateCommandPool(DeviceControl::getDevice(), &poolInfo, nullptr, &uploadCommandPool));
+
+  VkSemaphoreTypeCreateInfo timelineInfo = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+    .initialValue = 0,
+  };
+  VkSemaphoreCreateInfo semaphoreInfo = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    .pNext = &timelineInfo,
+  };
+  VK_CHECK(vkCreateSemaphore(DeviceControl::getDevice(), &semaphoreInfo, nullptr, &uploadTimeline));
+
+  createRing();
+
+  DeletionQueue::get().push_function([=](){
+    // Anything still open or in flight lands and runs its releases before the memory goes.
+    UploadQueue::wait(UploadQueue::submit());
+    vmaDestroyBuffer(Buffers::getAllocator(), stagingRing.buffer, stagingRing.allocation);
+    vkDestroySemaphore(DeviceControl::getDevice(), uploadTimeline, nullptr);
+    vkDestroyCommandPool(DeviceControl::getDevice(), uploadCommandPool, nullptr);
+  });
+}
+
+UploadQueue::Allocation UploadQueue::stage(VkDeviceSize size, VkDeviceSize alignment) {
+  const VkDeviceSize ringSize = stagingBudget;
+  if (size > ringSize) {
+    Agnosia_T::AllocatedBuffer buffer = Buffers::createBuffer(size, 0, Buffers::INTENT_STAGING);
+    dedicatedStaging.push_back(buffer.allocation);
+    stagingInFlight += size;
+    stagingPeak = std::max(stagingPeak, stagingInFlight);
+    release([=]() {
+      vmaDestroyBuffer(Buffers::getAllocator(), buffer.buffer, buffer.allocation);
+      stagingInFlight -= size;
+    });
+    return {buffer.buffer, 0, buffer.info.pMappedData};
+  }
+
+  VkDeviceSize offset = (ringHead + alignment - 1) / alignment * alignment;
+  if (offset + size > ringSize) {
+    // Wrap around, the end of the ring sits unused this time.
+    offset = 0;
+  }
+  // Caught up with bytes the GPU hasn't copied yet, the oldest batches have to finish first.
+  auto overlapsInFlight = [&]() {
+    for (const StagingSpan &span : stagingSpans) {
+      if (offset < span.end && span.begin < offset + size) {
+        return true;
+      }
+    }
+    return false;
+  };
+  while (overlapsInFlight()) {
+    wait(stagingSpans.front().ticket);
+  }
+  ringHead = offset + size;
+  stagingSpans.push_back({offset, offset + size, openTicket});
+  stagingInFlight += size;
+  stagingPeak = std::max(stagingPeak, stagingInFlight);
+  openUsed = true;
+  return {stagingRing.buffer, offset, static_cast<char *>(stagingRing.info.pMappedData) + offset};
+}
+
+void UploadQueue::stageChunked(size_t count, size_t stride,
+                               const std::function<void(void *destination, size_t first, size_t count)> &write,
+                               const std::function<void(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, size_t first, size_t count)> &copy) {
+  // At least one element a chunk, even one bigger than a chunk.
+  const size_t chunkCount = std::max<size_t>(1, getChunkSize() / stride);
+  for (size_t first = 0; first < count; first += chunkCount) {
+    const size_t elements = std::min(chunkCount, count - first);
+    const Allocation staging = stage(elements * stride);
+    write(staging.data, first, elements);
+    copy(getCommandBuffer(), staging.buffer, staging.offset, first, elements);
+    if (first + elements < count) {
+      // Let the GPU start on this one while the next is written.
+      submit();
+    }
+  }
+}
+
+VkCommandBuffer UploadQueue::getCommandBuffer() {
+  if (openCommandBuffer == VK_NULL_HANDLE) {
+    if (freeCommandBuffers.empty()) {
+      collect();
+    }
+    if (freeCommandBuffers.empty()) {
+      VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = uploadCommandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+      };
+      VK_CHECK(vkAllocateCommandBuffers(DeviceControl::getDevice(), &allocInfo, &openCommandBuffer));
+    } else {
+      openCommandBuffer = freeCommandBuffers.back();
+      freeCommandBuffers.pop_back();
+    }
+    VkCommandBufferBeginInfo beginInfo = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VK_CHECK(vkBeginCommandBuffer(openCommandBuffer, &beginInfo));
+  }
+  openUsed = true;
+  return openCommandBuffer;
+}
+
+UploadQueue::Ticket UploadQueue::getTicket() {
+  openUsed = true;
+  return openTicket;
+}
+
+UploadQueue::Ticket UploadQueue::submit() {
+  if (!openUsed) {
+    return openTicket - 1;
+  }
+  if (openCommandBuffer != VK_NULL_HANDLE) {
+    // Everything submitted after this batch, frames included, sees what it wrote,
+    // and so does the host once the ticket is done. Images are already moved to
+    // the layout they are read in by their own barriers.
+    VkMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_HOST_READ_BIT,
+    };
+    vkCmdPipelineBarrier(openCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    VK_CHECK(vkEndCommandBuffer(openCommandBuffer));
+  }
+  vmaFlushAllocation(Buffers::getAllocator(), stagingRing.allocation, 0, VK_WHOLE_SIZE);
+  for (VmaAllocation allocation : dedicatedStaging) {
+    vmaFlushAllocation(Buffers::getAllocator(), allocation, 0, VK_WHOLE_SIZE);
+  }
+  dedicatedStaging.clear();
+
+  // Releases alone still need a signal, an empty submit gives them one.
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {
+    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+    .signalSemaphoreValueCount = 1,
+    .pSignalSemaphoreValues = &openTicket,
+  };
+  VkSubmitInfo submitInfo = {
+    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .pNext = &timelineInfo,
+    .commandBufferCount = openCommandBuffer != VK_NULL_HANDLE ? 1u : 0u,
+    .pCommandBuffers = &openCommandBuffer,
+    .signalSemaphoreCount = 1,
+    .pSignalSemaphores = &uploadTimeline,
+  };
+  VK_CHECK(vkQueueSubmit(DeviceControl::getGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE));
+
+  submittedBatches.push_back({openCommandBuffer, openTicket});
+  openCommandBuffer = VK_NULL_HANDLE;
+  openUsed = false;
+  submitCount++;
+  const Ticket ticket = openTicket++;
+  collect();
+  return ticket;
+}
+
+bool UploadQueue::isComplete(Ticket ticket) {
+  if (ticket >= openTicket) {
+    return false;
+  }
+  if (ticket > completedTicket) {
+    collect();
+  }
+  return ticket <= completedTicket;
+}
+
+void UploadQueue::wait(Ticket ticket) {
+  if (ticket >= openTicket) {
+    submit();
+  }
+  if (ticket > completedTicket && ticket < openTicket) {
+    VkSemaphoreWaitInfo waitInfo = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+      .semaphoreCount = 1,
+      .pSemaphores = &uploadTimeline,
+      .pValues = &ticket,
+    };
+    VK_CHECK(vkWaitSemaphores(DeviceControl::getDevice(), &waitInfo, UINT64_MAX));
+  }
+  collect();
+}
+
+void UploadQueue::release(std::function<void()> &&function) {
+  pendingReleases.push_back({getTicket(), std::move(function)});
+}
+void UploadQueue::release(Agnosia_T::AllocatedBuffer buffer) {
+  release([=]() { vmaDestroyBuffer(Buffers::getAllocator(), buffer.buffer, buffer.allocation); });
+}
+
+VkDeviceSize UploadQueue::getStagingBudget() { return stagingBudget; }
+void UploadQueue::setStagingBudget(VkDeviceSize bytes) {
+  if (bytes != stagingBudget) {
+    // The ring can't grow or shrink in place, everything in it lands first.
+    wait(submit());
+    vmaDestroyBuffer(Buffers::getAllocator(), stagingRing.buffer, stagingRing.allocation);
+    stagingBudget = bytes;
+    createRing();
+  }
+  stagingPeak = stagingInFlight;
+}
+VkDeviceSize UploadQueue::getChunkSize() { return stagingBudget / 4; }
+
+uint64_t UploadQueue::getSubmitCount() { return submitCount; }
+VkDeviceSize UploadQueue::getStagingInFlight() { return stagingInFlight; }
+VkDeviceSize UploadQueue::getStagingPeak() { return stagingPeak; }
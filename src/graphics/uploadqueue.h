@@ -0,0 +1,78 @@
+#pragma once
+
+#include "volk.h"
+#include "vk_mem_alloc.h"
+#include "../utils/types.h"
+#include <cstdint>
+#include <functional>
+
+// Every copy to the GPU goes through here instead of a command buffer of its
+// own and a vkQueueWaitIdle. Staging memory comes out of one persistently
+// mapped ring, the copies are recorded into the open batch, and the whole batch
+// goes to the graphics queue in one submit that signals a timeline semaphore.
+// The value it signals is the batch's ticket, poll or wait on it to know the
+// copies landed. Main thread only.
+//
+// Nothing has to wait for the work to be usable by a frame, a batch ends with a
+// barrier making its writes visible to everything submitted after it, and the
+// main loop submits before drawing.
+class UploadQueue {
+public:
+  using Ticket = uint64_t;
+
+  // Where stage put the bytes, buffer and offset to copy from, data to write to.
+  struct Allocation {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    void *data;
+  };
+
+  // After the command pool, needs the allocator and the device.
+  static void create();
+
+  // size bytes of mapped staging memory, valid until the current batch is done.
+  // Bigger than the ring gets a buffer of its own, stageChunked keeps big
+  // uploads from needing one. Staging may have to submit the open batch to
+  // make room, record the copies out of one allocation before asking for the next.
+  static Allocation stage(VkDeviceSize size, VkDeviceSize alignment = 16);
+  // Stages count elements of stride bytes in chunks of at most getChunkSize.
+  // write fills count elements from first on at destination, copy records the
+  // copy of those elements out of buffer at offset. With more than one chunk
+  // each goes to the GPU as soon as it's written, so the CPU fills the next one
+  // while the last is copied, and only a few chunks are ever staged at once.
+  static void stageChunked(size_t count, size_t stride,
+                           const std::function<void(void *destination, size_t first, size_t count)> &write,
+                           const std::function<void(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, size_t first, size_t count)> &copy);
+  // The open batch, recording. Anything recorded ends up in getTicket().
+  static VkCommandBuffer getCommandBuffer();
+  // What the open batch will signal once it's done.
+  static Ticket getTicket();
+  // Sends the open batch off, returns its ticket. Without anything recorded,
+  // staged or released since the last one nothing is submitted and the last
+  // ticket comes back.
+  static Ticket submit();
+  static bool isComplete(Ticket ticket);
+  // Submits first if the ticket is the open batch's.
+  static void wait(Ticket ticket);
+
+  // Runs function once everything recorded so far and every frame already
+  // submitted is done with what it frees.
+  static void release(std::function<void()> &&function);
+  static void release(Agnosia_T::AllocatedBuffer buffer);
+
+  // Size of the ring, the most staging memory uploads hold at once unless a
+  // single element is bigger than a chunk. Changing it waits for everything in
+  // flight and makes a new ring, setting it at all restarts the peak. Read from
+  // any thread.
+  static VkDeviceSize getStagingBudget();
+  static void setStagingBudget(VkDeviceSize bytes);
+  // Largest piece stageChunked stages, a quarter of the ring so two are always
+  // in flight whatever else sits in it.
+  static VkDeviceSize getChunkSize();
+
+  // Batches submitted so far, staging bytes the GPU hasn't read yet and the
+  // most there ever were since the budget was set.
+  static uint64_t getSubmitCount();
+  static VkDeviceSize getStagingInFlight();
+  static VkDeviceSize getStagingPeak();
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../utils/types.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Reorders a triangle list for the GPU's post-transform vertex cache, then the
+// vertex buffer for fetch locality. Everything runs on the CPU and the cache is
+// simulated, so the gain can be measured without a GPU in the loop.
+class VertexCache {
+public:
+  // Post-transform cache size we optimize for and simulate, most hardware
+  // behaves at least as well as a 16 entry FIFO.
+  static constexpr uint32_t CACHE_SIZE = 16;
+
+  // ACMR: vertex shader invocations per triangle, 0.5 is the ideal for a regular grid.
+  // ATVR: vertex shader invocations per unique vertex, 1.0 is ideal.
+  static Agnosia_T::CacheStats analyze(const std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+  // Tipsify (Sander, Nehab & Barczak 2007), linear time in the index count.
+  static void optimizeTriangleOrder(std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+  // Expects a cache optimized order. Splits it into clusters and sorts them so
+  // the ones facing out from the center of the mesh are drawn first and occlude
+  // the rest, for about 5% more ACMR at most. The order inside a cluster is kept.
+  static void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<Agnosia_T::Vertex> &vertices, uint32_t cacheSize = CACHE_SIZE);
+
+  // Renumbers the vertices in the order the index buffer first touches them,
+  // dropping the ones no triangle references.
+  static void optimizeVertexFetch(std::vector<Agnosia_T::Vertex> &vertices, std::vector<uint32_t> &indices);
+};
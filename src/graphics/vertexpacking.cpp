@@ -0,0 +1,149 @@
+#include "vertexpacking.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+constexpr float UNORM16_MAX = 65535.0f;
+constexpr float SNORM16_MAX = 32767.0f;
+
+// The same rounding GLSL's packUnorm2x16/packSnorm2x16 use, so a mesh packed
+// here decodes with unpackUnorm2x16/unpackSnorm2x16.
+uint16_t packUnorm16(float value) {
+  return static_cast<uint16_t>(std::round(std::clamp(value, 0.0f, 1.0f) * UNORM16_MAX));
+}
+int16_t packSnorm16(float value) {
+  return static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * SNORM16_MAX));
+}
+float unpackSnorm16(int16_t value) {
+  return std::max(value / SNORM16_MAX, -1.0f);
+}
+float signNotZero(float value) {
+  return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+// Octahedral normal encoding (Cigolle et al. 2014), the sphere is projected
+// onto an octahedron and the lower half folded over the upper one, which
+// spreads the precision of two numbers about evenly over every direction.
+glm::vec2 octEncode(const glm::vec3 &normal) {
+  const float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  if (l1 == 0.0f) {
+    return glm::vec2(0.0f);
+  }
+  glm::vec2 encoded = glm::vec2(normal.x, normal.y) / l1;
+  if (normal.z < 0.0f) {
+    encoded = glm::vec2((1.0f - std::abs(encoded.y)) * signNotZero(encoded.x),
+                        (1.0f - std::abs(encoded.x)) * signNotZero(encoded.y));
+  }
+  return encoded;
+}
+glm::vec3 octDecode(const glm::vec2 &encoded) {
+  glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+  const float fold = std::max(-normal.z, 0.0f);
+  normal.x += normal.x >= 0.0f ? -fold : fold;
+  normal.y += normal.y >= 0.0f ? -fold : fold;
+  return glm::normalize(normal);
+}
+
+uint16_t VertexPacking::floatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const uint32_t floatExponent = (bits >> 23) & 0xFF;
+  uint32_t mantissa = bits & 0x7FFFFF;
+  if (floatExponent == 0xFF) {
+    // Infinity stays infinity, NaN stays NaN.
+    return static_cast<uint16_t>(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+  }
+  const int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+  if (exponent >= 31) {
+    return static_cast<uint16_t>(sign | 0x7C00);
+  }
+  // Round to nearest even everywhere, carrying into the exponent is fine and
+  // turns the largest values into infinity like it should.
+  if (exponent <= 0) {
+    if (exponent < -10) {
+      return static_cast<uint16_t>(sign);
+    }
+    mantissa |= 0x800000;
+    const uint32_t shift = static_cast<uint32_t>(14 - exponent);
+    uint32_t half = mantissa >> shift;
+    const uint32_t remainder = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half & 1))) {
+      half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+  }
+  uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+  const uint32_t remainder = mantissa & 0x1FFF;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+    half++;
+  }
+  return static_cast<uint16_t>(sign | half);
+}
+
+float VertexPacking::halfToFloat(uint16_t half) {
+  const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  const uint32_t exponent = (half >> 10) & 0x1F;
+  const uint32_t mantissa = half & 0x3FF;
+  if (exponent == 0) {
+    const float value = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign != 0 ? -value : value;
+  }
+  const uint32_t bits = exponent == 31 ? sign | 0x7F800000 | (mantissa << 13)
+                                       : sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+Agnosia_T::PackedVertex VertexPacking::pack(const Agnosia_T::Vertex &vertex, const Agnosia_T::Bounds &bounds) {
+  Agnosia_T::PackedVertex packed{};
+  const glm::vec3 extent = bounds.max - bounds.min;
+  for (int axis = 0; axis < 3; axis++) {
+    // Flat meshes have no extent along one axis, everything there sits on the minimum.
+    packed.pos[axis] = extent[axis] > 0.0f ? packUnorm16((vertex.pos[axis] - bounds.min[axis]) / extent[axis]) : 0;
+  }
+  const glm::vec2 normal = octEncode(vertex.normal);
+  packed.normal[0] = packSnorm16(normal.x);
+  packed.normal[1] = packSnorm16(normal.y);
+  packed.uv[0] = floatToHalf(vertex.uv.x);
+  packed.uv[1] = floatToHalf(vertex.uv.y);
+  return packed;
+}
+
+Agnosia_T::Vertex VertexPacking::unpack(const Agnosia_T::PackedVertex &packed, const Agnosia_T::Bounds &bounds) {
+  Agnosia_T::Vertex vertex;
+  const glm::vec3 fraction(packed.pos[0] / UNORM16_MAX, packed.pos[1] / UNORM16_MAX, packed.pos[2] / UNORM16_MAX);
+  vertex.pos = bounds.min + fraction * (bounds.max - bounds.min);
+  vertex.normal = octDecode(glm::vec2(unpackSnorm16(packed.normal[0]), unpackSnorm16(packed.normal[1])));
+  vertex.color = glm::vec3(1.0f);
+  vertex.uv = glm::vec2(halfToFloat(packed.uv[0]), halfToFloat(packed.uv[1]));
+  return vertex;
+}
+
+void VertexPacking::packAll(const Agnosia_T::Vertex *vertices, size_t vertexCount, const Agnosia_T::Bounds &bounds,
+                            Agnosia_T::PackedVertex *destination) {
+  for (size_t i = 0; i < vertexCount; i++) {
+    destination[i] = pack(vertices[i], bounds);
+  }
+}
+
+Agnosia_T::PackingError VertexPacking::measureError(const Agnosia_T::Vertex *vertices, size_t vertexCount,
+                                                    const Agnosia_T::Bounds &bounds) {
+  Agnosia_T::PackingError error{};
+  for (size_t i = 0; i < vertexCount; i++) {
+    const Agnosia_T::Vertex &vertex = vertices[i];
+    const Agnosia_T::Vertex unpacked = unpack(pack(vertex, bounds), bounds);
+    error.position = std::max(error.position, glm::length(unpacked.pos - vertex.pos));
+    const float normalLength = glm::length(vertex.normal);
+    if (normalLength > 0.0f) {
+      // atan2 rather than acos of the dot, which can't resolve angles this small in floats.
+      const glm::vec3 normal = vertex.normal / normalLength;
+      const float angle = std::atan2(glm::length(glm::cross(unpacked.normal, normal)), glm::dot(unpacked.normal, normal));
+      error.normal = std::max(error.normal, glm::degrees(angle));
+    }
+    error.uv = std::max(error.uv, std::max(std::abs(unpacked.uv.x - vertex.uv.x), std::abs(unpacked.uv.y - vertex.uv.y)));
+  }
+  return error;
+}
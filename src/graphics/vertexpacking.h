@@ -0,0 +1,24 @@
+#pragma once
+
+#include "../utils/types.h"
+#include <cstddef>
+#include <cstdint>
+
+// Packs vertices into Agnosia_T::PackedVertex and back. The unpack side is
+// the exact mirror of unpackVertex in shaders/vertexpacking.glsl, change
+// both together or the error report stops meaning anything.
+class VertexPacking {
+public:
+  static Agnosia_T::PackedVertex pack(const Agnosia_T::Vertex &vertex, const Agnosia_T::Bounds &bounds);
+  // What the vertex shader gets back, color is always white.
+  static Agnosia_T::Vertex unpack(const Agnosia_T::PackedVertex &packed, const Agnosia_T::Bounds &bounds);
+  static void packAll(const Agnosia_T::Vertex *vertices, size_t vertexCount, const Agnosia_T::Bounds &bounds,
+                      Agnosia_T::PackedVertex *destination);
+
+  // Round trips every vertex and returns the largest error of each attribute.
+  static Agnosia_T::PackingError measureError(const Agnosia_T::Vertex *vertices, size_t vertexCount,
+                                              const Agnosia_T::Bounds &bounds);
+
+  static uint16_t floatToHalf(float value);
+  static float halfToFloat(uint16_t half);
+};
@@ -0,0 +1,78 @@
+#include "vertexremap.h"
+#include "../utils/hash.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+// Key the table on bits rather than float equality, so -0.0 and 0.0 have to be
+// folded together first or they would land in different slots.
+inline Agnosia_T::Vertex canonicalize(const Agnosia_T::Vertex &vertex) {
+  Agnosia_T::Vertex canonical = vertex;
+  float *components = reinterpret_cast<float *>(&canonical);
+  for (size_t i = 0; i < sizeof(Agnosia_T::Vertex) / sizeof(float); i++) {
+    components[i] += 0.0f;
+  }
+  return canonical;
+}
+
+VertexRemap::VertexRemap(size_t expectedVertices) : stats{} {
+  // Keep the load factor at or below one half, linear probing stays short there.
+  const size_t capacity = std::bit_ceil(std::max<size_t>(expectedVertices * 2, 64));
+  this->slots.assign(capacity, Slot{0, EMPTY});
+  this->mask = capacity - 1;
+  this->vertices.reserve(expectedVertices);
+  this->stats.capacity = capacity;
+}
+
+uint32_t VertexRemap::insert(const Agnosia_T::Vertex &vertex) {
+  const Agnosia_T::Vertex key = canonicalize(vertex);
+  const uint32_t hash = static_cast<uint32_t>(Hash::bytes(&key, sizeof(Agnosia_T::Vertex)));
+  this->stats.lookups++;
+
+  size_t slot = hash & this->mask;
+  size_t probe = 0;
+  while (this->slots[slot].index != EMPTY) {
+    // Compare the stored hash first, it rejects almost every non-match
+    // without touching the vertex array.
+    if (this->slots[slot].hash == hash &&
+        memcmp(&this->vertices[this->slots[slot].index], &key, sizeof(Agnosia_T::Vertex)) == 0) {
+      break;
+    }
+    slot = (slot + 1) & this->mask;
+    probe++;
+  }
+  this->stats.collisions += probe;
+  this->stats.longestProbe = std::max(this->stats.longestProbe, probe);
+
+  if (this->slots[slot].index != EMPTY) {
+    return this->slots[slot].index;
+  }
+  const uint32_t index = static_cast<uint32_t>(this->vertices.size());
+  this->slots[slot] = {hash, index};
+  this->vertices.push_back(key);
+  if (this->vertices.size() * 2 > this->slots.size()) {
+    grow();
+  }
+  return index;
+}
+
+void VertexRemap::grow() {
+  // Every slot remembers its full hash, so rehashing never touches a vertex.
+  std::vector<Slot> old = std::move(this->slots);
+  this->slots.assign(old.size() * 2, Slot{0, EMPTY});
+  this->mask = this->slots.size() - 1;
+  this->stats.capacity = this->slots.size();
+  for (const Slot &entry : old) {
+    if (entry.index == EMPTY) {
+      continue;
+    }
+    size_t slot = entry.hash & this->mask;
+    while (this->slots[slot].index != EMPTY) {
+      slot = (slot + 1) & this->mask;
+    }
+    this->slots[slot] = entry;
+  }
+}
+
+std::vector<Agnosia_T::Vertex> &VertexRemap::getVertices() { return this->vertices; }
+VertexRemap::Stats VertexRemap::getStats() const { return this->stats; }
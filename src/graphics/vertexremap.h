@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../utils/types.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Builds the unique vertex buffer and index remap for a stream of triangle
+// corners. It is an open addressing table (linear probing over a flat array)
+// keyed by the raw bits of the vertex, so a lookup is one hash, one cache line
+// and usually one compare, and inserting a corner is a single probe sequence.
+class VertexRemap {
+public:
+  struct Stats {
+    size_t lookups;
+    // Slots visited past the home slot, summed over every lookup.
+    size_t collisions;
+    size_t longestProbe;
+    size_t capacity;
+  };
+
+  explicit VertexRemap(size_t expectedVertices = 0);
+
+  // Returns the index of the vertex in the unique buffer, adding it if unseen.
+  uint32_t insert(const Agnosia_T::Vertex &vertex);
+
+  std::vector<Agnosia_T::Vertex> &getVertices();
+  Stats getStats() const;
+
+private:
+  struct Slot {
+    uint32_t hash;
+    uint32_t index;
+  };
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+
+  void grow();
+
+  std::vector<Slot> slots;
+  size_t mask;
+  std::vector<Agnosia_T::Vertex> vertices;
+  Stats stats;
+};
@@ -7,38 +7,39 @@ layout(set = 1, binding = 2) uniform sampler _sampler;
 layout(location = 0) in vec3 v_norm;
 layout(location = 1) in vec3 v_pos;
 layout(location = 2) in vec2 texCoord;
+layout(location = 3) flat in uint textureSlot;
 
 layout(location = 0) out vec4 outColor;
 
 // Trowbridge-Reitz GGX NDF- Approximate the relative surface area of microfacets exactly aligned to the halfway vector.
-vec3 DistributionTRGGX(vec3 N, vec3 H, vec3 roughness) {
-  vec3 a = roughness*roughness;
-  vec3 a2 = a*a;
+float DistributionTRGGX(vec3 N, vec3 H, float roughness) {
+  float a = roughness*roughness;
+  float a2 = a*a;
   float NdotH = max(dot(N, H), 0.0);
   float NdotH2 = NdotH*NdotH;
 
-  vec3 num = a2;
-  vec3 denom = (NdotH2 * (a2 - 1.0) + 1.0);
+  float num = a2;
+  float denom = (NdotH2 * (a2 - 1.0) + 1.0);
   denom = 3.14159 * denom * denom;
 
   return num / denom;
 }
 // Schlick GGX, Approximate overshadowed microfacets occlusion. 
-vec3 GeometrySchlickGGX(float NdotV, vec3 roughness) {
-  vec3 r = (roughness + vec3(1.0));
-  vec3 k = (r*r) / 8.0;
+float GeometrySchlickGGX(float NdotV, float roughness) {
+  float r = (roughness + 1.0);
+  float k = (r*r) / 8.0;
 
   float num = NdotV;  
-  vec3 denom = NdotV * (1.0 - k) + k;
+  float denom = NdotV * (1.0 - k) + k;
 	
   return num / denom;
 }
 // Smith's method- take into account both view direction and light direction.
-vec3 GeometrySmith(vec3 normal, vec3 viewDir, vec3 lightDir, vec3 k) {
+float GeometrySmith(vec3 normal, vec3 viewDir, vec3 lightDir, float k) {
   float NdotV = max(dot(normal, viewDir), 0.0);
   float NdotL = max(dot(normal, lightDir), 0.0);
-  vec3 ggx1 = GeometrySchlickGGX(NdotV, k);
-  vec3 ggx2 = GeometrySchlickGGX(NdotL, k);
+  float ggx1 = GeometrySchlickGGX(NdotV, k);
+  float ggx2 = GeometrySchlickGGX(NdotL, k);
 
   return ggx1 * ggx2;
 }
@@ -51,10 +52,23 @@ void main() {
   const float PI = 3.14159265359;
 
   vec3 lightColor = gpuBuffer.lightColor * gpuBuffer.lightPower;
-  vec3 albedo = texture(sampler2D(_texture[gpuBuffer.diffuseID], _sampler), texCoord).rgb;
-  vec3 metallic = texture(sampler2D(_texture[gpuBuffer.metallicID], _sampler), texCoord).rgb;
-  vec3 ao = texture(sampler2D(_texture[gpuBuffer.aoID], _sampler), texCoord).rgb;
-  vec3 roughness = texture(sampler2D(_texture[gpuBuffer.roughnessID], _sampler), texCoord).rgb;
+  // Instances of one draw can use different materials, so the index isn't uniform.
+  // The mode is flat per instance, so every pixel of a quad takes the same branch.
+  uint slot = textureSlot & ~MATERIAL_PACKED;
+  vec3 albedo = texture(sampler2D(_texture[nonuniformEXT(slot)], _sampler), texCoord).rgb;
+  float metallic, ao, roughness;
+  if ((textureSlot & MATERIAL_PACKED) != 0u) {
+    // Occlusion, roughness and metallic in one fetch.
+    vec3 orm = texture(sampler2D(_texture[nonuniformEXT(slot + 1)], _sampler), texCoord).rgb;
+    ao = orm.r;
+    roughness = orm.g;
+    metallic = orm.b;
+  } else {
+    // Single channel R8 or BC4 images, only red holds anything.
+    metallic = texture(sampler2D(_texture[nonuniformEXT(slot + 1)], _sampler), texCoord).r;
+    ao = texture(sampler2D(_texture[nonuniformEXT(slot + 2)], _sampler), texCoord).r;
+    roughness = texture(sampler2D(_texture[nonuniformEXT(slot + 3)], _sampler), texCoord).r;
+  }
   
   vec3 F0 = vec3(0.04); 
   F0 = mix(F0, albedo, metallic);
@@ -74,8 +88,8 @@ void main() {
     vec3 radiance = lightColor * attenuation;
       
     // Cook-Torrance BRDF
-    vec3 NDF = DistributionTRGGX(N, H, roughness);       
-    vec3 G = GeometrySmith(N, V, L, roughness);       
+    float NDF = DistributionTRGGX(N, H, roughness);       
+    float G = GeometrySmith(N, V, L, roughness);       
     vec3 F = fresnelSchlick(max(dot(H, V), 0.0), F0);
     
     vec3 kS = F;
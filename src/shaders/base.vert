@@ -4,15 +4,19 @@
 layout(location = 0) out vec3 v_norm;
 layout(location = 1) out vec3 v_pos;
 layout(location = 2) out vec2 texCoord;
+layout(location = 3) flat out uint textureSlot;
 
 
 void main() {
-    Vertex vertex = gpuBuffer.vertBuffer.vertices[gl_VertexIndex];
+    Vertex vertex = fetchVertex(gl_VertexIndex);
+    // gl_InstanceIndex already includes the draw's firstInstance.
+    Instance instance = gpuBuffer.instanceBuffer.instances[gl_InstanceIndex];
     
     gl_Position = gpuBuffer.proj * gpuBuffer.view * gpuBuffer.model * 
-                    vec4(vertex.pos + gpuBuffer.objPos, 1.0f);
+                    vec4(vertex.pos + instance.position, 1.0f);
                     
     v_norm = vertex.normal;
     v_pos = vertex.pos;
     texCoord = vertex.texCoord;
+    textureSlot = instance.textureSlot;
 }
@@ -8,25 +8,42 @@ struct Vertex {
     vec3 color;
     vec2 texCoord;
 }; 
+#include "vertexpacking.glsl"
 
 layout(buffer_reference, scalar) readonly buffer VertexBuffer { 
 	Vertex vertices[];
 };
+struct Instance {
+    vec3 position;
+    uint textureSlot;
+};
+// Material::PACKED_SLOT_BIT, the material's second texture is ORM and there is no third or fourth.
+const uint MATERIAL_PACKED = 0x80000000u;
+layout(buffer_reference, scalar) readonly buffer InstanceBuffer {
+    Instance instances[];
+};
 layout(buffer_reference, scalar) readonly buffer GPUBuffer { 
     VertexBuffer vertBuffer;
-    vec3 objPos;
+    InstanceBuffer instanceBuffer;
     vec3 lightPos;
     vec3 lightColor;
     float lightPower;
     vec3 camPos;
-    int diffuseID;
-    int metallicID;
-    int aoID;
-    int roughnessID;
     mat4 model;
     mat4 view;
     mat4 proj;
+    vec3 boundsMin;
+    vec3 boundsExtent;
+    uint vertexFormat;
 };
 layout(push_constant, scalar) uniform constants {
     GPUBuffer gpuBuffer;
 };
+
+// Whichever layout the mesh was uploaded in, the same Vertex comes out.
+Vertex fetchVertex(int index) {
+    if (gpuBuffer.vertexFormat == VERTEX_PACKED) {
+        return unpackVertex(PackedVertexBuffer(gpuBuffer.vertBuffer).vertices[index], gpuBuffer.boundsMin, gpuBuffer.boundsExtent);
+    }
+    return gpuBuffer.vertBuffer.vertices[index];
+}
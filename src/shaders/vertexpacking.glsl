@@ -0,0 +1,36 @@
+// Decode side of VertexPacking (src/graphics/vertexpacking.cpp), change both together.
+// Needs Vertex declared before it's included.
+
+const uint VERTEX_FULL = 0;
+const uint VERTEX_PACKED = 1;
+
+// Agnosia_T::PackedVertex read as four words: 16 bit position x and y, z and
+// padding, the octahedral normal as two snorms, and the UV as two halfs.
+struct PackedVertex {
+    uint posXY;
+    uint posZ;
+    uint normal;
+    uint texCoord;
+};
+
+layout(buffer_reference, scalar) readonly buffer PackedVertexBuffer {
+    PackedVertex vertices[];
+};
+
+vec3 octDecode(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+}
+
+Vertex unpackVertex(PackedVertex packed, vec3 boundsMin, vec3 boundsExtent) {
+    Vertex vertex;
+    vec3 fraction = vec3(unpackUnorm2x16(packed.posXY), unpackUnorm2x16(packed.posZ).x);
+    vertex.pos = boundsMin + fraction * boundsExtent;
+    vertex.normal = octDecode(unpackSnorm2x16(packed.normal));
+    vertex.color = vec3(1.0);
+    vertex.texCoord = unpackHalf2x16(packed.texCoord);
+    return vertex;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Fast non-cryptographic hashing, a multiply-fold mixer in the style of wyhash.
+// Good avalanche on every input bit, which our hash tables rely on since they
+// take the low bits of the result directly as a slot index.
+class Hash {
+  public:
+    static constexpr uint64_t SEED = 0xa0761d6478bd642full;
+
+    static inline uint64_t mix(uint64_t a, uint64_t b) {
+      __uint128_t product = static_cast<__uint128_t>(a) * b;
+      return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+    }
+
+    static inline uint64_t bytes(const void* data, size_t size, uint64_t seed = SEED) {
+      const uint8_t* cursor = static_cast<const uint8_t*>(data);
+      uint64_t hash = seed ^ mix(size ^ 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull);
+
+      while(size >= 16) {
+        hash = mix(read64(cursor) ^ 0x589965cc75374cc3ull, read64(cursor + 8) ^ hash);
+        cursor += 16;
+        size -= 16;
+      }
+      uint64_t a = 0, b = 0;
+      if(size >= 8) {
+        a = read64(cursor);
+        b = read64(cursor + size - 8);
+      } else if(size >= 4) {
+        a = read32(cursor);
+        b = read32(cursor + size - 4);
+      } else if(size > 0) {
+        a = (static_cast<uint64_t>(cursor[0]) << 16) | (static_cast<uint64_t>(cursor[size >> 1]) << 8) | cursor[size - 1];
+      }
+      return mix(0x1d8e4e27c47d124full ^ a, hash ^ b ^ 0xe7037ed1a0b428dbull);
+    }
+
+  private:
+    static inline uint64_t read64(const uint8_t* p) {
+      uint64_t value;
+      memcpy(&value, p, sizeof(value));
+      return value;
+    }
+    static inline uint64_t read32(const uint8_t* p) {
+      uint32_t value;
+      memcpy(&value, p, sizeof(value));
+      return value;
+    }
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Cooked assets remember which version of their source they came from, if
+// either the size or the write time differ, the source was edited and we recook.
+struct SourceStamp {
+  uint64_t size;
+  int64_t time;
+};
+
+inline bool stampSource(const std::string &sourcePath, SourceStamp &stamp) {
+  std::error_code error;
+  stamp.size = std::filesystem::file_size(sourcePath, error);
+  if (error) {
+    return false;
+  }
+  stamp.time = std::filesystem::last_write_time(sourcePath, error).time_since_epoch().count();
+  return !error;
+}
+
+// One stamp for an asset cooked from several sources, it changes when any of them does.
+inline bool stampSources(const std::vector<std::string> &sourcePaths, SourceStamp &stamp) {
+  uint64_t size = 0, time = 0;
+  for (const std::string &sourcePath : sourcePaths) {
+    SourceStamp source;
+    if (!stampSource(sourcePath, source)) {
+      return false;
+    }
+    size = size * 31 + source.size;
+    time = time * 31 + static_cast<uint64_t>(source.time);
+  }
+  stamp = {.size = size, .time = static_cast<int64_t>(time)};
+  return true;
+}
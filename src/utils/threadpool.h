@@ -0,0 +1,118 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads, one per core, that chew through a shared job
+// queue. Loading work (parsing, decoding, mesh processing) gets split across it.
+class ThreadPool {
+  public:
+    static ThreadPool& get() {
+      static ThreadPool instance;
+      return instance;
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Fire and forget, the job runs on whichever worker picks it up first.
+    void enqueue(std::function<void()>&& job) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+      }
+      wake.notify_one();
+    }
+
+    // Runs body(i) for every i in [0, count) and returns once all of them are done.
+    // The calling thread works on the range too, so calling this from inside a
+    // job is fine, worst case the caller just does everything itself.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body) {
+      if(count == 0) return;
+      if(count == 1 || workers.empty()) {
+        for(size_t i = 0; i < count; i++) body(i);
+        return;
+      }
+      struct Range {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+      };
+      auto range = std::make_shared<Range>();
+      range->remaining = count;
+
+      auto work = [range, count, &body]() {
+        size_t i;
+        while((i = range->next.fetch_add(1)) < count) {
+          body(i);
+          if(range->remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(range->mutex);
+            range->done.notify_all();
+          }
+        }
+      };
+      // Helpers that start after the range is exhausted see next >= count and
+      // return without touching body, so it is safe for them to outlive this call.
+      const size_t helpers = std::min(count - 1, workers.size());
+      for(size_t i = 0; i < helpers; i++) {
+        enqueue([range, count, &body, work]() {
+          if(range->next.load() < count) work();
+        });
+      }
+      work();
+
+      std::unique_lock<std::mutex> lock(range->mutex);
+      range->done.wait(lock, [&]() { return range->remaining.load() == 0; });
+    }
+
+    size_t getThreadCount() const {
+      return workers.size() + 1;
+    }
+
+  private:
+    ThreadPool() {
+      // Leave one core for the thread that is submitting the work.
+      const unsigned int cores = std::max(2u, std::thread::hardware_concurrency());
+      for(unsigned int i = 0; i < cores - 1; i++) {
+        workers.emplace_back([this]() { workerLoop(); });
+      }
+    }
+    ~ThreadPool() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      wake.notify_all();
+      for(std::thread& worker : workers) {
+        worker.join();
+      }
+    }
+
+    void workerLoop() {
+      while(true) {
+        std::function<void()> job;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+          if(stopping && jobs.empty()) return;
+          job = std::move(jobs.front());
+          jobs.pop_front();
+        }
+        job();
+      }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
@@ -0,0 +1,17 @@
+#pragma once
+#include <chrono>
+
+// Dead simple wall clock stopwatch, starts counting as soon as it is constructed.
+class Timer {
+  public:
+    Timer() : start(std::chrono::steady_clock::now()) {}
+
+    void reset() {
+      start = std::chrono::steady_clock::now();
+    }
+    double elapsedMs() const {
+      return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+  private:
+    std::chrono::steady_clock::time_point start;
+};
@@ -3,6 +3,7 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include "vk_mem_alloc.h"
 #include <glm/glm.hpp>
+#include <vector>
 
 class Agnosia_T {
 public:
@@ -19,6 +20,93 @@ public:
              color == other.color && uv == other.uv;
     }
   };
+  struct PackedVertex {
+    // The compact alternative to Vertex, 16 bytes instead of 44, see
+    // VertexPacking and shaders/vertexpacking.glsl which decode it.
+    // Position as 16 bit fractions of the mesh bounds.
+    uint16_t pos[3];
+    uint16_t padding;
+    // Octahedral encoded unit normal, as two 16 bit snorms.
+    int16_t normal[2];
+    // Half floats.
+    uint16_t uv[2];
+  };
+  enum VertexFormat {
+    // Has to match the VERTEX_ constants in vertexpacking.glsl.
+    VERTEX_FULL,
+    VERTEX_PACKED,
+  };
+  struct PackingError {
+    // Worst case round trip error over every vertex of a mesh, in model units
+    // for the position, degrees for the normal and UV units for the UV.
+    float position;
+    float normal;
+    float uv;
+  };
+  struct Bounds {
+    // Axis aligned box in model space, computed once when the mesh is loaded.
+    glm::vec3 min;
+    glm::vec3 max;
+    // Bounding sphere around the center of the box, usually a good deal
+    // tighter than half its diagonal.
+    float radius;
+  };
+  struct CacheStats {
+    // Post-transform vertex cache efficiency of an index buffer, see VertexCache::analyze.
+    float acmr;
+    float atvr;
+  };
+  struct LodLevel {
+    // A range of the model's index buffer, level 0 is the full mesh.
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // Estimate of how far, in model space, this level deviates from the full
+    // mesh. Comes from the simplifier's quadrics, so it is an average over the
+    // collapsed area rather than a hard bound.
+    float error;
+  };
+  struct Meshlet {
+    // Laid out for std430, the GPU reads these straight from the meshlet buffer.
+    glm::vec3 center;
+    float radius;
+    // Every triangle faces away from a camera inside the cone behind the apex,
+    // dot(normalize(apex - camera), axis) >= cutoff. A cutoff of 1 never culls.
+    glm::vec3 coneApex;
+    float coneCutoff;
+    glm::vec3 coneAxis;
+    uint32_t vertexOffset;
+    // In bytes, into the meshlet triangle buffer.
+    uint32_t triangleOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    uint32_t padding;
+  };
+  struct MeshData {
+    // Everything the loader produces for one mesh, what gets cooked to disk.
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<LodLevel> lods;
+    // Clusters of the full detail level.
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint8_t> meshletTriangles;
+    Bounds bounds;
+    CacheStats cacheBefore;
+    CacheStats cacheAfter;
+  };
+  struct MeshView {
+    // The arrays of a MeshData wherever they live, a vector or a mapped cooked file.
+    const Vertex *vertices;
+    size_t vertexCount;
+    const uint32_t *indices;
+    size_t indexCount;
+    const Meshlet *meshlets;
+    size_t meshletCount;
+    const uint32_t *meshletVertices;
+    size_t meshletVertexCount;
+    const uint8_t *meshletTriangles;
+    size_t meshletTriangleBytes;
+  };
   struct Pipeline {
     VkPipeline pipeline;
     VkPipelineLayout layout;
@@ -28,28 +116,50 @@ public:
     VmaAllocation allocation;
     VmaAllocationInfo info;
   };
+  // Where a mesh sits in the geometry pools right now, see GeometryPool. Every
+  // mesh of a vertex format shares the vertex buffer, draws start at
+  // vertexOffset and firstIndex. Compaction moves them, don't keep it.
   struct GPUMeshBuffers {
-    AllocatedBuffer indexBuffer;
-    VkDeviceAddress indexBufferAddress;
-    AllocatedBuffer vertexBuffer;
+    VkBuffer indexBuffer;
+    // 16 bit whenever every vertex is reachable with one, see Mesh::uploadBuffers.
+    VkIndexType indexType;
+    uint32_t firstIndex;
     VkDeviceAddress vertexBufferAddress;
+    int32_t vertexOffset;
+    // Null for a mesh without meshlets.
+    VkDeviceAddress meshletBufferAddress;
+    VkDeviceAddress meshletVertexBufferAddress;
+    VkDeviceAddress meshletTriangleBufferAddress;
+  };
+
+  // One copy of a mesh in an instanced draw, indexed by gl_InstanceIndex.
+  struct InstanceData {
+    glm::vec3 position;
+    // First of the material's textures, diffuse, metallic, AO and roughness in
+    // that order, or diffuse and ORM with Material::PACKED_SLOT_BIT set.
+    uint32_t textureSlot;
   };
 
+  // One per draw, every instance of the draw shares it.
   struct SceneData {
     VkDeviceAddress vertexBuffer;
-    glm::vec3 objPosition;
+    VkDeviceAddress instanceBuffer;
     glm::vec3 lightPos;
     glm::vec3 lightColor;
     float lightPower;
     glm::vec3 camPos;
-    int diffuseID;
-    int metallicID;
-    int aoID;
-    int roughnessID;
     glm::mat4 model;
     glm::mat4 view;
     glm::mat4 proj;
+    // Packed positions are relative to the mesh bounds.
+    glm::vec3 boundsMin;
+    glm::vec3 boundsExtent;
+    uint32_t vertexFormat;
+    // Draws sit back to back in the scene buffer and GPUBuffer references
+    // need 16 byte alignment, so the stride is rounded up to it.
+    uint32_t padding[3];
   };
+  static_assert(sizeof(SceneData) % 16 == 0);
 
   struct GPUPushConstants {
     VkDeviceAddress gpuBufferAddress;